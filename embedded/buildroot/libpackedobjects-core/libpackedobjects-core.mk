@@ -0,0 +1,12 @@
+#############################################################
+#
+# libpackedobjects-core
+#
+ #############################################################
+LIBPACKEDOBJECTS_CORE_VERSION = 0.0.9
+LIBPACKEDOBJECTS_CORE_SOURCE = libpackedobjects-$(LIBPACKEDOBJECTS_CORE_VERSION).tar.gz
+LIBPACKEDOBJECTS_CORE_SITE = http://zedstar.org/tarballs
+LIBPACKEDOBJECTS_CORE_INSTALL_STAGING = YES
+LIBPACKEDOBJECTS_CORE_CONF_OPTS = --enable-core-only
+
+$(eval $(autotools-package))
@@ -0,0 +1,1385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "packedobjects.h"
+#include "layout.h"
+
+// the event stream of a decode written out as text
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t size;
+} eventLog;
+
+// the word/orBuf writer encode.c used before the 64 bit accumulator
+typedef struct {
+  char buf[WORD_32BIT * WORD_BYTE];
+  char *pdu;
+  int bufWords;
+  int pduWords;
+  int bitsUsed;
+} legacyEncode;
+
+// the word at a time reader decode.c used before the 64 bit cache
+typedef struct {
+  char *pdu;
+  int ub;
+  int word;
+} legacyDecode;
+
+// one worker of the threads bench with its own context
+typedef struct {
+  pthread_t thread;
+  packedobjectsContext *pc;
+  const char *infile;
+  char *pdu;
+  int bytes;
+  int loop;
+} stressWorker;
+
+static void bench_dispatch(packedobjectsContext *pc, const char *infile, int loop);
+static void bench_writer(int count);
+static void bench_reader(int count);
+static void bench_strings(int count);
+static void bench_threads(const char *schema_file, const char *infile, int threads, int loop);
+static void bench_text(packedobjectsContext *pc, const char *infile, int loop);
+static void bench_events(packedobjectsContext *pc, const char *infile, int loop);
+static void bench_arena(const char *schema_file, const char *infile, int loop);
+static void bench_pool(const char *schema_file, const char *infile, int loop);
+static void bench_batch(packedobjectsContext *pc, const char *infile, int loop);
+static void bench_parallel(const char *schema_file, const char *infile, int threads, int loop);
+static void bench_validate(const char *schema_file, const char *infile, int loop);
+static void bench_compiled(const char *schema_file, const char *infile, int loop);
+static void bench_struct(const char *schema_file, const char *infile, int loop);
+static void bench_core(const char *schema_file, const char *infile, int loop);
+static void log_event(eventLog *log, const char *kind, const char *name, const char *value);
+static void log_start(void *user, const char *name);
+static void log_end(void *user, const char *name);
+static void log_integer(void *user, const char *name, int64_t value);
+static void log_string(void *user, const char *name, const char *value, size_t len);
+static void log_boolean(void *user, const char *name, int value);
+static void log_enumerated(void *user, const char *name, int index, const char *value);
+static void log_po_start(void *user, const xmlChar *name);
+static void log_po_end(void *user, const xmlChar *name);
+static void log_po_integer(void *user, const xmlChar *name, int64_t value);
+static void log_po_string(void *user, const xmlChar *name, const char *value, size_t len);
+static void log_po_boolean(void *user, const xmlChar *name, int value);
+static void log_po_enumerated(void *user, const xmlChar *name, int index, const xmlChar *value);
+static void sum_integer(void *user, const xmlChar *name, int64_t value);
+static void *stress_worker(void *arg);
+static void *free_docs(void *arg);
+static void make_values(unsigned long *values, unsigned char *widths, int count);
+static void legacy_add_buf(legacyEncode *memBuf, unsigned long int n);
+static void legacy_flush(legacyEncode *memBuf);
+static void legacy_encode(legacyEncode *memBuf, unsigned long int n, int bitlength);
+static int legacy_finalize(legacyEncode *memBuf);
+static unsigned long int legacy_getn(legacyDecode *memBuf, int bitlen, int lb);
+static unsigned long int legacy_decode(legacyDecode *memBuf, int bitlen);
+static void legacy_encode_string(packedEncode *memBuf, char *s);
+static char *legacy_decode_string(packedDecode *memBuf);
+static int collect_fields(planNode *plan, xmlNodePtr node, planNode **fields, int n, int max);
+static int dispatch_by_name(xmlNodePtr schema_node);
+static int dispatch_by_enum(planNode *plan);
+static double elapsed_ns(struct timespec *start, struct timespec *end);
+static void print_usage(void);
+static void exit_with_message(char *message);
+
+static const char *type_names[] = {
+  "integer", "string", "bit-string", "numeric-string", "hex-string",
+  "octet-string", "sequence", "sequence-of", "sequence-optional", "null",
+  "boolean", "choice", "enumerated", "currency", "decimal", "ipv4-address",
+  "utf8-string", "unix-time", NULL
+};
+
+static const char *variant_names[] = {
+  "unconstrained", "semi-constrained", "constrained", "fixed-length", NULL
+};
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+  return ((end->tv_sec - start->tv_sec) * 1e9) + (end->tv_nsec - start->tv_nsec);
+}
+
+// record the plan node of every element in the order the encoder visits them
+static int collect_fields(planNode *plan, xmlNodePtr node, planNode **fields, int n, int max)
+{
+  xmlNodePtr cur_node = NULL;
+  planNode *np = NULL;
+  int cursor = 0;
+
+  if (n == max) return n;
+  fields[n++] = plan;
+  for (cur_node = node->children; cur_node; cur_node = cur_node->next) {
+    if (cur_node->type == XML_ELEMENT_NODE) {
+      if ((np = plan_find_child(plan, cur_node->name, &cursor)) == NULL) {
+        exit_with_message("data does not match schema");
+      }
+      n = collect_fields(np, cur_node, fields, n, max);
+    }
+  }
+
+  return n;
+}
+
+// the xmlGetProp and string comparison chain the encoder used to run per element
+static int dispatch_by_name(xmlNodePtr schema_node)
+{
+  xmlChar *type = NULL;
+  xmlChar *variant = NULL;
+  int i, j = 0;
+
+  type = xmlGetProp(schema_node, BAD_CAST "type");
+  for (i = 0; type_names[i]; i++) {
+    if (xmlStrEqual(type, BAD_CAST type_names[i])) break;
+  }
+  if (i < 6) {
+    variant = xmlGetProp(schema_node, BAD_CAST "variant");
+    for (j = 0; variant_names[j]; j++) {
+      if (xmlStrEqual(variant, BAD_CAST variant_names[j])) break;
+    }
+    xmlFree(variant);
+  }
+  xmlFree(type);
+
+  return (i << 4) | j;
+}
+
+static int dispatch_by_enum(planNode *plan)
+{
+  switch (plan->type) {
+  case INTEGER_TYPE:
+  case STRING_TYPE:
+  case BIT_STRING_TYPE:
+  case NUMERIC_STRING_TYPE:
+  case HEX_STRING_TYPE:
+  case OCTET_STRING_TYPE:
+    return (plan->type << 4) | plan->variant;
+  default:
+    return (plan->type << 4);
+  }
+}
+
+static void bench_dispatch(packedobjectsContext *pc, const char *infile, int loop)
+{
+  xmlDocPtr doc = NULL;
+  static planNode *fields[65536];
+  struct timespec start, end;
+  double by_name, by_enum;
+  long check = 0;
+  int i, j, n;
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) {
+    exit_with_message("did not find .xml file");
+  }
+  n = collect_fields(pc->plan, xmlDocGetRootElement(doc), fields, 0, 65536);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    for (j = 0; j < n; j++) {
+      check += dispatch_by_name(fields[j]->schema_node);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  by_name = elapsed_ns(&start, &end) / ((double)loop * n);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    for (j = 0; j < n; j++) {
+      check += dispatch_by_enum(fields[j]);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  by_enum = elapsed_ns(&start, &end) / ((double)loop * n);
+
+  printf("%s: %d fields, by name %.2f ns/field, by enum %.2f ns/field (%ld)\n",
+         infile, n, by_name, by_enum, check);
+
+  xmlFreeDoc(doc);
+}
+
+// deterministic mix of field widths similar to real schemas
+static void make_values(unsigned long *values, unsigned char *widths, int count)
+{
+  static const unsigned char mix[] = { 1, 2, 7, 8, 4, 16, 3, 7, 32, 10, 1, 8, 13, 7, 24, 5 };
+  uint32_t x = 2463534242U;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    widths[i] = mix[i % sizeof(mix)];
+    values[i] = (widths[i] == 32) ? x : (x & ((1UL << widths[i]) - 1));
+  }
+}
+
+static void legacy_add_buf(legacyEncode *memBuf, unsigned long int n)
+{
+  uint32_t word = htonl(n << (WORD_32BIT - memBuf->bitsUsed));
+  memcpy(memBuf->buf + (memBuf->bufWords * WORD_BYTE), &word, WORD_BYTE);
+  memBuf->bufWords++;
+}
+
+static void legacy_flush(legacyEncode *memBuf)
+{
+  uint32_t result = 0, n;
+  int i;
+
+  for (i = 0; i < memBuf->bufWords; i++) {
+    memcpy(&n, memBuf->buf + (i * WORD_BYTE), WORD_BYTE);
+    result = result | n;
+  }
+  memcpy(memBuf->pdu + (memBuf->pduWords * WORD_BYTE), &result, WORD_BYTE);
+  memBuf->pduWords++;
+  memset(memBuf->buf, 0, memBuf->bufWords * WORD_BYTE);
+  memBuf->bufWords = 0;
+  memBuf->bitsUsed = 0;
+}
+
+// kept out of line so both writers pay for a call per value
+__attribute__((noinline))
+static void legacy_encode(legacyEncode *memBuf, unsigned long int n, int bitlength)
+{
+  memBuf->bitsUsed = memBuf->bitsUsed + bitlength;
+
+  if (memBuf->bitsUsed == WORD_32BIT) {
+    legacy_add_buf(memBuf, n);
+    legacy_flush(memBuf);
+  } else if (memBuf->bitsUsed < WORD_32BIT) {
+    legacy_add_buf(memBuf, n);
+  } else {
+    int tail = memBuf->bitsUsed - WORD_32BIT;
+    memBuf->bitsUsed = WORD_32BIT;
+    legacy_add_buf(memBuf, (n >> tail));
+    legacy_flush(memBuf);
+    memBuf->bitsUsed = tail;
+    legacy_add_buf(memBuf, (n & ((1UL << tail) - 1)));
+  }
+}
+
+static int legacy_finalize(legacyEncode *memBuf)
+{
+  int bitsUsed = memBuf->bitsUsed;
+
+  if (bitsUsed == 0) {
+    return memBuf->pduWords * WORD_BYTE;
+  }
+  legacy_flush(memBuf);
+  return ((memBuf->pduWords - 1) * WORD_BYTE) + ((bitsUsed + CHAR_BIT - 1) / CHAR_BIT);
+}
+
+static unsigned long int legacy_getn(legacyDecode *memBuf, int bitlen, int lb)
+{
+  uint32_t n;
+
+  memcpy(&n, memBuf->pdu + (memBuf->word * WORD_BYTE), WORD_BYTE);
+  n = ntohl(n) >> lb;
+  return (bitlen == WORD_32BIT) ? n : (n & ((1UL << bitlen) - 1));
+}
+
+// kept out of line so both readers pay for a call per value
+__attribute__((noinline))
+static unsigned long int legacy_decode(legacyDecode *memBuf, int bitlen)
+{
+  unsigned long int n;
+  int lb = memBuf->ub - bitlen;
+
+  if (lb > 0) {
+    n = legacy_getn(memBuf, bitlen, lb);
+    memBuf->ub = lb;
+  } else if (lb == 0) {
+    n = legacy_getn(memBuf, bitlen, lb);
+    memBuf->ub = WORD_32BIT;
+    memBuf->word++;
+  } else {
+    unsigned long int n1, n2;
+    int lhs = lb + bitlen;
+    int rhs = bitlen - lhs;
+    n1 = legacy_getn(memBuf, lhs, 0);
+    memBuf->word++;
+    lb = WORD_32BIT - rhs;
+    n2 = legacy_getn(memBuf, rhs, lb);
+    n = ((n1 << rhs) | n2);
+    memBuf->ub = lb;
+  }
+  return n;
+}
+
+// the semi constrained string coders as they were, a char at a time
+__attribute__((noinline))
+static void legacy_encode_string(packedEncode *memBuf, char *s)
+{
+  int i, len;
+
+  (s) ? (len=strlen(s)) : (len=0);
+  encodeUnsignedSemiConstrainedInteger(memBuf, len, 0);
+  for (i = 0; i < len; i++) {
+    encode(memBuf, s[i], 7);
+  }
+}
+
+__attribute__((noinline))
+static char *legacy_decode_string(packedDecode *memBuf)
+{
+  int i, len;
+  char *s;
+
+  len = decodeUnsignedSemiConstrainedInteger(memBuf, 0);
+  if ((s = decodeAlloc(memBuf, len + 1)) == NULL) return NULL;
+  for (i = 0; i < len; i++) {
+    s[i] = decode(memBuf, 7);
+  }
+  s[len] = '\0';
+
+  return s;
+}
+
+static void bench_writer(int count)
+{
+  unsigned long *values = NULL;
+  unsigned char *widths = NULL;
+  char *old_pdu = NULL, *new_pdu = NULL;
+  legacyEncode legacy;
+  packedEncode *encodep = NULL;
+  struct timespec start, end;
+  double old_ns, new_ns;
+  int i, size, new_bytes;
+
+  size = (count * WORD_BYTE) + WORD_BYTE;
+  values = malloc(count * sizeof(unsigned long));
+  widths = malloc(count);
+  old_pdu = malloc(size);
+  new_pdu = malloc(size);
+  if (!values || !widths || !old_pdu || !new_pdu) exit_with_message("out of memory");
+  make_values(values, widths, count);
+
+  memset(&legacy, 0, sizeof(legacy));
+  legacy.pdu = old_pdu;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < count; i++) {
+    legacy_encode(&legacy, values[i], widths[i]);
+  }
+  legacy_finalize(&legacy);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  old_ns = elapsed_ns(&start, &end) / count;
+
+  if ((encodep = initializeEncode(new_pdu, size)) == NULL) exit_with_message("initializeEncode failed");
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < count; i++) {
+    encode(encodep, values[i], widths[i]);
+  }
+  new_bytes = finalizeEncode(encodep);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  new_ns = elapsed_ns(&start, &end) / count;
+
+  printf("writer: %d values, %d bytes, old %.2f ns/value, new %.2f ns/value\n",
+         count, new_bytes, old_ns, new_ns);
+
+  freeEncode(encodep);
+  free(values);
+  free(widths);
+  free(old_pdu);
+  free(new_pdu);
+}
+
+static void bench_reader(int count)
+{
+  unsigned long *values = NULL;
+  unsigned char *widths = NULL;
+  char *pdu = NULL;
+  legacyDecode legacy;
+  packedEncode *encodep = NULL;
+  packedDecode *decodep = NULL;
+  struct timespec start, end;
+  double old_ns, new_ns;
+  unsigned long old_sum = 0, new_sum = 0;
+  int i, size, bytes;
+
+  // room for the reader to fetch the whole of the final word
+  size = (count * WORD_BYTE) + WORD_BYTE;
+  values = malloc(count * sizeof(unsigned long));
+  widths = malloc(count);
+  pdu = calloc(size, 1);
+  if (!values || !widths || !pdu) exit_with_message("out of memory");
+  make_values(values, widths, count);
+
+  if ((encodep = initializeEncode(pdu, size)) == NULL) exit_with_message("initializeEncode failed");
+  for (i = 0; i < count; i++) {
+    encode(encodep, values[i], widths[i]);
+  }
+  bytes = finalizeEncode(encodep);
+
+  memset(&legacy, 0, sizeof(legacy));
+  legacy.pdu = pdu;
+  legacy.ub = WORD_32BIT;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < count; i++) {
+    old_sum += legacy_decode(&legacy, widths[i]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  old_ns = elapsed_ns(&start, &end) / count;
+
+  if ((decodep = initializeDecode(pdu, bytes)) == NULL) exit_with_message("initializeDecode failed");
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < count; i++) {
+    new_sum += decode(decodep, widths[i]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  new_ns = elapsed_ns(&start, &end) / count;
+
+  printf("reader: %d values, %d bytes, old %.2f ns/value, new %.2f ns/value (%lu)\n",
+         count, bytes, old_ns, new_ns, old_sum + new_sum);
+
+  freeDecode(decodep);
+  freeEncode(encodep);
+  free(values);
+  free(widths);
+  free(pdu);
+}
+
+// every other round provokes an error so longjmps race with good encodes
+static void *stress_worker(void *arg)
+{
+  stressWorker *w = arg;
+  xmlDocPtr doc = NULL;
+  xmlDocPtr out = NULL;
+  xmlChar *xml = NULL;
+  char small[8];
+  size_t len;
+  int i, size;
+
+  if ((doc = packedobjects_new_doc(w->infile)) == NULL) return NULL;
+  for (i = 0; i < w->loop; i++) {
+    if (i & 1) {
+      packedobjects_encode_into(w->pc, doc, small, sizeof(small), &len);
+      packedobjects_decode_n(w->pc, w->pdu, w->bytes / 2);
+      continue;
+    }
+    packedobjects_encode(w->pc, doc);
+    if ((out = packedobjects_decode_n(w->pc, w->pdu, w->bytes)) == NULL) continue;
+    xmlDocDumpMemory(out, &xml, &size);
+    xmlFree(xml);
+    xmlFreeDoc(out);
+  }
+  xmlFreeDoc(doc);
+
+  return NULL;
+}
+
+/*
+ * strings of a few lengths through the string encoder and decoder, which
+ * move eight chars at a time, against a 7 bit encode or decode per char
+ * as they did before. count is the number of chars per length
+ */
+static void bench_strings(int count)
+{
+  static const int lengths[] = { 7, 64, 1024, 65536 };
+  packedEncode *encodep = NULL;
+  packedDecode *decodep = NULL;
+  char *s = NULL, *t = NULL, *old_pdu = NULL, *new_pdu = NULL;
+  struct timespec start, end;
+  double old_encode_ns, new_encode_ns, old_decode_ns, new_decode_ns;
+  int i, k, len, loop, size, new_bytes = 0;
+
+  size = lengths[3] + WORD_BYTE * 4;
+  s = malloc(lengths[3] + 1);
+  old_pdu = malloc(size);
+  new_pdu = malloc(size);
+  if (!s || !old_pdu || !new_pdu) exit_with_message("out of memory");
+  srand(1);
+  for (i = 0; i < lengths[3]; i++) {
+    s[i] = ' ' + rand() % 95;
+  }
+  if ((encodep = initializeEncode(NULL, 0)) == NULL) exit_with_message("initializeEncode failed");
+  if ((decodep = initializeDecode(NULL, 0)) == NULL) exit_with_message("initializeDecode failed");
+  // both decoders allocate from the arena so keep malloc out of the timings
+  decodep->arena = 1;
+
+  for (k = 0; k < 4; k++) {
+    len = lengths[k];
+    loop = (count / len) ? count / len : 1;
+    s[len] = '\0';
+
+    encodep->pdu = old_pdu;
+    encodep->size = size;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loop; i++) {
+      resetEncode(encodep);
+      legacy_encode_string(encodep, s);
+      finalizeEncode(encodep);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    old_encode_ns = elapsed_ns(&start, &end) / loop;
+
+    encodep->pdu = new_pdu;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loop; i++) {
+      resetEncode(encodep);
+      encodeSemiConstrainedString(encodep, s);
+      new_bytes = finalizeEncode(encodep);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    new_encode_ns = elapsed_ns(&start, &end) / loop;
+
+    if (setjmp(decodep->env)) exit_with_message("string decode failed");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loop; i++) {
+      resetDecode(decodep, new_pdu, new_bytes);
+      if ((t = legacy_decode_string(decodep)) == NULL) exit_with_message("out of memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    old_decode_ns = elapsed_ns(&start, &end) / loop;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loop; i++) {
+      resetDecode(decodep, new_pdu, new_bytes);
+      t = decodeSemiConstrainedString(decodep);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    new_decode_ns = elapsed_ns(&start, &end) / loop;
+
+    printf("strings: %d chars, encode old %.2f ns/char, new %.2f ns/char, decode old %.2f ns/char, new %.2f ns/char\n",
+           len, old_encode_ns / len, new_encode_ns / len, old_decode_ns / len, new_decode_ns / len);
+    s[len] = ' ' + rand() % 95;
+  }
+
+  freeEncode(encodep);
+  freeDecode(decodep);
+  free(s);
+  free(old_pdu);
+  free(new_pdu);
+}
+
+// independent contexts encoding and decoding at once
+static void bench_threads(const char *schema_file, const char *infile, int threads, int loop)
+{
+  stressWorker *workers = NULL;
+  packedobjectsSchema *ps = NULL;
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr doc = NULL;
+  char *pdu = NULL;
+  struct timespec start, end;
+  double full_ns, shared_ns;
+  int i, bytes;
+
+  // the pdu every worker decodes
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if ((pc = init_packedobjects(schema_file, 0, 0)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  full_ns = elapsed_ns(&start, &end);
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  packedobjects_encode(pc, doc);
+  if (pc->encode_error) exit_with_message("encode failed");
+  bytes = pc->bytes;
+  if ((pdu = malloc(bytes)) == NULL) exit_with_message("out of memory");
+  memcpy(pdu, pc->encodep->pdu, bytes);
+  xmlFreeDoc(doc);
+  free_packedobjects(pc);
+
+  // the workers share one compiled schema
+  if ((ps = init_packedobjects_schema(schema_file, 0, NULL)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if ((workers = calloc(threads, sizeof(stressWorker))) == NULL) exit_with_message("out of memory");
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < threads; i++) {
+    workers[i].pc = init_packedobjects_with_schema(ps, 0, NULL);
+    if (workers[i].pc == NULL) exit_with_message("failed to initialise libpackedobjects");
+    workers[i].infile = infile;
+    workers[i].pdu = pdu;
+    workers[i].bytes = bytes;
+    workers[i].loop = loop;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  shared_ns = elapsed_ns(&start, &end) / threads;
+  free_packedobjects_schema(ps);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < threads; i++) {
+    if (pthread_create(&workers[i].thread, NULL, stress_worker, &workers[i])) exit_with_message("pthread_create failed");
+  }
+  for (i = 0; i < threads; i++) {
+    pthread_join(workers[i].thread, NULL);
+    free_packedobjects(workers[i].pc);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("threads: %s, init %.1f us per context from the schema file, %.1f us from a shared schema\n",
+         infile, full_ns / 1e3, shared_ns / 1e3);
+  printf("threads: %s, %d threads x %d rounds in %.1f ms\n",
+         infile, threads, loop, elapsed_ns(&start, &end) / 1e6);
+
+  free(workers);
+  free(pdu);
+}
+
+// decoding straight to text against building a tree and dumping it
+static void bench_text(packedobjectsContext *pc, const char *infile, int loop)
+{
+  xmlDocPtr doc = NULL;
+  xmlChar *xml = NULL;
+  char *pdu = NULL;
+  struct timespec start, end;
+  double dom_ns, text_ns;
+  int i, bytes, size, len;
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) {
+    exit_with_message("did not find .xml file");
+  }
+  packedobjects_encode(pc, doc);
+  if (pc->encode_error) exit_with_message("encode failed");
+  bytes = pc->bytes;
+  if ((pdu = malloc(bytes)) == NULL) exit_with_message("out of memory");
+  memcpy(pdu, pc->encodep->pdu, bytes);
+  xmlFreeDoc(doc);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    xmlFree(xml);
+    doc = packedobjects_decode_n(pc, pdu, bytes);
+    if (pc->decode_error) exit_with_message("decode failed");
+    xmlDocDumpMemory(doc, &xml, &size);
+    xmlFreeDoc(doc);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  dom_ns = elapsed_ns(&start, &end) / loop;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    packedobjects_decode_to_text(pc, pdu, bytes, &len);
+    if (pc->decode_error) exit_with_message("decode to text failed");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  text_ns = elapsed_ns(&start, &end) / loop;
+
+  printf("text: %s, %d bytes of xml, decode+dump %.2f us, decode to text %.2f us\n",
+         infile, len, dom_ns / 1e3, text_ns / 1e3);
+
+  xmlFree(xml);
+  free(pdu);
+}
+
+static void sum_integer(void *user, const xmlChar *name, int64_t value)
+{
+  *(int64_t *)user += value;
+}
+
+// pulling the integers out with callbacks against building a tree to drop
+static void bench_events(packedobjectsContext *pc, const char *infile, int loop)
+{
+  po_handler h = { .integer = sum_integer };
+  xmlDocPtr doc = NULL;
+  char *pdu = NULL;
+  struct timespec start, end;
+  double dom_ns, events_ns;
+  int64_t sum = 0;
+  int i, bytes;
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) {
+    exit_with_message("did not find .xml file");
+  }
+  packedobjects_encode(pc, doc);
+  if (pc->encode_error) exit_with_message("encode failed");
+  bytes = pc->bytes;
+  if ((pdu = malloc(bytes)) == NULL) exit_with_message("out of memory");
+  memcpy(pdu, pc->encodep->pdu, bytes);
+  xmlFreeDoc(doc);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    doc = packedobjects_decode_n(pc, pdu, bytes);
+    if (pc->decode_error) exit_with_message("decode failed");
+    xmlFreeDoc(doc);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  dom_ns = elapsed_ns(&start, &end) / loop;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if (packedobjects_decode_events(pc, pdu, bytes, &h, &sum)) exit_with_message("decode events failed");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  events_ns = elapsed_ns(&start, &end) / loop;
+
+  printf("events: %s, decode to tree %.2f us, decode to callbacks %.2f us (%lld)\n",
+         infile, dom_ns / 1e3, events_ns / 1e3, (long long)(sum / loop));
+
+  free(pdu);
+}
+
+// string mallocs per decode with and without the arena once warmed up
+static void bench_arena(const char *schema_file, const char *infile, int loop)
+{
+  static const int options[] = { NO_DATA_VALIDATION, NO_DATA_VALIDATION | DECODE_STRING_ARENA };
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr doc = NULL;
+  char *pdu = NULL;
+  struct timespec start, end;
+  unsigned long strings, mallocs;
+  int i, j, bytes, len;
+
+  for (j = 0; j < 2; j++) {
+    if ((pc = init_packedobjects(schema_file, 0, options[j])) == NULL) exit_with_message("failed to initialise libpackedobjects");
+    if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+    packedobjects_encode(pc, doc);
+    if (pc->encode_error) exit_with_message("encode failed");
+    bytes = pc->bytes;
+    if ((pdu = malloc(bytes)) == NULL) exit_with_message("out of memory");
+    memcpy(pdu, pc->encodep->pdu, bytes);
+    xmlFreeDoc(doc);
+
+    // the first decode grows the arena to fit
+    packedobjects_decode_to_text(pc, pdu, bytes, &len);
+    strings = pc->decodep->strings;
+    mallocs = pc->decodep->mallocs;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loop; i++) {
+      packedobjects_decode_to_text(pc, pdu, bytes, &len);
+      if (pc->decode_error) exit_with_message("decode to text failed");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("arena: %s, %s, %lu strings and %lu mallocs per decode, %.2f us\n",
+           infile, (j) ? "arena" : "malloc",
+           (pc->decodep->strings - strings) / loop, (pc->decodep->mallocs - mallocs) / loop,
+           elapsed_ns(&start, &end) / loop / 1e3);
+
+    free(pdu);
+    free_packedobjects(pc);
+  }
+}
+
+// system allocator calls per message once the pool has warmed up
+static void bench_pool(const char *schema_file, const char *infile, int loop)
+{
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr doc = NULL;
+  xmlDocPtr out = NULL;
+  xmlDocPtr docs[17];
+  pthread_t thread;
+  char *pdu = NULL;
+  struct timespec start, end;
+  unsigned long allocs = 0;
+  double cross;
+  int i, j, bytes = 0;
+
+  // must come before anything else touches libxml2
+  if (packedobjects_pool_memory() == -1) exit_with_message("failed to install pool");
+  if ((pc = init_packedobjects(schema_file, 0, DECODE_STRING_ARENA)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+
+  for (i = 0; i <= loop; i++) {
+    // the first round fills the free lists
+    if (i == 1) {
+      allocs = packedobjects_pool_system_allocs();
+      clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+    pdu = packedobjects_encode(pc, doc);
+    if (pc->encode_error) exit_with_message("encode failed");
+    bytes = pc->bytes;
+    out = packedobjects_decode_n(pc, pdu, bytes);
+    if (pc->decode_error) exit_with_message("decode failed");
+    xmlFreeDoc(out);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("pool: %s, encode+decode %.2f us, %.2f system allocs per message\n",
+         infile, elapsed_ns(&start, &end) / loop / 1e3,
+         (double)(packedobjects_pool_system_allocs() - allocs) / loop);
+
+  // documents freed in another thread and given back to this one
+  for (i = 0; i <= loop / 16; i++) {
+    if (i == 1) allocs = packedobjects_pool_system_allocs();
+    for (j = 0; j < 16; j++) {
+      docs[j] = packedobjects_decode_n(pc, pdu, bytes);
+      if (pc->decode_error) exit_with_message("decode failed");
+    }
+    docs[16] = NULL;
+    if (pthread_create(&thread, NULL, free_docs, docs)) exit_with_message("pthread_create failed");
+    pthread_join(thread, NULL);
+  }
+  cross = (double)(packedobjects_pool_system_allocs() - allocs) / (loop / 16 * 16);
+  printf("pool: %s, freed by another thread, %.2f system allocs per message\n", infile, cross);
+
+  xmlFreeDoc(doc);
+  free_packedobjects(pc);
+}
+
+static void *free_docs(void *arg)
+{
+  xmlDocPtr *docs = arg;
+  int i;
+
+  for (i = 0; docs[i]; i++) {
+    xmlFreeDoc(docs[i]);
+  }
+
+  return NULL;
+}
+
+// messages per second from single encodes against batches of 1, 16 and 256
+static void bench_batch(packedobjectsContext *pc, const char *infile, int loop)
+{
+  static const int sizes[] = { 1, 16, 256 };
+  xmlDocPtr docs[256];
+  char *bufs[256];
+  int lens[256];
+  char *copy = NULL;
+  struct timespec start, end;
+  int i, k, n;
+
+  if ((docs[0] = packedobjects_new_doc(infile)) == NULL) {
+    exit_with_message("did not find .xml file");
+  }
+  for (i = 1; i < 256; i++) {
+    if ((docs[i] = xmlCopyDoc(docs[0], 1)) == NULL) exit_with_message("out of memory");
+  }
+  packedobjects_encode(pc, docs[0]);
+  if (pc->encode_error) exit_with_message("encode failed");
+  if ((copy = malloc(pc->bytes)) == NULL) exit_with_message("out of memory");
+
+  // each pdu is copied out as the next encode reuses the buffer
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    packedobjects_encode(pc, docs[i & 255]);
+    if (pc->encode_error) exit_with_message("encode failed");
+    memcpy(copy, pc->encodep->pdu, pc->bytes);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("batch: %s, single %.0f msgs/sec", infile, loop * 1e9 / elapsed_ns(&start, &end));
+
+  for (k = 0; k < 3; k++) {
+    n = sizes[k];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loop; i += n) {
+      if (packedobjects_encode_batch(pc, docs, n, bufs, lens)) exit_with_message("batch encode failed");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf(", batch of %d %.0f msgs/sec", n, (double)((loop + n - 1) / n * n) * 1e9 / elapsed_ns(&start, &end));
+  }
+  printf("\n");
+
+  for (i = 0; i < 256; i++) {
+    xmlFreeDoc(docs[i]);
+  }
+  free(copy);
+}
+
+// messages per second encoding and decoding a large batch on 1 to threads workers
+static void bench_parallel(const char *schema_file, const char *infile, int threads, int loop)
+{
+  packedobjectsSchema *ps = NULL;
+  packedobjectsWorkers *pw = NULL;
+  xmlDocPtr copies[64];
+  xmlDocPtr *docs = NULL;
+  xmlDocPtr *out = NULL;
+  char **bufs = NULL;
+  int *lens = NULL;
+  struct timespec start, end;
+  double encode_ns, decode_ns, base_encode = 0, base_decode = 0;
+  int i, n;
+
+  // validation is left out so the workers can share the input documents
+  if ((ps = init_packedobjects_schema(schema_file, NO_DATA_VALIDATION, NULL)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if ((copies[0] = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  for (i = 1; i < 64; i++) {
+    if ((copies[i] = xmlCopyDoc(copies[0], 1)) == NULL) exit_with_message("out of memory");
+  }
+  out = malloc(loop * sizeof(xmlDocPtr));
+  docs = malloc(loop * sizeof(xmlDocPtr));
+  bufs = malloc(loop * sizeof(char *));
+  lens = malloc(loop * sizeof(int));
+  if (!out || !docs || !bufs || !lens) exit_with_message("out of memory");
+  for (i = 0; i < loop; i++) {
+    docs[i] = copies[i % 64];
+  }
+
+  for (n = 1; n <= threads; n *= 2) {
+    if ((pw = packedobjects_workers_new(ps, n, 0)) == NULL) exit_with_message("failed to start workers");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (packedobjects_encode_parallel(pw, docs, loop, bufs, lens)) exit_with_message("parallel encode failed");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    encode_ns = elapsed_ns(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (packedobjects_decode_parallel(pw, bufs, lens, loop, out, NULL)) exit_with_message("parallel decode failed");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    decode_ns = elapsed_ns(&start, &end);
+    for (i = 0; i < loop; i++) {
+      xmlFreeDoc(out[i]);
+    }
+
+    if (n == 1) {
+      base_encode = encode_ns;
+      base_decode = decode_ns;
+    }
+    printf("parallel: %s, %d messages on %d threads, encode %.0f msgs/sec (x%.2f), decode %.0f msgs/sec (x%.2f)\n",
+           infile, loop, n, loop * 1e9 / encode_ns, base_encode / encode_ns,
+           loop * 1e9 / decode_ns, base_decode / decode_ns);
+    packedobjects_workers_free(pw);
+  }
+
+  for (i = 0; i < 64; i++) {
+    xmlFreeDoc(copies[i]);
+  }
+  free_packedobjects_schema(ps);
+  free(docs);
+  free(out);
+  free(bufs);
+  free(lens);
+}
+
+// encode+decode with libxml2's validator, the inline checks and no validation
+static void bench_validate(const char *schema_file, const char *infile, int loop)
+{
+  static const int options[] = { 0, INLINE_VALIDATION, NO_DATA_VALIDATION };
+  static const char *names[] = { "libxml2", "inline", "none" };
+  packedobjectsContext *pc[3];
+  xmlDocPtr doc = NULL;
+  xmlDocPtr out = NULL;
+  char *pdu = NULL;
+  struct timespec start, end;
+  int i, j;
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  for (j = 0; j < 3; j++) {
+    if ((pc[j] = init_packedobjects(schema_file, 0, options[j])) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  }
+
+  printf("validate: %s", infile);
+  for (j = 0; j < 3; j++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loop; i++) {
+      pdu = packedobjects_encode(pc[j], doc);
+      if (pc[j]->encode_error) exit_with_message("encode failed");
+      out = packedobjects_decode_n(pc[j], pdu, pc[j]->bytes);
+      if (pc[j]->decode_error) exit_with_message("decode failed");
+      xmlFreeDoc(out);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf(", %s %.2f us", names[j], elapsed_ns(&start, &end) / loop / 1e3);
+  }
+  printf("\n");
+
+  for (j = 0; j < 3; j++) {
+    free_packedobjects(pc[j]);
+  }
+  xmlFreeDoc(doc);
+}
+
+// startup from the XSD against startup from a compiled copy of it
+static void bench_compiled(const char *schema_file, const char *infile, int loop)
+{
+  packedobjectsContext *pc = NULL;
+  char path[] = "/tmp/po-benchXXXXXX";
+  struct timespec start, end;
+  double xsd_ns, compiled_ns;
+  int i, fd;
+
+  if ((fd = mkstemp(path)) == -1) exit_with_message("could not create temporary file");
+  close(fd);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if ((pc = init_packedobjects(schema_file, 0, INLINE_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+    if (i < loop - 1) free_packedobjects(pc);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  xsd_ns = elapsed_ns(&start, &end);
+  if (packedobjects_write_compiled(pc->schema, path) == -1) exit_with_message("failed to write compiled schema");
+  free_packedobjects(pc);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if ((pc = init_packedobjects_from_compiled(path, 0, 0)) == NULL) exit_with_message("failed to load compiled schema");
+    free_packedobjects(pc);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  compiled_ns = elapsed_ns(&start, &end);
+
+  printf("compiled: %s, init from XSD %.2f us, from compiled schema %.2f us (x%.0f)\n",
+         infile, xsd_ns / loop / 1e3, compiled_ns / loop / 1e3, xsd_ns / compiled_ns);
+
+  unlink(path);
+}
+
+// decode then encode again through a tree against through a struct
+static void bench_struct(const char *schema_file, const char *infile, int loop)
+{
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr doc = NULL;
+  xmlDocPtr out = NULL;
+  po_field fields[MAX_FIELDS];
+  char path[MAX_PATH] = "";
+  char *pdu = NULL;
+  void *msg = NULL;
+  struct timespec start, end;
+  double tree_ns, struct_ns;
+  size_t size;
+  int i, n = 0, bytes;
+
+  // the struct has nothing to validate so neither does the tree
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  size = layout_struct(pc->plan, path, fields, &n, 0);
+  if (packedobjects_register_struct(pc, fields, n, size) == -1) exit_with_message("failed to register struct");
+  for (i = 0; i < n; i++) {
+    free((char *)fields[i].path);
+  }
+  if ((msg = malloc(size)) == NULL) exit_with_message("out of memory");
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  packedobjects_encode(pc, doc);
+  if (pc->encode_error) exit_with_message("encode failed");
+  bytes = pc->bytes;
+  if ((pdu = malloc(bytes)) == NULL) exit_with_message("out of memory");
+  memcpy(pdu, pc->encodep->pdu, bytes);
+  xmlFreeDoc(doc);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if ((out = packedobjects_decode_n(pc, pdu, bytes)) == NULL) exit_with_message("decode failed");
+    packedobjects_encode(pc, out);
+    if (pc->encode_error) exit_with_message("encode failed");
+    xmlFreeDoc(out);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  tree_ns = elapsed_ns(&start, &end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if (packedobjects_decode_struct(pc, pdu, bytes, msg)) exit_with_message("decode struct failed");
+    packedobjects_encode_struct(pc, msg);
+    if (pc->encode_error) exit_with_message("encode struct failed");
+    packedobjects_free_struct(pc, msg);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  struct_ns = elapsed_ns(&start, &end);
+
+  printf("struct: %s, decode and encode with a tree %.2f us, with a struct %.2f us (x%.0f)\n",
+         infile, tree_ns / loop / 1e3, struct_ns / loop / 1e3, tree_ns / struct_ns);
+
+  free(msg);
+  free(pdu);
+  free_packedobjects(pc);
+}
+
+static void log_event(eventLog *log, const char *kind, const char *name, const char *value)
+{
+  size_t n = strlen(kind) + strlen(name) + strlen(value) + 3;
+
+  if (log->len + n >= log->size) {
+    log->size = (log->size + n) * 2;
+    if ((log->buf = realloc(log->buf, log->size)) == NULL) exit_with_message("out of memory");
+  }
+  log->len += sprintf(log->buf + log->len, "%s %s %s\n", kind, name, value);
+}
+
+static void log_start(void *user, const char *name)
+{
+  log_event(user, "start", name, "");
+}
+
+static void log_end(void *user, const char *name)
+{
+  log_event(user, "end", name, "");
+}
+
+static void log_integer(void *user, const char *name, int64_t value)
+{
+  char s[24];
+
+  sprintf(s, "%lld", (long long)value);
+  log_event(user, "integer", name, s);
+}
+
+static void log_string(void *user, const char *name, const char *value, size_t len)
+{
+  log_event(user, "string", name, value);
+}
+
+static void log_boolean(void *user, const char *name, int value)
+{
+  log_event(user, "boolean", name, (value) ? "true" : "false");
+}
+
+static void log_enumerated(void *user, const char *name, int index, const char *value)
+{
+  log_event(user, "enumerated", name, value);
+}
+
+// the same for the libxml2 decoder
+static void log_po_start(void *user, const xmlChar *name)
+{
+  log_start(user, (const char *)name);
+}
+
+static void log_po_end(void *user, const xmlChar *name)
+{
+  log_end(user, (const char *)name);
+}
+
+static void log_po_integer(void *user, const xmlChar *name, int64_t value)
+{
+  log_integer(user, (const char *)name, value);
+}
+
+static void log_po_string(void *user, const xmlChar *name, const char *value, size_t len)
+{
+  log_string(user, (const char *)name, value, len);
+}
+
+static void log_po_boolean(void *user, const xmlChar *name, int value)
+{
+  log_boolean(user, (const char *)name, value);
+}
+
+static void log_po_enumerated(void *user, const xmlChar *name, int index, const xmlChar *value)
+{
+  log_enumerated(user, (const char *)name, index, (const char *)value);
+}
+
+/*
+ * the libxml2 free decoder against decode_events on the same compiled
+ * schema. both log every event as text so they do the same work
+ */
+static void bench_core(const char *schema_file, const char *infile, int loop)
+{
+  packedobjectsContext *pc = NULL;
+  coreSchema *cs = NULL;
+  packedDecode *decodep = NULL;
+  po_handler h = { .start_element = log_po_start, .end_element = log_po_end, .integer = log_po_integer,
+                   .string = log_po_string, .boolean = log_po_boolean, .enumerated = log_po_enumerated };
+  core_handler ch = { .start_element = log_start, .end_element = log_end, .integer = log_integer,
+                      .string = log_string, .boolean = log_boolean, .enumerated = log_enumerated };
+  eventLog expected = { NULL, 0, 0 }, got = { NULL, 0, 0 };
+  xmlDocPtr doc = NULL;
+  char path[] = "/tmp/po-benchXXXXXX";
+  char *pdu = NULL;
+  struct timespec start, end;
+  double init_ns, load_ns, events_ns, core_ns;
+  int i, fd, bytes;
+
+  if ((fd = mkstemp(path)) == -1) exit_with_message("could not create temporary file");
+  close(fd);
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if (packedobjects_write_compiled(pc->schema, path) == -1) exit_with_message("failed to write compiled schema");
+  free_packedobjects(pc);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if ((pc = init_packedobjects_from_compiled(path, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to load compiled schema");
+    if (i < loop - 1) free_packedobjects(pc);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  init_ns = elapsed_ns(&start, &end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if ((cs = core_schema_load(path)) == NULL) exit_with_message("core failed to load compiled schema");
+    if (i < loop - 1) core_schema_free(cs);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  load_ns = elapsed_ns(&start, &end);
+  if ((decodep = initializeDecode(NULL, 0)) == NULL) exit_with_message("failed to initialise decoder");
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  packedobjects_encode(pc, doc);
+  if (pc->encode_error) exit_with_message("encode failed");
+  bytes = pc->bytes;
+  if ((pdu = malloc(bytes)) == NULL) exit_with_message("out of memory");
+  memcpy(pdu, pc->encodep->pdu, bytes);
+  xmlFreeDoc(doc);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    expected.len = 0;
+    if (packedobjects_decode_events(pc, pdu, bytes, &h, &expected)) exit_with_message("decode events failed");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  events_ns = elapsed_ns(&start, &end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    got.len = 0;
+    if (core_decode(cs, decodep, pdu, bytes, &ch, &got)) exit_with_message("core decode failed");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  core_ns = elapsed_ns(&start, &end);
+
+  printf("core: %s, load %.2f us against %.2f us, decode %.2f us against %.2f us\n",
+         infile, load_ns / loop / 1e3, init_ns / loop / 1e3, core_ns / loop / 1e3, events_ns / loop / 1e3);
+
+  unlink(path);
+  freeDecode(decodep);
+  core_schema_free(cs);
+  free_packedobjects(pc);
+  free(expected.buf);
+  free(got.buf);
+  free(pdu);
+}
+
+static void print_usage(void)
+{
+  printf("usage: packedobjects-bench --bench dispatch --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench writer [--loop <values>]\n");
+  printf("       packedobjects-bench --bench reader [--loop <values>]\n");
+  printf("       packedobjects-bench --bench strings [--loop <chars>]\n");
+  printf("       packedobjects-bench --bench threads --schema <file> --in <file> [--threads <n>] [--loop <n>]\n");
+  printf("       packedobjects-bench --bench text --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench events --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench arena --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench pool --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench batch --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench parallel --schema <file> --in <file> [--threads <n>] [--loop <n>]\n");
+  printf("       packedobjects-bench --bench validate --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench compiled --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench struct --schema <file> --in <file> [--loop <n>]\n");
+  printf("       packedobjects-bench --bench core --schema <file> --in <file> [--loop <n>]\n");
+  exit(EXIT_SUCCESS);
+}
+
+static void exit_with_message(char *message)
+{
+  printf("Failed to run: %s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  int c;
+  packedobjectsContext *pc = NULL;
+  const char *bench = NULL;
+  const char *schema_file = NULL;
+  const char *in_file = NULL;
+  int loop = 0;
+  int threads = 8;
+
+  while(1) {
+    static struct option long_options[] =
+      {
+        {"help",  no_argument, 0, 'h'},
+        {"bench",  required_argument, 0, 'b'},
+        {"schema",  required_argument, 0, 's'},
+        {"in",  required_argument, 0, 'i'},
+        {"loop",  required_argument, 0, 'l'},
+        {"threads",  required_argument, 0, 't'},
+        {0, 0, 0, 0}
+      };
+    int option_index = 0;
+
+    c = getopt_long (argc, argv, "hb:s:i:l:t:?", long_options, &option_index);
+
+    if (c == -1) break;
+
+    switch (c)
+      {
+      case 'b':
+        bench = optarg;
+        break;
+
+      case 's':
+        schema_file = optarg;
+        break;
+
+      case 'i':
+        in_file = optarg;
+        break;
+
+      case 'l':
+        loop = atoi(optarg);
+        break;
+
+      case 't':
+        threads = atoi(optarg);
+        break;
+
+      case 'h':
+      case '?':
+      default:
+        print_usage();
+      }
+  }
+
+  if (!bench) exit_with_message("did not specify --bench");
+
+  if (!strcmp(bench, "dispatch")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    pc = init_packedobjects(schema_file, 0, NO_SCHEMA_VALIDATION | NO_DATA_VALIDATION);
+    if (pc == NULL) exit_with_message("failed to initialise libpackedobjects");
+    bench_dispatch(pc, in_file, (loop) ? loop : 100000);
+    free_packedobjects(pc);
+  } else if (!strcmp(bench, "writer")) {
+    bench_writer((loop) ? loop : 10000000);
+  } else if (!strcmp(bench, "reader")) {
+    bench_reader((loop) ? loop : 10000000);
+  } else if (!strcmp(bench, "strings")) {
+    bench_strings((loop) ? loop : 10000000);
+  } else if (!strcmp(bench, "threads")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_threads(schema_file, in_file, threads, (loop) ? loop : 1000);
+  } else if (!strcmp(bench, "text")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    // validation would dominate both so only the output is compared
+    pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION);
+    if (pc == NULL) exit_with_message("failed to initialise libpackedobjects");
+    bench_text(pc, in_file, (loop) ? loop : 10000);
+    free_packedobjects(pc);
+  } else if (!strcmp(bench, "events")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    // callbacks never see a tree so the tree is not validated either
+    pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION);
+    if (pc == NULL) exit_with_message("failed to initialise libpackedobjects");
+    bench_events(pc, in_file, (loop) ? loop : 10000);
+    free_packedobjects(pc);
+  } else if (!strcmp(bench, "arena")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_arena(schema_file, in_file, (loop) ? loop : 10000);
+  } else if (!strcmp(bench, "pool")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_pool(schema_file, in_file, (loop) ? loop : 10000);
+  } else if (!strcmp(bench, "batch")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    // validation costs the same either way so leave it out
+    pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION);
+    if (pc == NULL) exit_with_message("failed to initialise libpackedobjects");
+    bench_batch(pc, in_file, (loop) ? loop : 100000);
+    free_packedobjects(pc);
+  } else if (!strcmp(bench, "parallel")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_parallel(schema_file, in_file, threads, (loop) ? loop : 100000);
+  } else if (!strcmp(bench, "validate")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_validate(schema_file, in_file, (loop) ? loop : 10000);
+  } else if (!strcmp(bench, "compiled")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_compiled(schema_file, in_file, (loop) ? loop : 100);
+  } else if (!strcmp(bench, "struct")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_struct(schema_file, in_file, (loop) ? loop : 10000);
+  } else if (!strcmp(bench, "core")) {
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    bench_core(schema_file, in_file, (loop) ? loop : 10000);
+  } else {
+    exit_with_message("unknown --bench");
+  }
+
+  return EXIT_SUCCESS;
+}
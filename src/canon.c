@@ -25,12 +25,12 @@ static xmlChar *make_enumerated_variant(xmlNodePtr node1, xmlNodePtr node2, long
 xmlChar *get_sequence_type(xmlNodePtr node);
 
 
-static xmlDocPtr make_canonical_schema(packedobjectsContext *pc)
+static xmlDocPtr make_canonical_schema(packedobjectsSchema *ps)
 {
   xmlDocPtr canonical_doc = NULL;
   xmlNodePtr root_node = NULL, canonical_root_node = NULL;
 
-  xmlDocPtr doc = pc->doc_expanded_schema;
+  xmlDocPtr doc = ps->doc_expanded_schema;
   
   dbg("creating canonical XML schema:");
   root_node = xmlDocGetRootElement(doc);
@@ -48,16 +48,16 @@ static xmlDocPtr make_canonical_schema(packedobjectsContext *pc)
   return canonical_doc;
 }
 
-int canon_make_canonical_schema(packedobjectsContext *pc)
+int canon_make_canonical_schema(packedobjectsSchema *ps)
 {
   xmlDoc *doc_canonical_schema = NULL;
 
   // create the canonical schema we will use for encoding/decoding
-  doc_canonical_schema = make_canonical_schema(pc);
+  doc_canonical_schema = make_canonical_schema(ps);
 #ifdef DEBUG_MODE
   packedobjects_dump_doc_to_file("/tmp/canon.xml", doc_canonical_schema);
 #endif  
-  pc->doc_canonical_schema = doc_canonical_schema;
+  ps->doc_canonical_schema = doc_canonical_schema;
 
   return 0;
   
@@ -344,10 +344,10 @@ static void make_canonical_schema_worker(xmlNode *node1, xmlNode *node2)
 }
 
 
-void canon_free(packedobjectsContext *pc)
+void canon_free(packedobjectsSchema *ps)
 {
 
-  xmlFreeDoc(pc->doc_canonical_schema);  
+  xmlFreeDoc(ps->doc_canonical_schema);  
 
 }
 
@@ -3,7 +3,7 @@
 
 #include "packedobjects.h"
 
-int canon_make_canonical_schema(packedobjectsContext *pc);
-void canon_free(packedobjectsContext *pc);
+int canon_make_canonical_schema(packedobjectsSchema *ps);
+void canon_free(packedobjectsSchema *ps);
 
 #endif
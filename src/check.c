@@ -0,0 +1,999 @@
+/*
+ * round trip and negative tests run by test/po-test.sh, one check per run
+ * as the pool check must install its allocator before libxml2 is used.
+ * every check exits with EXIT_FAILURE and a message on the first fault
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "packedobjects.h"
+#include "layout.h"
+
+// the event stream of a decode written out as text
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t size;
+} eventLog;
+
+// one worker of the threads check with its own context
+typedef struct {
+  pthread_t thread;
+  packedobjectsContext *pc;
+  const char *infile;
+  char *pdu;
+  int bytes;
+  xmlChar *xml;
+  int loop;
+  int failures;
+} stressWorker;
+
+static void check_bits(void);
+static void check_strings(void);
+static void check_threads(const char *schema_file, const char *infile);
+static void check_text(const char *schema_file, const char *infile);
+static void check_arena(const char *schema_file, const char *infile);
+static void check_pool(const char *schema_file, const char *infile);
+static void check_batch(const char *schema_file, const char *infile);
+static void check_parallel(const char *schema_file, const char *infile);
+static void check_validate(const char *schema_file, const char *infile);
+static void check_compiled(const char *schema_file, const char *infile);
+static void check_struct(const char *schema_file, const char *infile);
+static void check_core(const char *schema_file, const char *infile);
+static void check_hostile(const char *schema_file, const char *infile);
+static char *copy_pdu(packedobjectsContext *pc, const char *infile, int *bytes);
+static void damage_compiled(const char *path);
+static void forge_compiled(const char *from, const char *to, size_t field, int32_t value);
+static void log_event(eventLog *log, const char *kind, const char *name, const char *value);
+static void log_start(void *user, const char *name);
+static void log_end(void *user, const char *name);
+static void log_integer(void *user, const char *name, int64_t value);
+static void log_string(void *user, const char *name, const char *value, size_t len);
+static void log_boolean(void *user, const char *name, int value);
+static void log_enumerated(void *user, const char *name, int index, const char *value);
+static void log_po_start(void *user, const xmlChar *name);
+static void log_po_end(void *user, const xmlChar *name);
+static void log_po_integer(void *user, const xmlChar *name, int64_t value);
+static void log_po_string(void *user, const xmlChar *name, const char *value, size_t len);
+static void log_po_boolean(void *user, const xmlChar *name, int value);
+static void log_po_enumerated(void *user, const xmlChar *name, int index, const xmlChar *value);
+static xmlNodePtr find_leaf(planNode *plan, xmlNodePtr node, int type, int variant, planNode **found);
+static int spoiled_rejected(packedobjectsContext **pc, xmlDocPtr bad);
+static void *stress_worker(void *arg);
+static void *free_docs(void *arg);
+static void print_usage(void);
+static void exit_with_message(char *message);
+
+// encode a document and keep a copy of its PDU
+static char *copy_pdu(packedobjectsContext *pc, const char *infile, int *bytes)
+{
+  xmlDocPtr doc = NULL;
+  char *pdu = NULL;
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  packedobjects_encode(pc, doc);
+  if (pc->encode_error) exit_with_message("encode failed");
+  *bytes = pc->bytes;
+  if ((pdu = malloc(*bytes)) == NULL) exit_with_message("out of memory");
+  memcpy(pdu, pc->encodep->pdu, *bytes);
+  xmlFreeDoc(doc);
+
+  return pdu;
+}
+
+// flip a bit just past the header so only the checksum can notice
+static void damage_compiled(const char *path)
+{
+  char byte;
+  int fd;
+
+  if ((fd = open(path, O_RDWR)) == -1) exit_with_message("could not open compiled schema");
+  if ((pread(fd, &byte, 1, sizeof(compiledHeader)) != 1)) exit_with_message("could not read compiled schema");
+  byte ^= 1;
+  if ((pwrite(fd, &byte, 1, sizeof(compiledHeader)) != 1)) exit_with_message("could not write compiled schema");
+  close(fd);
+}
+
+// set a field of the first node and fix the hash so only the loader can notice
+static void forge_compiled(const char *from, const char *to, size_t field, int32_t value)
+{
+  compiledHeader *header = NULL;
+  char buf[65536];
+  FILE *fp = NULL;
+  size_t size;
+
+  if ((fp = fopen(from, "rb")) == NULL) exit_with_message("could not open compiled schema");
+  size = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  if (size < sizeof(compiledHeader) + sizeof(compiledNode)) exit_with_message("compiled schema too short to forge");
+  memcpy(buf + sizeof(compiledHeader) + field, &value, sizeof(value));
+  header = (compiledHeader *)buf;
+  header->hash = compiled_hash_bytes(buf + sizeof(compiledHeader), size - sizeof(compiledHeader));
+  if ((fp = fopen(to, "wb")) == NULL) exit_with_message("could not write compiled schema");
+  if (fwrite(buf, 1, size, fp) != size) exit_with_message("could not write compiled schema");
+  fclose(fp);
+}
+
+// values of every width read back as written, and not a bit further
+static void check_bits(void)
+{
+  static const unsigned char mix[] = { 1, 2, 7, 8, 4, 16, 3, 7, 32, 10, 1, 8, 13, 7, 24, 5 };
+  unsigned long values[4096];
+  unsigned char widths[4096];
+  packedEncode *encodep = NULL;
+  packedDecode *decodep = NULL;
+  char pdu[4096 * WORD_BYTE];
+  uint32_t x = 2463534242U;
+  int i, bytes, count = 4096;
+
+  for (i = 0; i < count; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    widths[i] = (i < 32) ? i + 1 : mix[i % sizeof(mix)];
+    values[i] = (widths[i] == 32) ? x : (x & ((1UL << widths[i]) - 1));
+  }
+  if ((encodep = initializeEncode(pdu, sizeof(pdu))) == NULL) exit_with_message("initializeEncode failed");
+  if (setjmp(encodep->env)) exit_with_message("bits encode failed");
+  for (i = 0; i < count; i++) {
+    encode(encodep, values[i], widths[i]);
+  }
+  bytes = finalizeEncode(encodep);
+
+  if ((decodep = initializeDecode(pdu, bytes)) == NULL) exit_with_message("initializeDecode failed");
+  if (setjmp(decodep->env)) exit_with_message("bits decode failed");
+  for (i = 0; i < count; i++) {
+    if (decode(decodep, widths[i]) != values[i]) exit_with_message("bits decoded differently");
+  }
+  // whatever padding the last byte has, a full word more is not there
+  if (setjmp(decodep->env) != DECODE_PDU_TRUNCATED) {
+    decode(decodep, WORD_32BIT);
+    exit_with_message("read past the end of the pdu");
+  }
+
+  printf("bits: %d values, %d bytes, passed\n", count, bytes);
+  freeDecode(decodep);
+  freeEncode(encodep);
+}
+
+/*
+ * strings either side of the eight char groups the coders move at once
+ * must come out as a char at a time would write and read them
+ */
+static void check_strings(void)
+{
+  static const int lengths[] = { 0, 1, 7, 8, 9, 15, 16, 17, 64, 1024, 65536 };
+  packedEncode *encodep = NULL;
+  packedDecode *decodep = NULL;
+  char *s = NULL, *t = NULL, *pdu = NULL;
+  int i, k, n, len, size, bytes;
+
+  size = lengths[10] + WORD_BYTE * 4;
+  s = malloc(lengths[10] + 1);
+  pdu = malloc(size);
+  if (!s || !pdu) exit_with_message("out of memory");
+  srand(1);
+  for (i = 0; i < lengths[10]; i++) {
+    s[i] = ' ' + rand() % 95;
+  }
+  if ((encodep = initializeEncode(pdu, size)) == NULL) exit_with_message("initializeEncode failed");
+  if ((decodep = initializeDecode(NULL, 0)) == NULL) exit_with_message("initializeDecode failed");
+
+  for (k = 0; k < 11; k++) {
+    len = lengths[k];
+    s[len] = '\0';
+    resetEncode(encodep);
+    encodeSemiConstrainedString(encodep, s);
+    bytes = finalizeEncode(encodep);
+
+    if (setjmp(decodep->env)) exit_with_message("string decode failed");
+    resetDecode(decodep, pdu, bytes);
+    if ((n = decodeUnsignedSemiConstrainedInteger(decodep, 0)) != len) exit_with_message("string length differs");
+    for (i = 0; i < len; i++) {
+      if (decode(decodep, 7) != s[i]) exit_with_message("string pdu differs");
+    }
+    resetDecode(decodep, pdu, bytes);
+    t = decodeSemiConstrainedString(decodep);
+    if (strcmp(s, t)) exit_with_message("string decoded differently");
+    free(t);
+
+    // a pdu cut short inside the last few chars is still caught
+    if (len) {
+      resetDecode(decodep, pdu, bytes - 1);
+      if (setjmp(decodep->env) != DECODE_PDU_TRUNCATED) {
+        t = decodeSemiConstrainedString(decodep);
+        exit_with_message("short string pdu was decoded");
+      }
+    }
+    s[len] = ' ' + rand() % 95;
+  }
+
+  // a length the pdu can not hold is refused before anything is allocated
+  resetEncode(encodep);
+  encodeUnsignedSemiConstrainedInteger(encodep, INT_MAX, 0);
+  encodeFixedLengthString(encodep, s, 64);
+  bytes = finalizeEncode(encodep);
+  resetDecode(decodep, pdu, bytes);
+  i = decodep->mallocs;
+  if (setjmp(decodep->env) != DECODE_PDU_TRUNCATED) {
+    t = decodeSemiConstrainedString(decodep);
+    exit_with_message("overlong string pdu was decoded");
+  }
+  if (decodep->mallocs != i) exit_with_message("overlong string was allocated");
+
+  printf("strings: %d lengths, passed\n", k);
+  freeEncode(encodep);
+  freeDecode(decodep);
+  free(s);
+  free(pdu);
+}
+
+// every other round provokes an error so longjmps race with good encodes
+static void *stress_worker(void *arg)
+{
+  stressWorker *w = arg;
+  xmlDocPtr doc = NULL;
+  xmlDocPtr out = NULL;
+  xmlChar *xml = NULL;
+  char *pdu = NULL;
+  size_t len;
+  int i, size;
+
+  if ((doc = packedobjects_new_doc(w->infile)) == NULL) {
+    w->failures++;
+    return NULL;
+  }
+  for (i = 0; i < w->loop; i++) {
+    // a byte short is enough, and an empty pdu has nothing to cut
+    if ((i & 1) && w->bytes) {
+      pdu = malloc(w->bytes - 1);
+      if (packedobjects_encode_into(w->pc, doc, pdu, w->bytes - 1, &len) != ENCODE_PDU_BUFFER_FULL) w->failures++;
+      free(pdu);
+      packedobjects_decode_n(w->pc, w->pdu, w->bytes - 1);
+      if (w->pc->decode_error != DECODE_PDU_TRUNCATED) w->failures++;
+      continue;
+    }
+    pdu = packedobjects_encode(w->pc, doc);
+    if ((w->pc->bytes != w->bytes) || memcmp(pdu, w->pdu, w->bytes)) {
+      w->failures++;
+      continue;
+    }
+    out = packedobjects_decode_n(w->pc, w->pdu, w->bytes);
+    if (w->pc->decode_error) {
+      w->failures++;
+      continue;
+    }
+    xmlDocDumpMemory(out, &xml, &size);
+    if (!xmlStrEqual(xml, w->xml)) w->failures++;
+    xmlFree(xml);
+    xmlFreeDoc(out);
+  }
+  xmlFreeDoc(doc);
+
+  return NULL;
+}
+
+// independent contexts sharing a schema must not disturb each other
+static void check_threads(const char *schema_file, const char *infile)
+{
+  stressWorker workers[8];
+  packedobjectsSchema *ps = NULL;
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr doc = NULL;
+  xmlChar *xml = NULL;
+  char *pdu = NULL;
+  int i, bytes, size, error = -1, failures = 0;
+
+  // reference output from a single thread
+  if ((pc = init_packedobjects(schema_file, 0, 0)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  pdu = copy_pdu(pc, infile, &bytes);
+  doc = packedobjects_decode_n(pc, pdu, bytes);
+  if (pc->decode_error) exit_with_message("reference decode failed");
+  xmlDocDumpMemory(doc, &xml, &size);
+  xmlFreeDoc(doc);
+  free_packedobjects(pc);
+
+  if ((ps = init_packedobjects_schema(schema_file, 0, NULL)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  memset(workers, 0, sizeof(workers));
+  for (i = 0; i < 8; i++) {
+    if ((workers[i].pc = init_packedobjects_with_schema(ps, 0, &error)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+    if (error) exit_with_message("context made with an error set");
+    workers[i].infile = infile;
+    workers[i].pdu = pdu;
+    workers[i].bytes = bytes;
+    workers[i].xml = xml;
+    workers[i].loop = 100;
+  }
+  free_packedobjects_schema(ps);
+  for (i = 0; i < 8; i++) {
+    if (pthread_create(&workers[i].thread, NULL, stress_worker, &workers[i])) exit_with_message("pthread_create failed");
+  }
+  for (i = 0; i < 8; i++) {
+    pthread_join(workers[i].thread, NULL);
+    failures += workers[i].failures;
+    free_packedobjects(workers[i].pc);
+  }
+  if (failures) exit_with_message("threads disturbed each other");
+
+  printf("threads: %s, passed\n", infile);
+  free(pdu);
+  xmlFree(xml);
+}
+
+// decoding straight to text gives what building a tree and dumping it does
+static void check_text(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr doc = NULL;
+  xmlChar *xml = NULL;
+  char *pdu = NULL;
+  char *text = NULL;
+  int bytes, size, len;
+
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  pdu = copy_pdu(pc, infile, &bytes);
+  doc = packedobjects_decode_n(pc, pdu, bytes);
+  if (pc->decode_error) exit_with_message("decode failed");
+  xmlDocDumpMemory(doc, &xml, &size);
+  xmlFreeDoc(doc);
+  text = packedobjects_decode_to_text(pc, pdu, bytes, &len);
+  if (pc->decode_error) exit_with_message("decode to text failed");
+  if ((len != size) || memcmp(text, xml, len)) exit_with_message("text differs from xmlDocDumpMemory");
+
+  printf("text: %s, passed\n", infile);
+  xmlFree(xml);
+  free(pdu);
+  free_packedobjects(pc);
+}
+
+// once warmed up the arena gives out strings without calling malloc
+static void check_arena(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  char *pdu = NULL;
+  unsigned long mallocs;
+  int i, bytes, len;
+
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION | DECODE_STRING_ARENA)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  pdu = copy_pdu(pc, infile, &bytes);
+  // the first decode grows the arena to fit
+  packedobjects_decode_to_text(pc, pdu, bytes, &len);
+  mallocs = pc->decodep->mallocs;
+  for (i = 0; i < 10; i++) {
+    packedobjects_decode_to_text(pc, pdu, bytes, &len);
+    if (pc->decode_error) exit_with_message("decode to text failed");
+  }
+  if (pc->decodep->mallocs != mallocs) exit_with_message("arena still calls malloc");
+
+  printf("arena: %s, passed\n", infile);
+  free(pdu);
+  free_packedobjects(pc);
+}
+
+static void *free_docs(void *arg)
+{
+  xmlDocPtr *docs = arg;
+  int i;
+
+  for (i = 0; docs[i]; i++) {
+    xmlFreeDoc(docs[i]);
+  }
+
+  return NULL;
+}
+
+// documents freed in another thread must come back to the one that made them
+static void check_pool(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr docs[17];
+  pthread_t thread;
+  char *pdu = NULL;
+  unsigned long allocs = 0;
+  int i, j, bytes, rounds = 64;
+
+  // must come before anything else touches libxml2
+  if (packedobjects_pool_memory() == -1) exit_with_message("failed to install pool");
+  if ((pc = init_packedobjects(schema_file, 0, DECODE_STRING_ARENA)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  pdu = copy_pdu(pc, infile, &bytes);
+
+  for (i = 0; i <= rounds; i++) {
+    // the first round fills the free lists
+    if (i == 1) allocs = packedobjects_pool_system_allocs();
+    for (j = 0; j < 16; j++) {
+      docs[j] = packedobjects_decode_n(pc, pdu, bytes);
+      if (pc->decode_error) exit_with_message("decode failed");
+    }
+    docs[16] = NULL;
+    if (pthread_create(&thread, NULL, free_docs, docs)) exit_with_message("pthread_create failed");
+    pthread_join(thread, NULL);
+  }
+  if (packedobjects_pool_system_allocs() - allocs >= rounds * 16) exit_with_message("blocks freed by another thread were not reused");
+
+  printf("pool: %s, passed\n", infile);
+  free(pdu);
+  free_packedobjects(pc);
+}
+
+// a bad document in a batch fails alone and the rest match single encodes
+static void check_batch(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr docs[16];
+  char *bufs[16];
+  int lens[16];
+  char *pdu = NULL;
+  int i, bytes;
+
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  pdu = copy_pdu(pc, infile, &bytes);
+  if ((docs[0] = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  for (i = 1; i < 16; i++) {
+    if ((docs[i] = xmlCopyDoc(docs[0], 1)) == NULL) exit_with_message("out of memory");
+  }
+
+  xmlNodeSetName(xmlDocGetRootElement(docs[1]), BAD_CAST "nosuchelement");
+  if (packedobjects_encode_batch(pc, docs, 16, bufs, lens) != 1) exit_with_message("batch did not report one failure");
+  if ((lens[1] != -ENCODE_XPATH_QUERY_FAILED) || bufs[1]) exit_with_message("batch did not report the error");
+  for (i = 0; i < 16; i++) {
+    if ((i != 1) && ((lens[i] != bytes) || memcmp(bufs[i], pdu, bytes))) exit_with_message("batch pdu differs");
+  }
+
+  printf("batch: %s, passed\n", infile);
+  for (i = 0; i < 16; i++) {
+    xmlFreeDoc(docs[i]);
+  }
+  free(pdu);
+  free_packedobjects(pc);
+}
+
+// workers give back what a single context does, in input order
+static void check_parallel(const char *schema_file, const char *infile)
+{
+  packedobjectsSchema *ps = NULL;
+  packedobjectsWorkers *pw = NULL;
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr docs[64];
+  xmlDocPtr out[64];
+  xmlDocPtr doc = NULL;
+  xmlChar *xml = NULL, *check = NULL;
+  char *bufs[64];
+  char *pdu = NULL;
+  int lens[64];
+  int i, bytes, size, check_size;
+
+  // validation is left out so the workers can share the input documents
+  if ((ps = init_packedobjects_schema(schema_file, NO_DATA_VALIDATION, NULL)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if ((pc = init_packedobjects_with_schema(ps, 0, NULL)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  pdu = copy_pdu(pc, infile, &bytes);
+  doc = packedobjects_decode_n(pc, pdu, bytes);
+  if (pc->decode_error) exit_with_message("reference decode failed");
+  xmlDocDumpMemory(doc, &xml, &size);
+  xmlFreeDoc(doc);
+  free_packedobjects(pc);
+  if ((docs[0] = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  for (i = 1; i < 64; i++) {
+    if ((docs[i] = xmlCopyDoc(docs[0], 1)) == NULL) exit_with_message("out of memory");
+  }
+
+  if ((pw = packedobjects_workers_new(ps, 4, 0)) == NULL) exit_with_message("failed to start workers");
+  if (packedobjects_encode_parallel(pw, docs, 64, bufs, lens)) exit_with_message("parallel encode failed");
+  for (i = 0; i < 64; i++) {
+    if ((lens[i] != bytes) || memcmp(bufs[i], pdu, bytes)) exit_with_message("parallel pdu differs");
+  }
+  if (packedobjects_decode_parallel(pw, bufs, lens, 64, out, NULL)) exit_with_message("parallel decode failed");
+  for (i = 0; i < 64; i++) {
+    xmlDocDumpMemory(out[i], &check, &check_size);
+    if ((check_size != size) || memcmp(check, xml, size)) exit_with_message("parallel decode differs");
+    xmlFree(check);
+    xmlFreeDoc(out[i]);
+  }
+  packedobjects_workers_free(pw);
+
+  printf("parallel: %s, passed\n", infile);
+  for (i = 0; i < 64; i++) {
+    xmlFreeDoc(docs[i]);
+  }
+  free_packedobjects_schema(ps);
+  xmlFree(xml);
+  free(pdu);
+}
+
+// the first element of type and variant, or of any variant if that is 0
+static xmlNodePtr find_leaf(planNode *plan, xmlNodePtr node, int type, int variant, planNode **found)
+{
+  xmlNodePtr cur_node = NULL;
+  xmlNodePtr leaf = NULL;
+  planNode *np = NULL;
+  int cursor = 0;
+
+  if ((plan->type == type) && (!variant || (plan->variant == variant))) {
+    *found = plan;
+    return node;
+  }
+  for (cur_node = node->children; cur_node && !leaf; cur_node = cur_node->next) {
+    if (cur_node->type == XML_ELEMENT_NODE) {
+      if ((np = plan_find_child(plan, cur_node->name, &cursor)) == NULL) {
+        exit_with_message("data does not match schema");
+      }
+      leaf = find_leaf(np, cur_node, type, variant, found);
+    }
+  }
+
+  return leaf;
+}
+
+// 1 if both validators reject the document, tree and streamed, 0 if both accept
+static int spoiled_rejected(packedobjectsContext **pc, xmlDocPtr bad)
+{
+  xmlChar *xml = NULL;
+  int j, size, rejected[4];
+
+  xmlDocDumpMemory(bad, &xml, &size);
+  for (j = 0; j < 2; j++) {
+    packedobjects_encode(pc[j], bad);
+    rejected[j] = (pc[j]->encode_error == ENCODE_VALIDATION_FAILED);
+    packedobjects_encode_with_string(pc[j], (char *)xml);
+    rejected[j + 2] = (pc[j]->encode_error == ENCODE_VALIDATION_FAILED);
+  }
+  xmlFree(xml);
+  if ((rejected[0] != rejected[1]) || (rejected[0] != rejected[2]) || (rejected[0] != rejected[3])) {
+    exit_with_message("inline validation disagrees with libxml2");
+  }
+
+  return rejected[0];
+}
+
+// libxml2's validator, the inline checks and no validation agree on good and spoilt data
+static void check_validate(const char *schema_file, const char *infile)
+{
+  static const int options[] = { 0, INLINE_VALIDATION, NO_DATA_VALIDATION };
+  po_handler none = { NULL };
+  packedobjectsContext *pc[3];
+  planNode *np = NULL;
+  xmlDocPtr doc = NULL;
+  xmlDocPtr bad = NULL;
+  xmlDocPtr out = NULL;
+  xmlNodePtr root = NULL;
+  xmlNodePtr leaf = NULL;
+  char *pdu = NULL;
+  char *ref = NULL;
+  char value[24];
+  int i, j, k, bytes = 0, spoiled = 0;
+
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  for (j = 0; j < 3; j++) {
+    if ((pc[j] = init_packedobjects(schema_file, 0, options[j])) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  }
+
+  // valid data comes out the same whichever way it was checked
+  for (j = 0; j < 3; j++) {
+    pdu = packedobjects_encode(pc[j], doc);
+    if (pc[j]->encode_error) exit_with_message("encode failed");
+    out = packedobjects_decode_n(pc[j], pdu, pc[j]->bytes);
+    if (pc[j]->decode_error) exit_with_message("decode failed");
+    xmlFreeDoc(out);
+    if (j == 0) {
+      bytes = pc[0]->bytes;
+      if ((ref = malloc(bytes)) == NULL) exit_with_message("out of memory");
+      memcpy(ref, pdu, bytes);
+    } else if ((pc[j]->bytes != bytes) || memcmp(pdu, ref, bytes)) {
+      exit_with_message("pdu differs");
+    }
+  }
+
+  // spoil a copy of the data in a few ways the facets should catch
+  for (k = 0; k < 4; k++) {
+    if ((bad = xmlCopyDoc(doc, 1)) == NULL) exit_with_message("out of memory");
+    root = xmlDocGetRootElement(bad);
+    switch (k) {
+    case 0:
+      leaf = find_leaf(pc[0]->plan, root, INTEGER_TYPE, 0, &np);
+      if (leaf) xmlNodeSetContent(leaf, BAD_CAST "?");
+      break;
+    case 1:
+      leaf = find_leaf(pc[0]->plan, root, ENUMERATED_TYPE, 0, &np);
+      if (leaf) xmlNodeSetContent(leaf, BAD_CAST "?");
+      break;
+    case 2:
+      leaf = find_leaf(pc[0]->plan, root, INTEGER_TYPE, CONSTRAINED, &np);
+      if (leaf) {
+        sprintf(value, "%ld", np->ub + 1);
+        xmlNodeSetContent(leaf, BAD_CAST value);
+      }
+      break;
+    case 3:
+      // one child too many for a sequence or choice, which a sequence-of may allow
+      if ((leaf = xmlFirstElementChild(root))) {
+        xmlAddChild(root, xmlDocCopyNode(leaf, bad, 1));
+      }
+      break;
+    }
+    if (leaf) {
+      // anything but the extra child must be turned down
+      if (!spoiled_rejected(pc, bad) && (k != 3)) exit_with_message("spoilt data was accepted");
+      spoiled++;
+    }
+
+    // a value the PDU can carry but the facets forbid must not decode either
+    if ((k == 2) && leaf && ((pdu = packedobjects_encode(pc[2], bad)) != NULL) && (pc[2]->bytes > 0)) {
+      out = packedobjects_decode_n(pc[1], pdu, pc[2]->bytes);
+      xmlFreeDoc(out);
+      if (((np->ub + 1 - np->lb) < (1L << np->bits)) && (pc[1]->decode_error != DECODE_VALIDATION_FAILED)) {
+        exit_with_message("inline validation decoded a value out of range");
+      }
+      // callbacks are checked the same way as the tree
+      i = pc[1]->decode_error;
+      if (packedobjects_decode_events(pc[1], pdu, pc[2]->bytes, &none, NULL) != i) {
+        exit_with_message("inline validation decoded events differently");
+      }
+    }
+    xmlFreeDoc(bad);
+  }
+
+  printf("validate: %s, %d spoilt documents, passed\n", infile, spoiled);
+  for (j = 0; j < 3; j++) {
+    free_packedobjects(pc[j]);
+  }
+  xmlFreeDoc(doc);
+  free(ref);
+}
+
+// a compiled schema encodes exactly as its XSD does and refuses damage
+static void check_compiled(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  xmlDocPtr doc = NULL;
+  char path[] = "/tmp/po-checkXXXXXX";
+  char forged[] = "/tmp/po-checkXXXXXX";
+  char *pdu = NULL;
+  uint64_t hash;
+  int fd, bytes;
+
+  if ((fd = mkstemp(path)) == -1) exit_with_message("could not create temporary file");
+  close(fd);
+  if ((pc = init_packedobjects(schema_file, 0, INLINE_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if (packedobjects_write_compiled(pc->schema, path) == -1) exit_with_message("failed to write compiled schema");
+  hash = pc->schema->hash;
+  pdu = copy_pdu(pc, infile, &bytes);
+  free_packedobjects(pc);
+
+  if ((pc = init_packedobjects_from_compiled(path, 0, 0)) == NULL) exit_with_message("failed to load compiled schema");
+  if (pc->schema->hash != hash) exit_with_message("compiled schema hash differs");
+  // without the XSD data validation is left to the inline checks
+  if ((pc->init_options & INLINE_VALIDATION) == 0) exit_with_message("compiled schema does not validate");
+  if ((doc = packedobjects_new_doc(infile)) == NULL) exit_with_message("did not find .xml file");
+  packedobjects_encode(pc, doc);
+  if (pc->encode_error) exit_with_message("encode with compiled schema failed");
+  if ((pc->bytes != bytes) || memcmp(pc->encodep->pdu, pdu, bytes)) exit_with_message("compiled schema pdu differs");
+  free_packedobjects(pc);
+
+  // a node the decoder could not read is turned away even with a good hash
+  if ((fd = mkstemp(forged)) == -1) exit_with_message("could not create temporary file");
+  close(fd);
+  forge_compiled(path, forged, offsetof(compiledNode, bits), 33);
+  if (init_packedobjects_from_compiled(forged, 0, 0) != NULL) exit_with_message("33 bit compiled node was loaded");
+  forge_compiled(path, forged, offsetof(compiledNode, type), SEQUENCE_OPTIONAL_TYPE);
+  forge_compiled(forged, forged, offsetof(compiledNode, items), 33);
+  if (init_packedobjects_from_compiled(forged, 0, 0) != NULL) exit_with_message("33 bit compiled bitmap was loaded");
+
+  damage_compiled(path);
+  if (init_packedobjects_from_compiled(path, 0, 0) != NULL) exit_with_message("damaged compiled schema was loaded");
+
+  printf("compiled: %s, passed\n", infile);
+  unlink(forged);
+  unlink(path);
+  xmlFreeDoc(doc);
+  free(pdu);
+}
+
+// a struct holds everything the pdu did and a short pdu fails as for a tree
+static void check_struct(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  po_field fields[MAX_FIELDS];
+  char path[MAX_PATH] = "";
+  char *pdu = NULL;
+  void *msg = NULL;
+  size_t size;
+  int i, n = 0, bytes;
+
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  size = layout_struct(pc->plan, path, fields, &n, 0);
+  if (packedobjects_register_struct(pc, fields, n, size) == -1) exit_with_message("failed to register struct");
+  for (i = 0; i < n; i++) {
+    free((char *)fields[i].path);
+  }
+  if ((msg = malloc(size)) == NULL) exit_with_message("out of memory");
+  pdu = copy_pdu(pc, infile, &bytes);
+
+  if (packedobjects_decode_struct(pc, pdu, bytes, msg)) exit_with_message("decode struct failed");
+  packedobjects_encode_struct(pc, msg);
+  if (pc->encode_error) exit_with_message("encode struct failed");
+  packedobjects_free_struct(pc, msg);
+  if ((pc->bytes != bytes) || memcmp(pc->encodep->pdu, pdu, bytes)) exit_with_message("struct pdu differs");
+
+  xmlFreeDoc(packedobjects_decode_n(pc, pdu, bytes / 2));
+  i = pc->decode_error;
+  if (packedobjects_decode_struct(pc, pdu, bytes / 2, msg) != i) exit_with_message("short pdu decoded differently");
+  if (i == 0) packedobjects_free_struct(pc, msg);
+
+  printf("struct: %s, passed\n", infile);
+  free(msg);
+  free(pdu);
+  free_packedobjects(pc);
+}
+
+static void log_event(eventLog *log, const char *kind, const char *name, const char *value)
+{
+  size_t n = strlen(kind) + strlen(name) + strlen(value) + 3;
+
+  if (log->len + n >= log->size) {
+    log->size = (log->size + n) * 2;
+    if ((log->buf = realloc(log->buf, log->size)) == NULL) exit_with_message("out of memory");
+  }
+  log->len += sprintf(log->buf + log->len, "%s %s %s\n", kind, name, value);
+}
+
+static void log_start(void *user, const char *name)
+{
+  log_event(user, "start", name, "");
+}
+
+static void log_end(void *user, const char *name)
+{
+  log_event(user, "end", name, "");
+}
+
+static void log_integer(void *user, const char *name, int64_t value)
+{
+  char s[24];
+
+  sprintf(s, "%lld", (long long)value);
+  log_event(user, "integer", name, s);
+}
+
+static void log_string(void *user, const char *name, const char *value, size_t len)
+{
+  if (strlen(value) != len) exit_with_message("string length differs");
+  log_event(user, "string", name, value);
+}
+
+static void log_boolean(void *user, const char *name, int value)
+{
+  log_event(user, "boolean", name, (value) ? "true" : "false");
+}
+
+static void log_enumerated(void *user, const char *name, int index, const char *value)
+{
+  log_event(user, "enumerated", name, value);
+}
+
+// the same for the libxml2 decoder
+static void log_po_start(void *user, const xmlChar *name)
+{
+  log_start(user, (const char *)name);
+}
+
+static void log_po_end(void *user, const xmlChar *name)
+{
+  log_end(user, (const char *)name);
+}
+
+static void log_po_integer(void *user, const xmlChar *name, int64_t value)
+{
+  log_integer(user, (const char *)name, value);
+}
+
+static void log_po_string(void *user, const xmlChar *name, const char *value, size_t len)
+{
+  log_string(user, (const char *)name, value, len);
+}
+
+static void log_po_boolean(void *user, const xmlChar *name, int value)
+{
+  log_boolean(user, (const char *)name, value);
+}
+
+static void log_po_enumerated(void *user, const xmlChar *name, int index, const xmlChar *value)
+{
+  log_enumerated(user, (const char *)name, index, (const char *)value);
+}
+
+// the libxml2 free decoder sees exactly what decode_events does
+static void check_core(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  coreSchema *cs = NULL;
+  packedDecode *decodep = NULL;
+  po_handler h = { .start_element = log_po_start, .end_element = log_po_end, .integer = log_po_integer,
+                   .string = log_po_string, .boolean = log_po_boolean, .enumerated = log_po_enumerated };
+  core_handler ch = { .start_element = log_start, .end_element = log_end, .integer = log_integer,
+                      .string = log_string, .boolean = log_boolean, .enumerated = log_enumerated };
+  eventLog expected = { NULL, 0, 0 }, got = { NULL, 0, 0 };
+  char path[] = "/tmp/po-checkXXXXXX";
+  char forged[] = "/tmp/po-checkXXXXXX";
+  char *pdu = NULL;
+  int fd, bytes, error;
+
+  if ((fd = mkstemp(path)) == -1) exit_with_message("could not create temporary file");
+  close(fd);
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if (packedobjects_write_compiled(pc->schema, path) == -1) exit_with_message("failed to write compiled schema");
+  pdu = copy_pdu(pc, infile, &bytes);
+  if ((cs = core_schema_load(path)) == NULL) exit_with_message("core failed to load compiled schema");
+  if (cs->hash != pc->schema->hash) exit_with_message("core schema hash differs");
+  if ((decodep = initializeDecode(NULL, 0)) == NULL) exit_with_message("failed to initialise decoder");
+
+  if (packedobjects_decode_events(pc, pdu, bytes, &h, &expected)) exit_with_message("decode events failed");
+  if (core_decode(cs, decodep, pdu, bytes, &ch, &got)) exit_with_message("core decode failed");
+  if ((got.len != expected.len) || memcmp(got.buf, expected.buf, got.len)) exit_with_message("core events differ");
+
+  // a short pdu fails as it does for the full library
+  error = packedobjects_decode_events(pc, pdu, bytes / 2, &h, &expected);
+  if (core_decode(cs, decodep, pdu, bytes / 2, &ch, &got) != error) exit_with_message("short pdu decoded differently");
+
+  // a node the decoder could not read is turned away even with a good hash
+  if ((fd = mkstemp(forged)) == -1) exit_with_message("could not create temporary file");
+  close(fd);
+  forge_compiled(path, forged, offsetof(compiledNode, bits), 33);
+  if (core_schema_load(forged) != NULL) exit_with_message("33 bit compiled node was loaded");
+  forge_compiled(path, forged, offsetof(compiledNode, type), SEQUENCE_OPTIONAL_TYPE);
+  forge_compiled(forged, forged, offsetof(compiledNode, items), 33);
+  if (core_schema_load(forged) != NULL) exit_with_message("33 bit compiled bitmap was loaded");
+
+  // and a damaged file is turned away
+  damage_compiled(path);
+  if (core_schema_load(path) != NULL) exit_with_message("damaged compiled schema was loaded");
+
+  printf("core: %s, passed\n", infile);
+  unlink(forged);
+  unlink(path);
+  freeDecode(decodep);
+  core_schema_free(cs);
+  free_packedobjects(pc);
+  free(expected.buf);
+  free(got.buf);
+  free(pdu);
+}
+
+// a pdu crafted to lie fails the same way whichever decoder reads it
+static void check_hostile(const char *schema_file, const char *infile)
+{
+  packedobjectsContext *pc = NULL;
+  coreSchema *cs = NULL;
+  packedDecode *decodep = NULL;
+  po_field fields[MAX_FIELDS];
+  char path[MAX_PATH] = "";
+  char file[] = "/tmp/po-checkXXXXXX";
+  po_handler h = { .start_element = log_po_start, .end_element = log_po_end, .integer = log_po_integer,
+                   .string = log_po_string, .boolean = log_po_boolean, .enumerated = log_po_enumerated };
+  core_handler ch = { .start_element = log_start, .end_element = log_end, .integer = log_integer,
+                      .string = log_string, .boolean = log_boolean, .enumerated = log_enumerated };
+  eventLog log = { NULL, 0, 0 };
+  char pdu[4096];
+  void *msg = NULL;
+  FILE *fp = NULL;
+  size_t size;
+  int i, n = 0, fd, bytes, error, len;
+
+  if ((fp = fopen(infile, "rb")) == NULL) exit_with_message("did not find .po file");
+  bytes = fread(pdu, 1, sizeof(pdu), fp);
+  fclose(fp);
+  if ((fd = mkstemp(file)) == -1) exit_with_message("could not create temporary file");
+  close(fd);
+  if ((pc = init_packedobjects(schema_file, 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if (packedobjects_write_compiled(pc->schema, file) == -1) exit_with_message("failed to write compiled schema");
+  if ((cs = core_schema_load(file)) == NULL) exit_with_message("core failed to load compiled schema");
+  if ((decodep = initializeDecode(NULL, 0)) == NULL) exit_with_message("failed to initialise decoder");
+  size = layout_struct(pc->plan, path, fields, &n, 0);
+  if (packedobjects_register_struct(pc, fields, n, size) == -1) exit_with_message("failed to register struct");
+  for (i = 0; i < n; i++) {
+    free((char *)fields[i].path);
+  }
+  if ((msg = malloc(size)) == NULL) exit_with_message("out of memory");
+
+  xmlFreeDoc(packedobjects_decode_n(pc, pdu, bytes));
+  if ((error = pc->decode_error) == 0) exit_with_message("hostile pdu was decoded");
+  packedobjects_decode_to_text(pc, pdu, bytes, &len);
+  if (pc->decode_error != error) exit_with_message("text decoded differently");
+  if (packedobjects_decode_events(pc, pdu, bytes, &h, &log) != error) exit_with_message("events decoded differently");
+  if (packedobjects_decode_struct(pc, pdu, bytes, msg) != error) exit_with_message("struct decoded differently");
+  if (core_decode(cs, decodep, pdu, bytes, &ch, &log) != error) exit_with_message("core decoded differently");
+
+  printf("hostile: %s, error %d, passed\n", infile, error);
+  unlink(file);
+  freeDecode(decodep);
+  core_schema_free(cs);
+  free_packedobjects(pc);
+  free(log.buf);
+  free(msg);
+}
+
+static void print_usage(void)
+{
+  printf("usage: packedobjects-check --check bits\n");
+  printf("       packedobjects-check --check strings\n");
+  printf("       packedobjects-check --check <threads|text|arena|pool|batch|parallel|validate|compiled|struct|core> --schema <file> --in <file>\n");
+  printf("       packedobjects-check --check hostile --schema <file> --in <file.po>\n");
+  exit(EXIT_SUCCESS);
+}
+
+static void exit_with_message(char *message)
+{
+  printf("Failed to run: %s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  static const char *names[] = { "threads", "text", "arena", "pool", "batch", "parallel",
+                                 "validate", "compiled", "struct", "core", "hostile", NULL };
+  static void (*checks[])(const char *, const char *) = { check_threads, check_text, check_arena, check_pool, check_batch, check_parallel,
+                                                          check_validate, check_compiled, check_struct, check_core, check_hostile };
+  const char *check = NULL;
+  const char *schema_file = NULL;
+  const char *in_file = NULL;
+  int c, i;
+
+  while(1) {
+    static struct option long_options[] =
+      {
+        {"help",  no_argument, 0, 'h'},
+        {"check",  required_argument, 0, 'c'},
+        {"schema",  required_argument, 0, 's'},
+        {"in",  required_argument, 0, 'i'},
+        {0, 0, 0, 0}
+      };
+    int option_index = 0;
+
+    c = getopt_long (argc, argv, "hc:s:i:?", long_options, &option_index);
+
+    if (c == -1) break;
+
+    switch (c)
+      {
+      case 'c':
+        check = optarg;
+        break;
+
+      case 's':
+        schema_file = optarg;
+        break;
+
+      case 'i':
+        in_file = optarg;
+        break;
+
+      case 'h':
+      case '?':
+      default:
+        print_usage();
+      }
+  }
+
+  if (!check) exit_with_message("did not specify --check");
+
+  if (!strcmp(check, "bits")) {
+    check_bits();
+  } else if (!strcmp(check, "strings")) {
+    check_strings();
+  } else {
+    for (i = 0; names[i]; i++) {
+      if (!strcmp(check, names[i])) break;
+    }
+    if (!names[i]) exit_with_message("unknown --check");
+    if (!schema_file) exit_with_message("did not specify --schema file");
+    if (!in_file) exit_with_message("did not specify --in file");
+    checks[i](schema_file, in_file);
+  }
+
+  return EXIT_SUCCESS;
+}
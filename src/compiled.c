@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "compiled.h"
+#include "plan.h"
+
+#ifdef DEBUG_MODE
+#define dbg(fmtstr, args...) \
+  (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#else
+#define dbg(dummy...)
+#endif
+
+#ifdef QUIET_MODE
+#define alert(dummy...)
+#else
+#define alert(fmtstr, args...) \
+  (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#endif
+
+// the file as it is being laid out or read back
+typedef struct {
+  compiledNode *nodes;
+  char *strings;
+  uint32_t nnodes;
+  uint32_t nstrings;
+  uint32_t next;
+} compiledPlan;
+
+static void count_node(planNode *np, compiledPlan *cp);
+static uint32_t add_string(compiledPlan *cp, const xmlChar *s);
+static void write_node(planNode *np, compiledPlan *cp);
+static char *serialize(packedobjectsSchema *ps, uint32_t *size);
+static const char *read_string(compiledPlan *cp, uint32_t offset);
+static int read_node(packedobjectsSchema *ps, compiledPlan *cp, planNode *parent, planNode **slot);
+
+static void count_node(planNode *np, compiledPlan *cp)
+{
+  int i;
+
+  cp->nnodes++;
+  cp->nstrings += xmlStrlen(np->name) + 1;
+  if (np->enumeration) {
+    for (i = 0; i < np->items; i++) {
+      cp->nstrings += xmlStrlen(np->enumeration[i]) + 1;
+    }
+  }
+  for (i = 0; i < np->nchildren; i++) {
+    count_node(np->children[i], cp);
+  }
+}
+
+static uint32_t add_string(compiledPlan *cp, const xmlChar *s)
+{
+  uint32_t offset = cp->nstrings;
+  int n = xmlStrlen(s) + 1;
+
+  memcpy(cp->strings + offset, (s) ? (const char *)s : "", n);
+  cp->nstrings += n;
+
+  return offset;
+}
+
+static void write_node(planNode *np, compiledPlan *cp)
+{
+  compiledNode *cn = &cp->nodes[cp->next++];
+  int i;
+
+  cn->name = add_string(cp, np->name);
+  cn->nchildren = np->nchildren;
+  cn->type = np->type;
+  cn->variant = np->variant;
+  cn->lb = np->lb;
+  cn->ub = np->ub;
+  cn->length = np->length;
+  cn->items = np->items;
+  cn->bits = np->bits;
+  cn->unbounded = np->unbounded;
+  cn->has_max = np->has_max;
+  cn->enumeration = 0;
+  if (np->enumeration) {
+    for (i = 0; i < np->items; i++) {
+      if (i == 0) {
+        cn->enumeration = add_string(cp, np->enumeration[i]);
+      } else {
+        add_string(cp, np->enumeration[i]);
+      }
+    }
+  }
+  for (i = 0; i < np->nchildren; i++) {
+    write_node(np->children[i], cp);
+  }
+}
+
+// the whole file in memory, zeroed so the padding hashes the same every time
+static char *serialize(packedobjectsSchema *ps, uint32_t *size)
+{
+  compiledPlan cp = { NULL, NULL, 0, 0, 0 };
+  compiledHeader *header = NULL;
+  char *buf = NULL;
+
+  count_node(ps->plan, &cp);
+  *size = sizeof(compiledHeader) + cp.nnodes * sizeof(compiledNode) + cp.nstrings;
+  if ((buf = calloc(1, *size)) == NULL) {
+    alert("Could not allocate memory.");
+    return NULL;
+  }
+  header = (compiledHeader *)buf;
+  cp.nodes = (compiledNode *)(buf + sizeof(compiledHeader));
+  cp.strings = (char *)(cp.nodes + cp.nnodes);
+  cp.nstrings = 0;
+  write_node(ps->plan, &cp);
+
+  memcpy(header->magic, COMPILED_MAGIC, 4);
+  header->version = COMPILED_VERSION;
+  header->bom = COMPILED_BOM;
+  header->nnodes = cp.nnodes;
+  header->strings = cp.strings - buf;
+  header->size = *size;
+  header->hash = compiled_hash_bytes(buf + sizeof(compiledHeader), *size - sizeof(compiledHeader));
+
+  return buf;
+}
+
+// identifies the schema whichever way it was loaded
+int compiled_hash(packedobjectsSchema *ps)
+{
+  compiledHeader *header = NULL;
+  uint32_t size;
+
+  if ((header = (compiledHeader *)serialize(ps, &size)) == NULL) {
+    return -1;
+  }
+  ps->hash = header->hash;
+  free(header);
+
+  return 0;
+}
+
+int compiled_write(packedobjectsSchema *ps, const char *file)
+{
+  FILE *fp = NULL;
+  char *buf = NULL;
+  uint32_t size;
+  int result = 0;
+
+  if ((buf = serialize(ps, &size)) == NULL) {
+    return -1;
+  }
+  if ((fp = fopen(file, "wb")) == NULL) {
+    alert("Could not open file %s.", file);
+    free(buf);
+    return -1;
+  }
+  if (fwrite(buf, 1, size, fp) != size) {
+    alert("Could not write file %s.", file);
+    result = -1;
+  }
+  if (fclose(fp) != 0) {
+    result = -1;
+  }
+  free(buf);
+  dbg("wrote %u bytes", size);
+
+  return result;
+}
+
+static const char *read_string(compiledPlan *cp, uint32_t offset)
+{
+
+  if (offset >= cp->nstrings) {
+    alert("Compiled schema has a bad string offset.");
+    return NULL;
+  }
+
+  return cp->strings + offset;
+}
+
+// nodes are attached as soon as they exist so plan_free can clean up a failure
+static int read_node(packedobjectsSchema *ps, compiledPlan *cp, planNode *parent, planNode **slot)
+{
+  compiledNode *cn = NULL;
+  planNode *np = NULL;
+  const char *s = NULL;
+  int i;
+
+  if (cp->next == cp->nnodes) {
+    alert("Compiled schema is missing nodes.");
+    return -1;
+  }
+  cn = &cp->nodes[cp->next++];
+  if ((cn->type < UNKNOWN_TYPE) || (cn->type > UNIX_TIME_TYPE) ||
+      (cn->variant < UNKNOWN_VARIANT) || (cn->variant > FIXED_LENGTH) ||
+      // the decoder reads at most 32 bits at a time, bitmaps included
+      (cn->bits < 0) || (cn->bits > 32) || (cn->items < 0) ||
+      ((cn->type == SEQUENCE_OPTIONAL_TYPE) && (cn->items > 32)) ||
+      (cn->nchildren > cp->nnodes - cp->next)) {
+    alert("Compiled schema has a bad node.");
+    return -1;
+  }
+  if ((s = read_string(cp, cn->name)) == NULL) {
+    return -1;
+  }
+
+  if ((np = (planNode *)malloc(sizeof(planNode))) == NULL) {
+    alert("Could not allocate memory.");
+    return -1;
+  }
+  np->name = NULL;
+  np->schema_node = NULL;
+  np->parent = parent;
+  np->children = NULL;
+  np->nchildren = 0;
+  np->type = cn->type;
+  np->variant = cn->variant;
+  np->lb = cn->lb;
+  np->ub = cn->ub;
+  np->length = cn->length;
+  np->items = cn->items;
+  np->bits = cn->bits;
+  np->unbounded = cn->unbounded;
+  np->has_max = cn->has_max;
+  np->enumeration = NULL;
+  *slot = np;
+
+  // interned so decoded documents share the names as they do with an XSD
+  if ((np->name = xmlDictLookup(ps->dict, BAD_CAST s, -1)) == NULL) {
+    alert("Could not allocate memory.");
+    return -1;
+  }
+
+  if ((np->type == ENUMERATED_TYPE) && (np->items > 0)) {
+    if ((uint32_t)np->items > cp->nstrings) {
+      alert("Compiled schema has a bad node.");
+      return -1;
+    }
+    // point at the values held in the mapped file
+    if ((np->enumeration = (const xmlChar **)calloc(np->items, sizeof(xmlChar *))) == NULL) {
+      alert("Could not allocate memory.");
+      return -1;
+    }
+    for (i = 0; i < np->items; i++) {
+      if ((s = read_string(cp, (i == 0) ? cn->enumeration : s - cp->strings + strlen(s) + 1)) == NULL) {
+        return -1;
+      }
+      np->enumeration[i] = BAD_CAST s;
+    }
+  }
+
+  if (cn->nchildren == 0) {
+    np->min_bits = plan_min_bits(np);
+    return 0;
+  }
+  if ((np->children = (planNode **)calloc(cn->nchildren, sizeof(planNode *))) == NULL) {
+    alert("Could not allocate memory.");
+    return -1;
+  }
+  np->nchildren = cn->nchildren;
+  for (i = 0; i < np->nchildren; i++) {
+    if (read_node(ps, cp, np, &np->children[i]) == -1) {
+      return -1;
+    }
+  }
+  np->min_bits = plan_min_bits(np);
+
+  return 0;
+}
+
+/*
+ * map a file written by compiled_write and rebuild the plan from it. the
+ * file stays mapped for as long as the schema since enumerations point
+ * into it
+ */
+int compiled_read(packedobjectsSchema *ps, const char *file)
+{
+  compiledPlan cp = { NULL, NULL, 0, 0, 0 };
+  compiledHeader *header = NULL;
+  struct stat st;
+  void *map = NULL;
+  int fd;
+
+  if ((fd = open(file, O_RDONLY)) == -1) {
+    alert("Could not open file %s.", file);
+    return -1;
+  }
+  if ((fstat(fd, &st) == -1) || (st.st_size < (off_t)sizeof(compiledHeader))) {
+    alert("Compiled schema %s is too small.", file);
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    alert("Could not map file %s.", file);
+    return -1;
+  }
+  ps->compiled = map;
+  ps->compiled_size = st.st_size;
+
+  header = map;
+  if (memcmp(header->magic, COMPILED_MAGIC, 4) || (header->bom != COMPILED_BOM) ||
+      (header->version != COMPILED_VERSION) || (header->size != st.st_size)) {
+    alert("%s is not a compiled schema this library can read.", file);
+    return -1;
+  }
+  if ((header->nnodes == 0) ||
+      (header->strings != sizeof(compiledHeader) + (uint64_t)header->nnodes * sizeof(compiledNode)) ||
+      (header->strings >= header->size) || (((char *)map)[header->size - 1] != '\0')) {
+    alert("Compiled schema %s is damaged.", file);
+    return -1;
+  }
+  if (compiled_hash_bytes((char *)map + sizeof(compiledHeader), header->size - sizeof(compiledHeader)) != header->hash) {
+    alert("Compiled schema %s does not match its hash.", file);
+    return -1;
+  }
+  ps->hash = header->hash;
+
+  cp.nodes = (compiledNode *)((char *)map + sizeof(compiledHeader));
+  cp.nnodes = header->nnodes;
+  cp.strings = (char *)map + header->strings;
+  cp.nstrings = header->size - header->strings;
+
+  if ((ps->dict = xmlDictCreate()) == NULL) {
+    alert("Failed to create dictionary.");
+    return -1;
+  }
+  if ((read_node(ps, &cp, NULL, &ps->plan) == -1) || (cp.next != cp.nnodes)) {
+    alert("Failed to load plan from %s.", file);
+    return -1;
+  }
+
+  return 0;
+}
+
+void compiled_free(packedobjectsSchema *ps)
+{
+
+  if (ps->compiled) {
+    munmap(ps->compiled, ps->compiled_size);
+  }
+
+}
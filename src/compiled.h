@@ -0,0 +1,14 @@
+#ifndef COMPILED_H_
+#define COMPILED_H_
+
+#include <stdint.h>
+
+#include "packedobjects.h"
+
+// the file itself is laid out in core.h
+int compiled_hash(packedobjectsSchema *ps);
+int compiled_write(packedobjectsSchema *ps, const char *file);
+int compiled_read(packedobjectsSchema *ps, const char *file);
+void compiled_free(packedobjectsSchema *ps);
+
+#endif
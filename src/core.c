@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "core.h"
+
+#ifdef DEBUG_MODE
+#define dbg(fmtstr, args...) \
+  (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#else
+#define dbg(dummy...)
+#endif
+
+#ifdef QUIET_MODE
+#define alert(dummy...)
+#else
+#define alert(fmtstr, args...) \
+  (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#endif
+
+#define CHECK_BIT(var,pos) ((var) & (1<<(pos)))
+
+// what a decode needs at every node
+typedef struct {
+  coreSchema *cs;
+  packedDecode *decodep;
+  const core_handler *h;
+  void *user;
+} coreDecode;
+
+static int item_bits(coreSchema *cs, coreNode *np);
+static int load_node(coreSchema *cs, const char *strings, uint32_t nstrings, uint32_t *next, uint32_t *nvalues);
+static char *decode_string(packedDecode *d, const compiledNode *cn, int first);
+static void emit_string(coreDecode *cd, const char *name, const char *value);
+static void decode_node(coreDecode *cd, uint32_t i);
+
+// 64 bit FNV-1a
+uint64_t compiled_hash_bytes(const void *p, size_t n)
+{
+  const unsigned char *s = p;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  while (n--) {
+    h ^= *s++;
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+// the same checks as compiled_read, nothing is trusted beyond the hash
+// least bits one item of a sequence-of takes, the sum of its children
+static int item_bits(coreSchema *cs, coreNode *np)
+{
+  uint32_t child;
+  int bits = 0;
+
+  for (child = np - cs->nodes + 1; child < np->end; child = cs->nodes[child].end) {
+    bits += cs->nodes[child].min_bits;
+  }
+
+  return bits;
+}
+
+static int load_node(coreSchema *cs, const char *strings, uint32_t nstrings, uint32_t *next, uint32_t *nvalues)
+{
+  coreNode *np = NULL;
+  const compiledNode *cn = NULL;
+  uint32_t i, offset;
+
+  if (*next == cs->nnodes) {
+    alert("Compiled schema is missing nodes.");
+    return -1;
+  }
+  np = &cs->nodes[*next];
+  cn = np->cn;
+  (*next)++;
+  if ((cn->type < UNKNOWN_TYPE) || (cn->type > UNIX_TIME_TYPE) ||
+      (cn->variant < UNKNOWN_VARIANT) || (cn->variant > FIXED_LENGTH) ||
+      // the decoder reads at most 32 bits at a time, bitmaps included
+      (cn->bits < 0) || (cn->bits > 32) || (cn->items < 0) ||
+      ((cn->type == SEQUENCE_OPTIONAL_TYPE) && (cn->items > 32)) ||
+      (cn->nchildren > cs->nnodes - *next) || (cn->name >= nstrings)) {
+    alert("Compiled schema has a bad node.");
+    return -1;
+  }
+  np->name = strings + cn->name;
+
+  if ((cn->type == ENUMERATED_TYPE) && (cn->items > 0)) {
+    if ((uint32_t)cn->items > nstrings - *nvalues) {
+      alert("Compiled schema has a bad node.");
+      return -1;
+    }
+    np->enumeration = &cs->values[*nvalues];
+    for (i = 0, offset = cn->enumeration; i < (uint32_t)cn->items; i++) {
+      if (offset >= nstrings) {
+        alert("Compiled schema has a bad string offset.");
+        return -1;
+      }
+      cs->values[(*nvalues)++] = strings + offset;
+      offset += strlen(strings + offset) + 1;
+    }
+  }
+
+  for (i = 0; i < cn->nchildren; i++) {
+    if (load_node(cs, strings, nstrings, next, nvalues) == -1) {
+      return -1;
+    }
+  }
+  np->end = *next;
+  np->min_bits = minimumBits(cn->type, cn->variant, cn->length, cn->items, item_bits(cs, np));
+
+  return 0;
+}
+
+coreSchema *core_schema_load(const char *file)
+{
+  coreSchema *cs = NULL;
+  compiledHeader *header = NULL;
+  const compiledNode *nodes = NULL;
+  const char *strings = NULL;
+  struct stat st;
+  uint32_t i, nstrings, next = 0, nvalues = 0;
+  int fd;
+
+  if ((cs = (coreSchema *)calloc(1, sizeof(coreSchema))) == NULL) {
+    alert("Could not allocate memory.");
+    return NULL;
+  }
+  if ((fd = open(file, O_RDONLY)) == -1) {
+    alert("Could not open file %s.", file);
+    free(cs);
+    return NULL;
+  }
+  if ((fstat(fd, &st) == -1) || (st.st_size < (off_t)sizeof(compiledHeader))) {
+    alert("Compiled schema %s is too small.", file);
+    close(fd);
+    free(cs);
+    return NULL;
+  }
+  cs->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (cs->map == MAP_FAILED) {
+    alert("Could not map file %s.", file);
+    free(cs);
+    return NULL;
+  }
+  cs->size = st.st_size;
+
+  header = cs->map;
+  if (memcmp(header->magic, COMPILED_MAGIC, 4) || (header->bom != COMPILED_BOM) ||
+      (header->version != COMPILED_VERSION) || (header->size != st.st_size)) {
+    alert("%s is not a compiled schema this library can read.", file);
+    core_schema_free(cs);
+    return NULL;
+  }
+  if ((header->nnodes == 0) ||
+      (header->strings != sizeof(compiledHeader) + (uint64_t)header->nnodes * sizeof(compiledNode)) ||
+      (header->strings >= header->size) || (((char *)cs->map)[header->size - 1] != '\0')) {
+    alert("Compiled schema %s is damaged.", file);
+    core_schema_free(cs);
+    return NULL;
+  }
+  if (compiled_hash_bytes((char *)cs->map + sizeof(compiledHeader), header->size - sizeof(compiledHeader)) != header->hash) {
+    alert("Compiled schema %s does not match its hash.", file);
+    core_schema_free(cs);
+    return NULL;
+  }
+  cs->hash = header->hash;
+
+  nodes = (const compiledNode *)((char *)cs->map + sizeof(compiledHeader));
+  strings = (char *)cs->map + header->strings;
+  nstrings = header->size - header->strings;
+  cs->nnodes = header->nnodes;
+  // a well formed file has no more enumeration values than string bytes
+  if (((cs->nodes = (coreNode *)calloc(cs->nnodes, sizeof(coreNode))) == NULL) ||
+      ((cs->values = (const char **)calloc(nstrings, sizeof(char *))) == NULL)) {
+    alert("Could not allocate memory.");
+    core_schema_free(cs);
+    return NULL;
+  }
+  for (i = 0; i < cs->nnodes; i++) {
+    cs->nodes[i].cn = &nodes[i];
+  }
+  if ((load_node(cs, strings, nstrings, &next, &nvalues) == -1) || (next != cs->nnodes)) {
+    alert("Failed to load plan from %s.", file);
+    core_schema_free(cs);
+    return NULL;
+  }
+  dbg("loaded %u nodes", cs->nnodes);
+
+  return cs;
+}
+
+void core_schema_free(coreSchema *cs)
+{
+
+  munmap(cs->map, cs->size);
+  free(cs->nodes);
+  free(cs->values);
+  free(cs);
+
+}
+
+// any string type by its variant, freed with decodeRelease
+static char *decode_string(packedDecode *d, const compiledNode *cn, int type)
+{
+  static char *(*semi_constrained[])(packedDecode *) = {
+    decodeSemiConstrainedString, decodeSemiConstrainedBitString, decodeSemiConstrainedNumericString,
+    decodeSemiConstrainedHexString, decodeSemiConstrainedOctetString };
+  static char *(*constrained[])(packedDecode *, int, int) = {
+    decodeConstrainedString, decodeConstrainedBitString, decodeConstrainedNumericString,
+    decodeConstrainedHexString, decodeConstrainedOctetString };
+  static char *(*fixed_length[])(packedDecode *, int) = {
+    decodeFixedLengthString, decodeFixedLengthBitString, decodeFixedLengthNumericString,
+    decodeFixedLengthHexString, decodeFixedLengthOctetString };
+  int i = type - STRING_TYPE;
+
+  switch (cn->variant) {
+  case SEMI_CONSTRAINED:
+    return semi_constrained[i](d);
+  case CONSTRAINED:
+    return constrained[i](d, cn->lb, cn->ub);
+  case FIXED_LENGTH:
+    return fixed_length[i](d, cn->length);
+  }
+  alert("Found a string variant I can't decode.");
+
+  return NULL;
+}
+
+static void emit_string(coreDecode *cd, const char *name, const char *value)
+{
+
+  if (cd->h->string && value) {
+    cd->h->string(cd->user, name, value, strlen(value));
+  }
+
+}
+
+// the decoder in packedobjects_decode.c without the document
+static void decode_node(coreDecode *cd, uint32_t i)
+{
+  coreNode *np = &cd->cs->nodes[i];
+  const compiledNode *cn = np->cn;
+  const core_handler *h = cd->h;
+  packedDecode *d = cd->decodep;
+  char value[UNIX_TIME_CHARS];
+  char *s = NULL;
+  unsigned long int bitmap, len, k;
+  signed long int n = 0;
+  uint32_t child;
+  int bit;
+
+  dbg("type:%d", cn->type);
+
+  switch (cn->type) {
+  case INTEGER_TYPE:
+    switch (cn->variant) {
+    case UNCONSTRAINED:
+      n = decodeUnconstrainedInteger(d);
+      break;
+    case SEMI_CONSTRAINED:
+      n = decodeUnsignedSemiConstrainedInteger(d, cn->lb);
+      break;
+    case CONSTRAINED:
+      n = decodeConstrainedWholeNumber(d, cn->lb, cn->bits);
+      break;
+    default:
+      alert("Found an integer variant I can't decode.");
+      return;
+    }
+    if (h->integer) {
+      h->integer(cd->user, np->name, n);
+    }
+    break;
+  case STRING_TYPE:
+  case BIT_STRING_TYPE:
+  case NUMERIC_STRING_TYPE:
+  case HEX_STRING_TYPE:
+  case OCTET_STRING_TYPE:
+    s = decode_string(d, cn, cn->type);
+    emit_string(cd, np->name, s);
+    decodeRelease(d, s);
+    break;
+  case DECIMAL_TYPE:
+    s = decodeDecimal(d);
+    emit_string(cd, np->name, s);
+    decodeRelease(d, s);
+    break;
+  case UTF8_STRING_TYPE:
+    s = decodeSemiConstrainedOctetString(d);
+    emit_string(cd, np->name, s);
+    decodeRelease(d, s);
+    break;
+  case SEQUENCE_TYPE:
+    if (h->start_element) h->start_element(cd->user, np->name);
+    for (child = i + 1; child < np->end; child = cd->cs->nodes[child].end) {
+      decode_node(cd, child);
+    }
+    if (h->end_element) h->end_element(cd->user, np->name);
+    break;
+  case SEQUENCE_OF_TYPE:
+    if (cn->unbounded) {
+      len = decodeUnsignedSemiConstrainedInteger(d, cn->lb);
+    } else {
+      len = decodeConstrainedWholeNumber(d, cn->lb, cn->bits);
+    }
+    dbg("sequence_of len:%lu", len);
+    checkItemCount(d, len, item_bits(cd->cs, np));
+    if (h->start_element) h->start_element(cd->user, np->name);
+    for (k = 0; k < len; k++) {
+      for (child = i + 1; child < np->end; child = cd->cs->nodes[child].end) {
+        decode_node(cd, child);
+      }
+    }
+    if (h->end_element) h->end_element(cd->user, np->name);
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    bitmap = decodeBitmap(d, cn->items);
+    if (h->start_element) h->start_element(cd->user, np->name);
+    for (bit = 0, child = i + 1; (bit < cn->items) && (child < np->end); bit++, child = cd->cs->nodes[child].end) {
+      if (CHECK_BIT(bitmap, bit)) {
+        decode_node(cd, child);
+      }
+    }
+    if (h->end_element) h->end_element(cd->user, np->name);
+    break;
+  case NULL_TYPE:
+    // an empty element has no value to report
+    if (h->start_element) h->start_element(cd->user, np->name);
+    if (h->end_element) h->end_element(cd->user, np->name);
+    break;
+  case BOOLEAN_TYPE:
+    n = decodeBoolean(d);
+    if (h->boolean) h->boolean(cd->user, np->name, n);
+    break;
+  case CHOICE_TYPE:
+    n = decodeConstrainedWholeNumber(d, 1, cn->bits);
+    dbg("choice:%ld", n);
+    if (h->start_element) h->start_element(cd->user, np->name);
+    for (child = i + 1; (child < np->end) && (n > 1); child = cd->cs->nodes[child].end) {
+      n--;
+    }
+    if ((n == 1) && (child < np->end)) {
+      decode_node(cd, child);
+    }
+    if (h->end_element) h->end_element(cd->user, np->name);
+    break;
+  case ENUMERATED_TYPE:
+    n = decodeConstrainedWholeNumber(d, 0, cn->bits);
+    if ((n < cn->items) && h->enumerated) {
+      h->enumerated(cd->user, np->name, n, np->enumeration[n]);
+    }
+    break;
+  case CURRENCY_TYPE:
+    k = decodeCurrencyCents(d);
+    if (h->currency) {
+      h->currency(cd->user, np->name, k);
+    } else {
+      emit_string(cd, np->name, currencyString(value, CURRENCY_CHARS, k));
+    }
+    break;
+  case IPV4_ADDRESS_TYPE:
+    k = decodeIPv4AddressValue(d);
+    if (h->ipv4_address) {
+      h->ipv4_address(cd->user, np->name, ntohl(k));
+    } else {
+      emit_string(cd, np->name, ipv4AddressString(value, IPV4_ADDRESS_CHARS, k));
+    }
+    break;
+  case UNIX_TIME_TYPE:
+    n = decodeUnixTimeValue(d);
+    if (h->unix_time) {
+      h->unix_time(cd->user, np->name, n);
+    } else {
+      emit_string(cd, np->name, unixTimeString(value, UNIX_TIME_CHARS, n));
+    }
+    break;
+  default:
+    alert("Found a type I can't decode.");
+  }
+
+}
+
+int core_decode(coreSchema *cs, packedDecode *decodep, char *pdu, int len, const core_handler *h, void *user)
+{
+  coreDecode cd = { cs, decodep, h, user };
+  // modified between setjmp and longjmp
+  volatile int error = 0;
+
+  // exception handler
+  switch (setjmp(decodep->env)) {
+  case DECODE_INVALID_PREFIX:
+    error = DECODE_INVALID_PREFIX;
+    break;
+  case DECODE_PDU_TRUNCATED:
+    error = DECODE_PDU_TRUNCATED;
+    break;
+  case DECODE_DOCUMENT_FAILED:
+    error = DECODE_DOCUMENT_FAILED;
+    break;
+  case 0:
+    resetDecode(decodep, pdu, len);
+    decode_node(&cd, 0);
+  }
+
+  return error;
+}
@@ -0,0 +1,147 @@
+#ifndef CORE_H_
+#define CORE_H_
+
+/*
+ * the parts of the library which do without libxml2: the error codes, the
+ * compiled schema file and an interpreter which decodes straight from it
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "ier.h"
+
+// types and variants found in the canonical schema
+enum NODE_TYPES {
+  UNKNOWN_TYPE = 0,
+  INTEGER_TYPE,
+  STRING_TYPE,
+  BIT_STRING_TYPE,
+  NUMERIC_STRING_TYPE,
+  HEX_STRING_TYPE,
+  OCTET_STRING_TYPE,
+  SEQUENCE_TYPE,
+  SEQUENCE_OF_TYPE,
+  SEQUENCE_OPTIONAL_TYPE,
+  NULL_TYPE,
+  BOOLEAN_TYPE,
+  CHOICE_TYPE,
+  ENUMERATED_TYPE,
+  CURRENCY_TYPE,
+  DECIMAL_TYPE,
+  IPV4_ADDRESS_TYPE,
+  UTF8_STRING_TYPE,
+  UNIX_TIME_TYPE,
+};
+
+enum NODE_VARIANTS {
+  UNKNOWN_VARIANT = 0,
+  UNCONSTRAINED,
+  SEMI_CONSTRAINED,
+  CONSTRAINED,
+  FIXED_LENGTH,
+};
+
+enum ERROR_CODES {
+  INIT_FAILED = 100,
+  INIT_SCHEMA_SETUP_FAILED,
+  INIT_ENCODE_SETUP_FAILED,
+  INIT_SCHEMA_VALIDATION_FAILED,
+  INIT_SETUP_VALIDATION_FAILED,
+  INIT_EXPANDED_SCHEMA_FAILED,
+  INIT_CANON_SCHEMA_FAILED,
+  // retired, nothing sets it but the codes after it keep their numbers
+  INIT_XPATH_SETUP_FAILED,
+  ENCODE_VALIDATION_FAILED,
+  ENCODE_PDU_BUFFER_FULL,
+  ENCODE_XPATH_QUERY_FAILED,
+  DECODE_VALIDATION_FAILED,
+  DECODE_INVALID_PREFIX,
+  INIT_PLAN_FAILED,
+  DECODE_PDU_TRUNCATED,
+  INIT_DECODE_SETUP_FAILED,
+  ENCODE_PARSE_FAILED,
+  DECODE_TEXT_BUFFER_FULL,
+  DECODE_DOCUMENT_FAILED,
+  INIT_COMPILED_SCHEMA_FAILED,
+};
+
+#define COMPILED_MAGIC "POSC"
+#define COMPILED_VERSION 1
+// tells a file written on a machine of the other byte order
+#define COMPILED_BOM 0x01020304
+
+/*
+ * a compiled schema file is this header, the plan's nodes in depth first
+ * order and then a table of nul terminated strings which the nodes refer
+ * to by offset. hash covers everything after the header
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t bom;
+  uint32_t nnodes;
+  uint32_t strings;
+  uint32_t size;
+  uint64_t hash;
+} compiledHeader;
+
+typedef struct {
+  uint32_t name;
+  uint32_t nchildren;
+  int32_t type;
+  int32_t variant;
+  int64_t lb;
+  int64_t ub;
+  int32_t length;
+  int32_t items;
+  int32_t bits;
+  int32_t unbounded;
+  int32_t has_max;
+  // offset of the first of items strings, one after another
+  uint32_t enumeration;
+} compiledNode;
+
+// a node of the mapped file with its strings looked up
+typedef struct {
+  const compiledNode *cn;
+  const char *name;
+  const char **enumeration;
+  // the node after everything below this one
+  uint32_t end;
+  // least bits the node can encode to, bounding sequence-of counts
+  int min_bits;
+} coreNode;
+
+typedef struct {
+  void *map;
+  size_t size;
+  coreNode *nodes;
+  uint32_t nnodes;
+  const char **values;
+  uint64_t hash;
+} coreSchema;
+
+// the same as po_handler but with plain char names
+typedef struct {
+  void (*start_element)(void *user, const char *name);
+  void (*end_element)(void *user, const char *name);
+  void (*integer)(void *user, const char *name, int64_t value);
+  // value is only valid during the call
+  void (*string)(void *user, const char *name, const char *value, size_t len);
+  void (*boolean)(void *user, const char *name, int value);
+  void (*enumerated)(void *user, const char *name, int index, const char *value);
+  // go to string as text when left out, the address is in host byte order
+  void (*currency)(void *user, const char *name, int64_t cents);
+  void (*ipv4_address)(void *user, const char *name, uint32_t address);
+  void (*unix_time)(void *user, const char *name, time_t t);
+} core_handler;
+
+uint64_t compiled_hash_bytes(const void *p, size_t n);
+// load a file written by packedobjects_write_compiled, NULL if it is unusable
+coreSchema *core_schema_load(const char *file);
+void core_schema_free(coreSchema *cs);
+// decode with one decoder per thread, returns 0 or the decode error
+int core_decode(coreSchema *cs, packedDecode *decodep, char *pdu, int len, const core_handler *h, void *user);
+
+#endif
@@ -3,8 +3,12 @@
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <setjmp.h>
 
 #include "config.h"
+// include for error codes
+#include "core.h"
 #include "decode.h"
 
 #ifdef DEBUG_MODE
@@ -24,68 +28,153 @@
 /* defined in encode.c */
 extern unsigned mask32[];
 
-static unsigned long int getn(packedDecode *memBuf, int bitlen, int lb);
+static unsigned long int refill(packedDecode *memBuf, int bitlen);
 
 
-packedDecode *initializeDecode(char * pdu) {
+/* size is the length of the pdu in bytes */
+packedDecode *initializeDecode(char * pdu, int size) {
   packedDecode *memBuf;
   
   if ((memBuf = (packedDecode *)malloc(sizeof(packedDecode))) == NULL) {
     alert("Failed to allocate memory during initialisation.");
     return NULL;
   }
-  memBuf->ub = WORD_32BIT;
+  memBuf->arena = 0;
+  memBuf->blocks = NULL;
+  memBuf->strings = 0;
+  memBuf->mallocs = 0;
+  resetDecode(memBuf, pdu, size);
+  return memBuf;
+}
+
+/* start reading a new pdu of size bytes */
+void resetDecode(packedDecode *memBuf, char *pdu, int size) {
+  arenaBlock *block;
+  
   memBuf->word = 0;
+  memBuf->cache = 0;
+  memBuf->cacheBits = 0;
   memBuf->pdu = pdu;
-  return memBuf;
+  memBuf->size = size;
+  /* keep only the newest and largest block for the next pdu */
+  if (memBuf->blocks) {
+    while ((block = memBuf->blocks->next) != NULL) {
+      memBuf->blocks->next = block->next;
+      free(block);
+    }
+  }
+  memBuf->arenaUsed = 0;
 }
 
 void freeDecode(packedDecode *memBuf) {
+  arenaBlock *block;
+  
   //free(memBuf->pdu);
+  while ((block = memBuf->blocks) != NULL) {
+    memBuf->blocks = block->next;
+    free(block);
+  }
   free(memBuf);
 }
 
+/* 
+ * room for a decoded string. without the arena every string is a
+ * malloc the caller must release. with it strings are carved from a
+ * block, and once the block has grown to fit a whole pdu no more
+ * mallocs are made
+ */
+char *decodeAlloc(packedDecode *memBuf, int bytes) {
+  arenaBlock *block = memBuf->blocks;
+  char *s;
+  int size;
+  
+  /* a size from a hostile pdu may have wrapped */
+  if (bytes <= 0) {
+    alert("refused to allocate %d bytes.", bytes);
+    return NULL;
+  }
+  memBuf->strings++;
+  if (!memBuf->arena) {
+    memBuf->mallocs++;
+    return malloc(bytes);
+  }
+  if ((block == NULL) || (bytes > block->size - memBuf->arenaUsed)) {
+    size = (block) ? block->size : ARENA_BYTES / 2;
+    do {
+      if (size > INT_MAX / 2) {
+        alert("refused to allocate %d bytes.", bytes);
+        return NULL;
+      }
+      size = size * 2;
+    } while (size < bytes);
+    if ((block = malloc(sizeof(arenaBlock) + size)) == NULL) {
+      return NULL;
+    }
+    memBuf->mallocs++;
+    block->size = size;
+    block->next = memBuf->blocks;
+    memBuf->blocks = block;
+    memBuf->arenaUsed = 0;
+  }
+  s = (char *)(block + 1) + memBuf->arenaUsed;
+  memBuf->arenaUsed += bytes;
+  
+  return s;
+}
+
+/* give back a string from decodeAlloc */
+void decodeRelease(packedDecode *memBuf, void *s) {
+  if (!memBuf->arena) {
+    free(s);
+  }
+}
 
-static unsigned long int getn(packedDecode *memBuf, int bitlen, int lb) {
-  unsigned long int n;
-  int offset;
+
+/* 
+ * append the next big endian word of the pdu below the unread bits, or
+ * whatever is left of it at the end of the buffer, then take the field.
+ * kept out of line so the common case in decode() needs no stack frame
+ */
+__attribute__((noinline))
+static unsigned long int refill(packedDecode *memBuf, int bitlen) {
+  uint32_t n = 0;
+  int offset, bytes;
   
   offset = ((memBuf->word) * WORD_BYTE);
-  memcpy(&n, (memBuf->pdu)+offset, WORD_BYTE);
-  /* get it back to lil endian */
-  n = ntohl(n);
-  n = n >> lb;
-  return (n & mask32[bitlen]);
+  bytes = memBuf->size - offset;
+  if (bytes >= WORD_BYTE) {
+    memcpy(&n, (memBuf->pdu)+offset, WORD_BYTE);
+    memBuf->cache = (memBuf->cache << WORD_32BIT) | ntohl(n);
+    memBuf->cacheBits += WORD_32BIT;
+    memBuf->word++;
+  } else {
+    if (bytes > 0) {
+      memcpy(&n, (memBuf->pdu)+offset, bytes);
+      n = ntohl(n) >> ((WORD_BYTE - bytes) * CHAR_BIT);
+      memBuf->cache = (memBuf->cache << (bytes * CHAR_BIT)) | n;
+      memBuf->cacheBits += bytes * CHAR_BIT;
+      memBuf->word++;
+    }
+    if (memBuf->cacheBits < bitlen) {
+      alert("decoder ran past the end of the PDU.");
+      longjmp(memBuf->env, DECODE_PDU_TRUNCATED);
+    }
+  }
+  memBuf->cacheBits -= bitlen;
+  
+  return ((memBuf->cache >> memBuf->cacheBits) & mask32[bitlen]);
 }
 
+/* 
+ * unread bits sit at the bottom of a 64 bit cache so a field is a
+ * shift and mask whether or not it crosses a word boundary
+ */
 unsigned long int decode(packedDecode *memBuf, int bitlen) {
-  unsigned long int n;
-  int lb;
   
-  lb = memBuf->ub - bitlen;
-  
-  if (lb > 0) {
-    /* our value exists within the current word...kewl! */
-    n = getn(memBuf, bitlen, lb);
-    memBuf->ub = lb;
-  } else if (lb == 0) {
-    /* once we get this we hit the boundary so incr word count */
-    n = getn(memBuf, bitlen, lb);
-    memBuf->ub = WORD_32BIT;
-    memBuf->word++;
-  } else {
-    /* our value crossed a boundary lb < 0 */
-    unsigned long int n1, n2;
-    int lhs, rhs;
-    lhs = lb + bitlen;
-    n1 = getn(memBuf, lhs, 0);
-    rhs = bitlen - lhs;
-    memBuf->ub = WORD_32BIT;
-    memBuf->word++;
-    lb = WORD_32BIT - rhs;
-    n2 = getn(memBuf, rhs, lb);
-    n = ((n1 << rhs) | n2);
-    memBuf->ub = lb;
+  if (memBuf->cacheBits < bitlen) {
+    return refill(memBuf, bitlen);
   }
-  return n;
+  memBuf->cacheBits -= bitlen;
+  
+  return ((memBuf->cache >> memBuf->cacheBits) & mask32[bitlen]);
 }
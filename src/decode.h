@@ -1,18 +1,41 @@
 #ifndef DECODE_H_
 #define DECODE_H_
 
+#include <stdint.h>
+#include <setjmp.h>
+
 #define WORD_32BIT 32
 #define WORD_BYTE 4
 
+/* first block size of the optional string arena */
+#define ARENA_BYTES 1024
+
+/* a block of arena memory, the strings follow the header */
+typedef struct arenaBlock {
+  struct arenaBlock *next;
+  int size;
+} arenaBlock;
+
 typedef struct {
   char *pdu;
-  int ub;
+  int size;
   int word;
+  uint64_t cache;
+  int cacheBits;
+  jmp_buf env; /* where errors are thrown during a decode */
+  int arena; /* strings come from the arena and live until the next pdu */
+  arenaBlock *blocks; /* newest first and only the newest has room */
+  int arenaUsed;
+  unsigned long strings; /* strings handed out so far */
+  unsigned long mallocs; /* calls to malloc made for them */
 } packedDecode;
 
 
-packedDecode *initializeDecode(char * pdu);
+packedDecode *initializeDecode(char * pdu, int size);
+void resetDecode(packedDecode *memBuf, char *pdu, int size);
 void freeDecode(packedDecode *memBuf);
+char *decodeAlloc(packedDecode *memBuf, int bytes);
+void decodeRelease(packedDecode *memBuf, void *s);
 unsigned long int decode(packedDecode *memBuf, int bitlen);
 
 #endif
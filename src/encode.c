@@ -6,8 +6,9 @@
 #include <limits.h>
 #include <setjmp.h>
 
+#include "config.h"
 // include for error codes
-#include "packedobjects.h"
+#include "core.h"
 #include "encode.h"
 
 #ifdef DEBUG_MODE
@@ -24,9 +25,6 @@
   (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
 #endif
 
-// defined in packedobject.c
-extern jmp_buf encode_exception_env;
-
 unsigned mask32[] = {
   0,					
   ~(~0<<1),					
@@ -64,10 +62,8 @@ unsigned mask32[] = {
 };
 
 
-static void addBuf(packedEncode *memBuf, unsigned long int n);
-static void addWord(packedEncode *memBuf, unsigned long int n);
-static unsigned long int orBuf(packedEncode *memBuf);
-static void resetBuf(packedEncode *memBuf);
+static void addWord(packedEncode *memBuf, uint32_t n);
+static int fullPDU(packedEncode *memBuf, int bytes);
 
 
 void dumpBuffer(char *bufName, char *buf, int amount) {
@@ -84,15 +80,12 @@ packedEncode *initializeEncode(char *pdu, int size) {
     alert("Failed to allocate memory during initialisation.");
     return NULL;
   }
-  if ((memBuf->buf = calloc(WORD_32BIT, WORD_BYTE)) == NULL) {
-    alert("Failed to allocate memory during initialisation.");
-    return NULL;    
-  }
   memBuf->pdu = pdu;
-  memBuf->bufWords = 0;
   memBuf->size = size; /* in bytes */
+  memBuf->growable = 0;
+  memBuf->pduBytes = 0;
+  memBuf->acc = 0;
   memBuf->bitsUsed = 0;
-  memBuf->pduWords = 0;
   
   return memBuf;
 }
@@ -102,111 +95,116 @@ char *pduEncode(packedEncode *memBuf) {
 }
 
 int finalizeEncode(packedEncode *memBuf) {
-  int totalbytes, bufused; 
-  
-  bufused = 0;
+  int totalbytes;
   
-  /* add any leftover */
+  /* add any leftover using only the bytes it needs */
   if (memBuf->bitsUsed > 0) {
-    unsigned long int word;
-    int buffree;
-    word = orBuf(memBuf);
-    addWord(memBuf, word);
-    buffree = (WORD_32BIT - memBuf->bitsUsed) / CHAR_BIT;
-    bufused = WORD_BYTE - buffree;
-    memBuf->pduWords--;
+    uint32_t word;
+    int bytes;
+    word = htonl((uint32_t)(memBuf->acc << (WORD_32BIT - memBuf->bitsUsed)));
+    bytes = (memBuf->bitsUsed + CHAR_BIT - 1) / CHAR_BIT;
+    if ((memBuf->pduBytes + bytes <= memBuf->size) || fullPDU(memBuf, bytes)) {
+      memcpy((memBuf->pdu)+memBuf->pduBytes, &word, bytes);
+    }
+    memBuf->pduBytes += bytes;
   }
-  totalbytes = (memBuf->pduWords * WORD_BYTE) + bufused;
+  totalbytes = memBuf->pduBytes;
 
-  // reset some values
-  memBuf->bufWords = 0;
-  memBuf->bitsUsed = 0;
-  memBuf->pduWords = 0;
+  resetEncode(memBuf);
   
   return totalbytes;
 }
 
+/* discard anything left over from an abandoned encode */
+void resetEncode(packedEncode *memBuf) {
+  memBuf->pduBytes = 0;
+  memBuf->acc = 0;
+  memBuf->bitsUsed = 0;
+}
+
+/* 
+ * append every bit written to from so far, then empty it. only full
+ * words reach from's pdu so it is copied a word at a time
+ */
+void appendEncode(packedEncode *memBuf, packedEncode *from) {
+  uint32_t word;
+  int i;
+  
+  for (i = 0; i < from->pduBytes; i += WORD_BYTE) {
+    memcpy(&word, (from->pdu)+i, WORD_BYTE);
+    encode(memBuf, ntohl(word), WORD_32BIT);
+  }
+  if (from->bitsUsed > 0) {
+    encode(memBuf, (unsigned long int)from->acc, from->bitsUsed);
+  }
+  resetEncode(from);
+}
+
 void freeEncode(packedEncode *memBuf) {
   //free(memBuf->pdu);  
-  free(memBuf->buf);  
   free(memBuf);   
 }
 
 
-static void addBuf(packedEncode *memBuf, unsigned long int n) {
-  unsigned long int word;
-  int offset;
-  
-  /* make sure is big endian */
-  word = htonl(n << (WORD_32BIT - memBuf->bitsUsed));
+/* 
+ * make room for another bytes in the pdu. a growable pdu is enlarged in
+ * place. a fixed pdu is left alone and the encode carries on counting
+ * bytes without storing them, so finalizeEncode reports the size that
+ * was needed. returns 1 if the bytes can be stored.
+ * kept out of line so the word writer stays small
+ */
+__attribute__((noinline))
+static int fullPDU(packedEncode *memBuf, int bytes) {
+  char *pdu;
+  int size;
   
-  offset = ((memBuf->bufWords) * WORD_BYTE);
-  memcpy((memBuf->buf)+offset, &word, WORD_BYTE);
-  memBuf->bufWords++;
-}
-
-/* copy word across to the pdu */
-static void addWord(packedEncode *memBuf, unsigned long int n) {
-  int bytes;
-  
-  bytes = ((memBuf->pduWords) * WORD_BYTE);
-  if (bytes+WORD_BYTE > memBuf->size) {
+  if (!memBuf->growable) {
+    return 0;
+  }
+  size = memBuf->size * 2;
+  if (size < memBuf->pduBytes + bytes) size = memBuf->pduBytes + bytes;
+  if ((pdu = realloc(memBuf->pdu, size)) == NULL) {
     alert("encoder ran out of memory trying to copy to PDU.");
-    longjmp(encode_exception_env, ENCODE_PDU_BUFFER_FULL);
+    longjmp(memBuf->env, ENCODE_PDU_BUFFER_FULL);
   }
-  /* copy a word at pdu offset by bytes */
-  memcpy((memBuf->pdu)+bytes, &n, WORD_BYTE);
-  memBuf->pduWords++;
+  dbg("grew pdu from %d to %d bytes", memBuf->size, size);
+  memBuf->pdu = pdu;
+  memBuf->size = size;
+  
+  return 1;
 }
 
-static unsigned long int orBuf(packedEncode *memBuf) {
-  unsigned long int result;
-  unsigned long int *n;
-  int i;
+/* copy a full word across to the pdu in big endian order */
+static void addWord(packedEncode *memBuf, uint32_t n) {
   
-  result = 0;
-  
-  for (i = 0 ; i < memBuf->bufWords ; i++) {
-    n = (unsigned long int *)(memBuf->buf + (i * WORD_BYTE));
-    result = (result | *n);
+  if ((memBuf->pduBytes+WORD_BYTE <= memBuf->size) || fullPDU(memBuf, WORD_BYTE)) {
+    n = htonl(n);
+    memcpy((memBuf->pdu)+memBuf->pduBytes, &n, WORD_BYTE);
   }
-  return result;
-}
-
-static void resetBuf(packedEncode *memBuf) {
-  memset(memBuf->buf, 0, ((memBuf->bufWords) * WORD_BYTE));
-  memBuf->bufWords = 0;
-  memBuf->bitsUsed = 0;
+  memBuf->pduBytes += WORD_BYTE;
 }
 
+/* 
+ * values are shifted into the bottom of a 64 bit accumulator and the
+ * top 32 bits are written out as soon as they are complete, giving the
+ * same msb first layout as packing each word separately
+ */
 void encode(packedEncode *memBuf, unsigned long int n, int bitlength) {
-  //int bytes;
-  unsigned long int word;
   
-  //bytes = (memBuf->pduWords * WORD_BYTE);
-    
+  if (bitlength > WORD_32BIT) {
+    /* split wide values such as large bitmaps */
+    encode(memBuf, n >> WORD_32BIT, bitlength - WORD_32BIT);
+    encode(memBuf, n, WORD_32BIT);
+    return;
+  }
+  
+  memBuf->acc = (memBuf->acc << bitlength) | (n & mask32[bitlength]);
   memBuf->bitsUsed = memBuf->bitsUsed + bitlength;
   
-  if (memBuf->bitsUsed == WORD_32BIT) { /* lucky fit */
-    addBuf(memBuf, n);
-    word = orBuf(memBuf);
-    addWord(memBuf, word);
-    resetBuf(memBuf);
-  } else if (memBuf->bitsUsed < WORD_32BIT) { /* some room */
-    addBuf(memBuf, n);
-  } else { /* exceeded space available, ie. memBuf->bitsUsed > WORD_32BIT */
-    int tail;
-    tail = (memBuf->bitsUsed - WORD_32BIT);		
-    /* set the word to be full */
-    memBuf->bitsUsed = WORD_32BIT;
-    /* remove the tail so we just add the head into the gap */
-    addBuf(memBuf, (n >> tail));
-    word = orBuf(memBuf);
-    addWord(memBuf, word);
-    resetBuf(memBuf);
-    /* encode the leftover tail */
-    memBuf->bitsUsed = tail;
-    addBuf(memBuf, (n & mask32[tail]));
-  }	
+  if (memBuf->bitsUsed >= WORD_32BIT) {
+    memBuf->bitsUsed = memBuf->bitsUsed - WORD_32BIT;
+    /* anything above the top 32 bits was flushed previously */
+    addWord(memBuf, (uint32_t)(memBuf->acc >> memBuf->bitsUsed));
+  }
 }
 
@@ -1,22 +1,28 @@
 #ifndef ENCODE_H_
 #define ENCODE_H_
 
+#include <stdint.h>
+#include <setjmp.h>
+
 #define WORD_32BIT 32
 #define WORD_BYTE 4
 
 
 typedef struct {
-  char *buf;
   char *pdu;
-  int bufWords;
   int size;
-  int pduWords;
+  int growable; /* pdu was malloc'd and may be realloc'd when full */
+  int pduBytes;
+  uint64_t acc;
   int bitsUsed;
+  jmp_buf env; /* where errors are thrown during an encode */
 } packedEncode;
 
 
 packedEncode *initializeEncode(char *pdu, int size);
 int finalizeEncode(packedEncode *memBuf);
+void resetEncode(packedEncode *memBuf);
+void appendEncode(packedEncode *memBuf, packedEncode *from);
 char *pduEncode(packedEncode *memBuf);
 void freeEncode(packedEncode *memBuf);
 void encode(packedEncode *memBuf, unsigned long int n, int bitlength);
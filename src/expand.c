@@ -14,7 +14,7 @@
   (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
 #endif
 
-static void expand_user_defined_types_worker(packedobjectsContext *pc, xmlNode *node1, xmlNode *node2);
+static void expand_user_defined_types_worker(packedobjectsSchema *ps, xmlNode *node1, xmlNode *node2);
 
 char *simple_types[] =
   { "integer",
@@ -48,12 +48,12 @@ static int is_simple_type(const xmlChar *type)
 
 }
 
-static xmlDoc *expand_user_defined_types(packedobjectsContext *pc)
+static xmlDoc *expand_user_defined_types(packedobjectsSchema *ps)
 {
   xmlDoc *expanded_doc = NULL;
   xmlNodePtr root_node = NULL, expanded_root_node = NULL;
   xmlChar *element_name = NULL;
-  xmlDoc *doc = pc->doc_schema;
+  xmlDoc *doc = ps->doc_schema;
   
   dbg("expanding user defined types in XML schema:");
   root_node = xmlDocGetRootElement(doc);
@@ -67,7 +67,7 @@ static xmlDoc *expand_user_defined_types(packedobjectsContext *pc)
   while (1) {
     if ((!xmlStrcmp(root_node->name, (const xmlChar *)"element"))) {
       element_name = xmlGetProp(root_node, (const xmlChar *)"name");      
-      if ((!xmlStrcmp(element_name, pc->start_element_name))) {
+      if ((!xmlStrcmp(element_name, ps->start_element_name))) {
         xmlFree(element_name);
         break;
       }
@@ -77,13 +77,13 @@ static xmlDoc *expand_user_defined_types(packedobjectsContext *pc)
   }
 
   
-  expand_user_defined_types_worker(pc, root_node, expanded_root_node);
+  expand_user_defined_types_worker(ps, root_node, expanded_root_node);
   
   return expanded_doc;
   
 }
 
-static void expand_user_defined_types_worker(packedobjectsContext *pc, xmlNode *node1, xmlNode *node2)
+static void expand_user_defined_types_worker(packedobjectsSchema *ps, xmlNode *node1, xmlNode *node2)
 {
   xmlNode *cur_node = NULL;
   xmlChar *element_name = NULL;
@@ -96,26 +96,26 @@ static void expand_user_defined_types_worker(packedobjectsContext *pc, xmlNode *
       element_name = xmlGetProp(cur_node, (const xmlChar *)"type");
       // if a udt
       if ( (element_name) && (!is_simple_type(element_name)) ) {
-        udt_node = xmlHashLookup(pc->udt, element_name);
+        udt_node = xmlHashLookup(ps->udt, element_name);
         xmlFree(element_name);
         np = xmlAddChild(node2, xmlCopyNode(cur_node, 2));
         np = xmlAddChild(np, xmlCopyNode(udt_node, 2));
-        expand_user_defined_types_worker(pc, udt_node->children, np);
+        expand_user_defined_types_worker(ps, udt_node->children, np);
       } else {
         xmlFree(element_name);
         np = xmlAddChild(node2, xmlCopyNode(cur_node, 2));
-        expand_user_defined_types_worker(pc, cur_node->children, np);
+        expand_user_defined_types_worker(ps, cur_node->children, np);
       }
     }
   }
 }
 
-static void hash_user_defined_types(packedobjectsContext *pc)
+static void hash_user_defined_types(packedobjectsSchema *ps)
 {
 
   xmlNodePtr schema_node = NULL;
   xmlNodePtr cur_node = NULL;
-  xmlDoc *doc = pc->doc_schema;
+  xmlDoc *doc = ps->doc_schema;
   xmlChar *element_name = NULL;
 
   // first node <xs:schema>
@@ -125,7 +125,7 @@ static void hash_user_defined_types(packedobjectsContext *pc)
   while (cur_node != NULL) {
     if ((!xmlStrcmp(cur_node->name, (const xmlChar *)"element"))) {
       element_name = xmlGetProp(cur_node, (const xmlChar *)"name");      
-      if ((!xmlStrcmp(element_name, pc->start_element_name))) {
+      if ((!xmlStrcmp(element_name, ps->start_element_name))) {
         dbg("ignoring start element");
       }
       xmlFree(element_name);
@@ -135,7 +135,7 @@ static void hash_user_defined_types(packedobjectsContext *pc)
       // we add the rest as user defined types 
       element_name = xmlGetProp(cur_node, (const xmlChar *)"name");
       dbg("adding %s to udt hash table", element_name);
-      xmlHashAddEntry(pc->udt, element_name, cur_node);
+      xmlHashAddEntry(ps->udt, element_name, cur_node);
       xmlFree(element_name);
     }
     cur_node = cur_node->next;
@@ -143,7 +143,7 @@ static void hash_user_defined_types(packedobjectsContext *pc)
 
 }
 
-static int create_user_defined_types(packedobjectsContext *pc)
+static int create_user_defined_types(packedobjectsSchema *ps)
 {
   xmlHashTablePtr udt = NULL;
   
@@ -152,8 +152,8 @@ static int create_user_defined_types(packedobjectsContext *pc)
     alert("Failed to create hash table.");
     return -1;
   }
-  pc->udt = udt;
-  hash_user_defined_types(pc);  
+  ps->udt = udt;
+  hash_user_defined_types(ps);  
 
   return 0;
   
@@ -178,13 +178,13 @@ static xmlChar *get_start_element(xmlDocPtr doc)
   return element_name;
 }
 
-static int set_start_element(packedobjectsContext *pc)
+static int set_start_element(packedobjectsSchema *ps)
 {
   xmlChar *start_element_name = NULL;
   
   // set start element in schema
-  if ((start_element_name = get_start_element(pc->doc_schema))) { 
-    pc->start_element_name = start_element_name;
+  if ((start_element_name = get_start_element(ps->doc_schema))) { 
+    ps->start_element_name = start_element_name;
     return 0;
   } else {
     alert("Failed to find start element in schema.");
@@ -192,36 +192,36 @@ static int set_start_element(packedobjectsContext *pc)
   }
 }
 
-int expand_make_expanded_schema(packedobjectsContext *pc)
+int expand_make_expanded_schema(packedobjectsSchema *ps)
 {
   xmlDoc *doc_expanded_schema = NULL;
 
   // set start element in schema
-  if (set_start_element(pc) == -1) {
+  if (set_start_element(ps) == -1) {
     return -1;
   }
   
   // record any user define types
-  if (create_user_defined_types(pc) == -1) {
+  if (create_user_defined_types(ps) == -1) {
     return -1;
   }
   
   // create expanded schema without user defined types
-  doc_expanded_schema = expand_user_defined_types(pc);
+  doc_expanded_schema = expand_user_defined_types(ps);
 #ifdef DEBUG_MODE
   packedobjects_dump_doc_to_file("/tmp/expand.xml", doc_expanded_schema);
 #endif
-  pc->doc_expanded_schema = doc_expanded_schema;  
+  ps->doc_expanded_schema = doc_expanded_schema;  
 
   return 0;
   
 }
 
-void expand_free(packedobjectsContext *pc)
+void expand_free(packedobjectsSchema *ps)
 {
-  xmlFree(BAD_CAST pc->start_element_name);
-  xmlFreeDoc(pc->doc_expanded_schema);
+  xmlFree(BAD_CAST ps->start_element_name);
+  xmlFreeDoc(ps->doc_expanded_schema);
   // contents in hash table should be freed already
-  xmlHashFree(pc->udt, NULL);
+  xmlHashFree(ps->udt, NULL);
   
 }
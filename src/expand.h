@@ -3,7 +3,7 @@
 
 #include "packedobjects.h"
 
-int expand_make_expanded_schema(packedobjectsContext *pc);
-void expand_free(packedobjectsContext *pc);
+int expand_make_expanded_schema(packedobjectsSchema *ps);
+void expand_free(packedobjectsSchema *ps);
 
 #endif
@@ -0,0 +1,395 @@
+#include "facets.h"
+
+#ifdef DEBUG_MODE
+#define dbg(fmtstr, args...) \
+  (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#else
+#define dbg(dummy...)
+#endif
+
+#ifdef QUIET_MODE
+#define alert(dummy...)
+#else
+#define alert(fmtstr, args...) \
+  (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#endif
+
+// the lexical space of xs:int
+#define INT_LB -2147483648L
+#define INT_UB 2147483647L
+
+static int is_space(xmlChar c);
+static int is_digits(const xmlChar *s, int n);
+static void trim(const xmlChar **s, int *n);
+static int check_integer(planNode *plan, const xmlChar *s, int n);
+static int check_decimal(const xmlChar *s, int n);
+static int check_currency(const xmlChar *s, int n);
+static int check_ipv4_address(const xmlChar *s);
+static int check_unix_time(const xmlChar *s, int n);
+static int check_enumerated(planNode *plan, const xmlChar *s, int n);
+static int check_charset(planNode *plan, const xmlChar *s);
+static int check_length(planNode *plan, const xmlChar *s);
+static long days_from_civil(long y, int m, int d);
+
+static int is_space(xmlChar c)
+{
+  return ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'));
+}
+
+static int is_digits(const xmlChar *s, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if ((s[i] < '0') || (s[i] > '9')) return 0;
+  }
+
+  return 1;
+}
+
+// types based on xs:int, xs:decimal and the like collapse their whitespace
+static void trim(const xmlChar **s, int *n)
+{
+  while ((*n > 0) && is_space(**s)) {
+    (*s)++;
+    (*n)--;
+  }
+  while ((*n > 0) && is_space((*s)[*n - 1])) {
+    (*n)--;
+  }
+}
+
+static int check_integer(planNode *plan, const xmlChar *s, int n)
+{
+  signed long int value = 0;
+  int i = 0, sign = 1;
+
+  if ((n > 0) && ((s[0] == '+') || (s[0] == '-'))) {
+    if (s[0] == '-') sign = -1;
+    i++;
+  }
+  if ((i == n) || !is_digits(s + i, n - i)) {
+    return -1;
+  }
+  for (; i < n; i++) {
+    value = value * 10 + (s[i] - '0');
+    // stop before a long long string of digits can overflow
+    if (value > INT_UB + 1) return -1;
+  }
+
+  return facets_check_integer(plan, sign * value);
+}
+
+int facets_check_integer(planNode *plan, signed long int n)
+{
+
+  if ((n < INT_LB) || (n > INT_UB)) {
+    return -1;
+  }
+  if (((plan->variant == SEMI_CONSTRAINED) || (plan->variant == CONSTRAINED)) && (n < plan->lb)) {
+    return -1;
+  }
+  // an integer with only a maximum is still encoded as unconstrained
+  if (((plan->variant == CONSTRAINED) || plan->has_max) && (n > plan->ub)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+// optional sign then digits with at most one point somewhere among them
+static int check_decimal(const xmlChar *s, int n)
+{
+  int i = 0, digits = 0, points = 0;
+
+  if ((n > 0) && ((s[0] == '+') || (s[0] == '-'))) {
+    i++;
+  }
+  for (; i < n; i++) {
+    if (s[i] == '.') {
+      points++;
+    } else if ((s[i] >= '0') && (s[i] <= '9')) {
+      digits++;
+    } else {
+      return -1;
+    }
+  }
+
+  return ((digits > 0) && (points <= 1)) ? 0 : -1;
+}
+
+// \d{1,7}.\d{2} on top of xs:decimal
+static int check_currency(const xmlChar *s, int n)
+{
+
+  if ((n < 4) || (n > 10)) {
+    return -1;
+  }
+  if (!is_digits(s, n - 3) || !is_digits(s + n - 2, 2)) {
+    return -1;
+  }
+
+  return check_decimal(s, n);
+}
+
+// dotted quad without leading zeros and a first part of 1 to 223
+static int check_ipv4_address(const xmlChar *s)
+{
+  int part, value, digits;
+
+  for (part = 0; part < 4; part++) {
+    if ((part > 0) && (*s++ != '.')) {
+      return -1;
+    }
+    value = 0;
+    for (digits = 0; (s[digits] >= '0') && (s[digits] <= '9'); digits++) {
+      value = value * 10 + (s[digits] - '0');
+    }
+    if ((digits == 0) || (digits > 3) || ((digits > 1) && (s[0] == '0'))) {
+      return -1;
+    }
+    if ((value > 255) || ((part == 0) && ((value == 0) || (value > 223)))) {
+      return -1;
+    }
+    s += digits;
+  }
+
+  return (*s == '\0') ? 0 : -1;
+}
+
+static long days_from_civil(long y, int m, int d)
+{
+  long era, yoe, doy, doe;
+
+  y -= (m <= 2);
+  era = (y >= 0 ? y : y - 399) / 400;
+  yoe = y - era * 400;
+  doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + doe - 719468;
+}
+
+// YYYY-MM-DDThh:mm:ss with Z or an offset, within a signed 32 bit time_t
+static int check_unix_time(const xmlChar *s, int n)
+{
+  static const int mdays[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  long y, t;
+  int m, d, hh, mm, ss, oh, om, offset = 0, leap;
+
+  if ((n != 20) && (n != 25)) {
+    return -1;
+  }
+  if (!is_digits(s, 4) || (s[4] != '-') || !is_digits(s + 5, 2) || (s[7] != '-') ||
+      !is_digits(s + 8, 2) || (s[10] != 'T') || !is_digits(s + 11, 2) || (s[13] != ':') ||
+      !is_digits(s + 14, 2) || (s[16] != ':') || !is_digits(s + 17, 2)) {
+    return -1;
+  }
+  y = atoi((const char *) s);
+  m = (s[5] - '0') * 10 + (s[6] - '0');
+  d = (s[8] - '0') * 10 + (s[9] - '0');
+  hh = (s[11] - '0') * 10 + (s[12] - '0');
+  mm = (s[14] - '0') * 10 + (s[15] - '0');
+  ss = (s[17] - '0') * 10 + (s[18] - '0');
+  leap = ((y % 4 == 0) && (y % 100 != 0)) || (y % 400 == 0);
+  if ((y < 1900) || (y > 2099) || (m < 1) || (m > 12) || (d < 1) || (d > mdays[m - 1]) ||
+      ((m == 2) && (d == 29) && !leap) || (hh > 23) || (mm > 59) || (ss > 59)) {
+    return -1;
+  }
+
+  if (n == 20) {
+    if (s[19] != 'Z') return -1;
+  } else {
+    if (((s[19] != '+') && (s[19] != '-')) || !is_digits(s + 20, 2) || (s[22] != ':') || !is_digits(s + 23, 2)) {
+      return -1;
+    }
+    oh = (s[20] - '0') * 10 + (s[21] - '0');
+    om = (s[23] - '0') * 10 + (s[24] - '0');
+    // hh:00, hh:30 or hh:45 up to 13:45, or 14:00
+    if (!((oh <= 13) && ((om == 0) || (om == 30) || (om == 45))) && !((oh == 14) && (om == 0))) {
+      return -1;
+    }
+    offset = (s[19] == '-') ? -(oh * 60 + om) : (oh * 60 + om);
+  }
+
+  t = days_from_civil(y, m, d) * 86400 + hh * 3600 + mm * 60 + ss - offset * 60;
+
+  return ((t < INT_LB) || (t > INT_UB)) ? -1 : 0;
+}
+
+static int check_enumerated(planNode *plan, const xmlChar *s, int n)
+{
+  int i;
+
+  for (i = 0; i < plan->items; i++) {
+    if ((xmlStrlen(plan->enumeration[i]) == n) && (xmlStrncmp(plan->enumeration[i], s, n) == 0)) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+// the patterns of the string types in packedobjectsDataTypes.xsd
+static int check_charset(planNode *plan, const xmlChar *s)
+{
+
+  for (; *s; s++) {
+    switch (plan->type) {
+    case STRING_TYPE:
+      if (*s > 0x7f) return -1;
+      break;
+    case BIT_STRING_TYPE:
+      if ((*s != '0') && (*s != '1')) return -1;
+      break;
+    case NUMERIC_STRING_TYPE:
+      if ((*s < '0') || (*s > '9')) return -1;
+      break;
+    case HEX_STRING_TYPE:
+      if (!(((*s >= '0') && (*s <= '9')) || ((*s >= 'a') && (*s <= 'f')) || ((*s >= 'A') && (*s <= 'F')))) return -1;
+      break;
+    }
+  }
+
+  return 0;
+}
+
+// XSD counts characters rather than bytes
+static int check_length(planNode *plan, const xmlChar *s)
+{
+  int len = xmlUTF8Strlen(s);
+
+  if (len < 0) {
+    return -1;
+  }
+  switch (plan->variant) {
+  case SEMI_CONSTRAINED:
+    return (len >= plan->lb) ? 0 : -1;
+  case CONSTRAINED:
+    return ((len >= plan->lb) && (len <= plan->ub)) ? 0 : -1;
+  case FIXED_LENGTH:
+    return (len == plan->length) ? 0 : -1;
+  }
+
+  return 0;
+}
+
+// check the text of a simple type against its type and facets
+int facets_check_value(planNode *plan, const xmlChar *value)
+{
+  const xmlChar *s = (value) ? value : BAD_CAST "";
+  int n = xmlStrlen(s);
+
+  switch (plan->type) {
+  case INTEGER_TYPE:
+    trim(&s, &n);
+    return check_integer(plan, s, n);
+  case STRING_TYPE:
+  case BIT_STRING_TYPE:
+  case NUMERIC_STRING_TYPE:
+  case HEX_STRING_TYPE:
+  case OCTET_STRING_TYPE:
+    if (check_charset(plan, s) == -1) return -1;
+    return check_length(plan, s);
+  case BOOLEAN_TYPE:
+    trim(&s, &n);
+    if ((n == 1) && ((s[0] == '0') || (s[0] == '1'))) return 0;
+    if ((n == 4) && (xmlStrncmp(s, BAD_CAST "true", 4) == 0)) return 0;
+    if ((n == 5) && (xmlStrncmp(s, BAD_CAST "false", 5) == 0)) return 0;
+    return -1;
+  case ENUMERATED_TYPE:
+    trim(&s, &n);
+    return check_enumerated(plan, s, n);
+  case DECIMAL_TYPE:
+    trim(&s, &n);
+    return check_decimal(s, n);
+  case CURRENCY_TYPE:
+    trim(&s, &n);
+    return check_currency(s, n);
+  case IPV4_ADDRESS_TYPE:
+    return check_ipv4_address(s);
+  case UNIX_TIME_TYPE:
+    trim(&s, &n);
+    return check_unix_time(s, n);
+  case NULL_TYPE:
+    return (n == 0) ? 0 : -1;
+  case UTF8_STRING_TYPE:
+    return (xmlUTF8Strlen(s) < 0) ? -1 : 0;
+  }
+
+  return 0;
+}
+
+/*
+ * unlike plan_find_child this enforces the order and number of children:
+ * a sequence in full, an optional sequence in order with each child at
+ * most once, a choice of exactly one and a sequence-of repeating its
+ * group in order
+ */
+planNode *facets_next_child(planNode *parent, const xmlChar *name, facetsCursor *fc)
+{
+  planNode *np = NULL;
+  int i;
+
+  switch (parent->type) {
+  case SEQUENCE_TYPE:
+    if ((fc->pos < parent->nchildren) && xmlStrEqual(parent->children[fc->pos]->name, name)) {
+      np = parent->children[fc->pos++];
+    }
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    for (i = fc->pos; i < parent->nchildren; i++) {
+      if (xmlStrEqual(parent->children[i]->name, name)) {
+        np = parent->children[i];
+        fc->pos = i + 1;
+        break;
+      }
+    }
+    break;
+  case CHOICE_TYPE:
+    if (fc->count > 0) break;
+    for (i = 0; i < parent->nchildren; i++) {
+      if (xmlStrEqual(parent->children[i]->name, name)) {
+        np = parent->children[i];
+        break;
+      }
+    }
+    break;
+  case SEQUENCE_OF_TYPE:
+    i = fc->count % parent->nchildren;
+    if (xmlStrEqual(parent->children[i]->name, name)) {
+      np = parent->children[i];
+    }
+    break;
+  }
+  if (np) {
+    fc->count++;
+  }
+
+  return np;
+}
+
+// called after the last child to check nothing required is missing
+int facets_end_children(planNode *parent, facetsCursor *fc)
+{
+  int n;
+
+  switch (parent->type) {
+  case SEQUENCE_TYPE:
+    return (fc->pos == parent->nchildren) ? 0 : -1;
+  case CHOICE_TYPE:
+    return (fc->count == 1) ? 0 : -1;
+  case SEQUENCE_OF_TYPE:
+    if (fc->count % parent->nchildren) {
+      return -1;
+    }
+    n = fc->count / parent->nchildren;
+    dbg("sequence_of len:%d", n);
+    if ((n < parent->lb) || (!parent->unbounded && (n > parent->ub))) {
+      return -1;
+    }
+    break;
+  }
+
+  return 0;
+}
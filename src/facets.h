@@ -0,0 +1,18 @@
+#ifndef FACETS_H_
+#define FACETS_H_
+
+#include "packedobjects.h"
+
+// where a container's children have got to while they are checked
+typedef struct {
+  int pos;
+  int count;
+} facetsCursor;
+
+// the plan node for name if it may come next, otherwise NULL
+planNode *facets_next_child(planNode *parent, const xmlChar *name, facetsCursor *fc);
+int facets_end_children(planNode *parent, facetsCursor *fc);
+int facets_check_value(planNode *plan, const xmlChar *value);
+int facets_check_integer(planNode *plan, signed long int n);
+
+#endif
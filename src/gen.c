@@ -0,0 +1,939 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+
+#include "packedobjects.h"
+#include "plan.h"
+
+// longest C name made from the element names on a path
+#define NAME_CHARS 1024
+// a name with the struct access around it
+#define EXPR_CHARS (NAME_CHARS + 16)
+
+static const char *keywords[] = {
+  "auto", "break", "case", "char", "const", "continue", "default", "do",
+  "double", "else", "enum", "extern", "float", "for", "goto", "if",
+  "inline", "int", "long", "register", "restrict", "return", "short",
+  "signed", "sizeof", "static", "struct", "switch", "typedef", "union",
+  "unsigned", "void", "volatile", "while", NULL
+};
+
+// indexed by the STRING_TYPES enum
+static const char *string_kinds[] = { "String", "BitString", "NumericString", "HexString", "OctetString" };
+
+static void print_usage(void);
+static void exit_with_message(char *message);
+static const char *get_filename_ext(const char *filename);
+static void make_ident(char *buf, const xmlChar *name);
+static void type_name(char *buf, planNode *np);
+static int is_struct(planNode *np);
+static int has_field(planNode *np);
+static int needs_free(planNode *np);
+static int string_kind(planNode *np);
+static void check_names(planNode *np, const char **names, int n);
+static void check_node(planNode *np);
+static void write_values(FILE *fp, planNode *np);
+static void write_field(FILE *fp, planNode *np, const char *indent, int array);
+static void write_fields(FILE *fp, planNode *np, const char *indent);
+static void write_structs(FILE *fp, planNode *np);
+static void write_encode_value(FILE *fp, planNode *np, const char *expr, const char *indent);
+static void write_decode_value(FILE *fp, planNode *np, const char *expr, const char *indent);
+static void write_free_value(FILE *fp, planNode *np, const char *expr, const char *indent);
+static void write_encode(FILE *fp, planNode *np);
+static void write_decode(FILE *fp, planNode *np);
+static void write_free(FILE *fp, planNode *np);
+static void write_functions(FILE *fp, planNode *np);
+static void write_header(const char *file, const char *base, const char *schema_file, planNode *plan);
+static void write_source(const char *file, const char *base, const char *schema_file, planNode *plan);
+
+static void print_usage(void)
+{
+  printf("usage: packedobjects-gen --schema <file> --out <name>\n");
+  exit(EXIT_SUCCESS);
+}
+
+static void exit_with_message(char *message)
+{
+  printf("Failed to run: %s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+static const char *get_filename_ext(const char *filename)
+{
+  const char *dot = strrchr(filename, '.');
+  if(!dot || dot == filename) return "";
+  return dot + 1;
+}
+
+// element names may hold characters C does not allow
+static void make_ident(char *buf, const xmlChar *name)
+{
+  const char **kp = NULL;
+  int i = 0;
+
+  if (isdigit(*name)) buf[i++] = '_';
+  for (; *name && (i < NAME_CHARS - 2); name++) {
+    buf[i++] = (isalnum(*name) || (*name == '_')) ? *name : '_';
+  }
+  buf[i] = '\0';
+  for (kp = keywords; *kp; kp++) {
+    if (!strcmp(buf, *kp)) {
+      strcat(buf, "_");
+      break;
+    }
+  }
+}
+
+// the names on the path from the root joined up
+static void type_name(char *buf, planNode *np)
+{
+  char ident[NAME_CHARS];
+
+  make_ident(ident, np->name);
+  if (np->parent == NULL) {
+    strcpy(buf, ident);
+    return;
+  }
+  type_name(buf, np->parent);
+  if (strlen(buf) + strlen(ident) + 2 > NAME_CHARS) {
+    exit_with_message("schema is nested too deeply to name its types");
+  }
+  strcat(buf, "_");
+  strcat(buf, ident);
+}
+
+static int is_struct(planNode *np)
+{
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+  case SEQUENCE_OF_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+  case CHOICE_TYPE:
+    return 1;
+  }
+
+  return 0;
+}
+
+// a null element is there or not but holds nothing
+static int has_field(planNode *np)
+{
+  return (np->type != NULL_TYPE);
+}
+
+// strings and arrays which a decode allocates
+static int needs_free(planNode *np)
+{
+  int i;
+
+  switch (np->type) {
+  case INTEGER_TYPE:
+  case NULL_TYPE:
+  case BOOLEAN_TYPE:
+  case ENUMERATED_TYPE:
+    return 0;
+  case SEQUENCE_OF_TYPE:
+    if ((np->nchildren > 1) || has_field(np->children[0])) return 1;
+    return 0;
+  case SEQUENCE_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+  case CHOICE_TYPE:
+    for (i = 0; i < np->nchildren; i++) {
+      if (needs_free(np->children[i])) return 1;
+    }
+    return 0;
+  }
+
+  return 1;
+}
+
+static int string_kind(planNode *np)
+{
+
+  switch (np->type) {
+  case BIT_STRING_TYPE:
+    return BIT_STRING;
+  case NUMERIC_STRING_TYPE:
+    return NUMERIC_STRING;
+  case HEX_STRING_TYPE:
+    return HEX_STRING;
+  case OCTET_STRING_TYPE:
+    return OCTET_STRING;
+  }
+
+  return STRING;
+}
+
+// two elements which make the same C name cannot share a struct
+static void check_names(planNode *np, const char **names, int n)
+{
+  int i, j;
+
+  for (i = 0; i < n; i++) {
+    for (j = i + 1; j < n; j++) {
+      if (!strcmp(names[i], names[j])) {
+        fprintf(stderr, "%s has two fields called %s.\n", np->name, names[i]);
+        exit_with_message("schema has element names which clash in C");
+      }
+    }
+  }
+}
+
+// anything the interpreter would not encode is refused before writing
+static void check_node(planNode *np)
+{
+  char (*idents)[NAME_CHARS] = NULL;
+  const char **names = NULL;
+  int i, n = 0;
+
+  switch (np->type) {
+  case INTEGER_TYPE:
+    if ((np->variant != UNCONSTRAINED) && (np->variant != SEMI_CONSTRAINED) && (np->variant != CONSTRAINED)) {
+      fprintf(stderr, "%s has an integer variant I can't encode.\n", np->name);
+      exit_with_message("unsupported schema");
+    }
+    return;
+  case STRING_TYPE:
+  case BIT_STRING_TYPE:
+  case NUMERIC_STRING_TYPE:
+  case HEX_STRING_TYPE:
+  case OCTET_STRING_TYPE:
+    if ((np->variant != SEMI_CONSTRAINED) && (np->variant != CONSTRAINED) && (np->variant != FIXED_LENGTH)) {
+      fprintf(stderr, "%s has a string variant I can't encode.\n", np->name);
+      exit_with_message("unsupported schema");
+    }
+    return;
+  case NULL_TYPE:
+  case BOOLEAN_TYPE:
+  case ENUMERATED_TYPE:
+  case CURRENCY_TYPE:
+  case DECIMAL_TYPE:
+  case IPV4_ADDRESS_TYPE:
+  case UTF8_STRING_TYPE:
+  case UNIX_TIME_TYPE:
+    return;
+  case SEQUENCE_OF_TYPE:
+    if ((np->nchildren == 0) || (np->items != np->nchildren)) {
+      fprintf(stderr, "%s does not repeat its children whole.\n", np->name);
+      exit_with_message("unsupported schema");
+    }
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    if ((np->items != np->nchildren) || (np->items > 32)) {
+      fprintf(stderr, "%s has a bitmap I can't encode.\n", np->name);
+      exit_with_message("unsupported schema");
+    }
+    break;
+  case CHOICE_TYPE:
+    if (np->nchildren == 0) {
+      fprintf(stderr, "%s has nothing to choose from.\n", np->name);
+      exit_with_message("unsupported schema");
+    }
+    break;
+  case SEQUENCE_TYPE:
+    break;
+  default:
+    fprintf(stderr, "%s has a type I can't encode.\n", np->name);
+    exit_with_message("unsupported schema");
+  }
+
+  // the members the struct will have besides count and choice
+  if (((idents = malloc(2 * (np->nchildren + 1) * NAME_CHARS)) == NULL) ||
+      ((names = malloc(2 * (np->nchildren + 1) * sizeof(char *))) == NULL)) {
+    exit_with_message("out of memory");
+  }
+  for (i = 0; i < np->nchildren; i++) {
+    make_ident(idents[n], np->children[i]->name);
+    names[n] = idents[n];
+    n++;
+    if (np->type == SEQUENCE_OPTIONAL_TYPE) {
+      strcpy(idents[n], "has_");
+      strncat(idents[n], idents[n - 1], NAME_CHARS - 5);
+      names[n] = idents[n];
+      n++;
+    }
+  }
+  if (np->type == SEQUENCE_OF_TYPE) {
+    names[n++] = "count";
+  } else if (np->type == CHOICE_TYPE) {
+    names[n++] = "choice";
+  }
+  check_names(np, names, n);
+  free(names);
+  free(idents);
+
+  for (i = 0; i < np->nchildren; i++) {
+    check_node(np->children[i]);
+  }
+}
+
+// what each number stands for
+static void write_values(FILE *fp, planNode *np)
+{
+  const xmlChar *s = NULL;
+  int i;
+
+  if (np->type == ENUMERATED_TYPE) {
+    fprintf(fp, " //");
+    for (i = 0; i < np->items; i++) {
+      fprintf(fp, "%s %d ", (i) ? "," : "", i);
+      for (s = np->enumeration[i]; *s; s++) {
+        fputc(((*s == '\n') || (*s == '\r')) ? ' ' : *s, fp);
+      }
+    }
+  } else if (np->type == CHOICE_TYPE) {
+    fprintf(fp, " //");
+    for (i = 0; i < np->nchildren; i++) {
+      fprintf(fp, "%s %d %s", (i) ? "," : "", i + 1, np->children[i]->name);
+    }
+  }
+}
+
+static void write_field(FILE *fp, planNode *np, const char *indent, int array)
+{
+  char name[NAME_CHARS];
+  char ident[NAME_CHARS];
+
+  make_ident(ident, np->name);
+  fprintf(fp, "%s", indent);
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+  case SEQUENCE_OF_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+  case CHOICE_TYPE:
+    type_name(name, np);
+    fprintf(fp, "struct %s ", name);
+    break;
+  case INTEGER_TYPE:
+    fprintf(fp, "signed long int ");
+    break;
+  case BOOLEAN_TYPE:
+  case ENUMERATED_TYPE:
+    fprintf(fp, "int ");
+    break;
+  default:
+    fprintf(fp, "char *");
+  }
+  fprintf(fp, "%s%s;", (array) ? "*" : "", ident);
+  if (np->type == ENUMERATED_TYPE) {
+    write_values(fp, np);
+  }
+  fprintf(fp, "\n");
+}
+
+// the members for the children of np, which may be none
+static void write_fields(FILE *fp, planNode *np, const char *indent)
+{
+  int i, n = 0;
+
+  for (i = 0; i < np->nchildren; i++) {
+    if (has_field(np->children[i])) {
+      write_field(fp, np->children[i], indent, 0);
+      n++;
+    }
+  }
+  // C has no empty structs
+  if (n == 0) {
+    fprintf(fp, "%schar unused;\n", indent);
+  }
+}
+
+// children are written first so each struct is complete where it is used
+static void write_structs(FILE *fp, planNode *np)
+{
+  char name[NAME_CHARS];
+  char ident[NAME_CHARS];
+  int i, n = 0;
+
+  if (!is_struct(np)) {
+    return;
+  }
+  for (i = 0; i < np->nchildren; i++) {
+    write_structs(fp, np->children[i]);
+  }
+  type_name(name, np);
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+    fprintf(fp, "struct %s {\n", name);
+    write_fields(fp, np, "  ");
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    fprintf(fp, "struct %s {\n", name);
+    for (i = 0; i < np->nchildren; i++) {
+      make_ident(ident, np->children[i]->name);
+      fprintf(fp, "  int has_%s;\n", ident);
+      if (has_field(np->children[i])) {
+        write_field(fp, np->children[i], "  ", 0);
+      }
+    }
+    break;
+  case CHOICE_TYPE:
+    fprintf(fp, "struct %s {\n", name);
+    fprintf(fp, "  int choice;");
+    write_values(fp, np);
+    fprintf(fp, "\n");
+    for (i = 0; i < np->nchildren; i++) {
+      if (has_field(np->children[i])) n++;
+    }
+    if (n) {
+      fprintf(fp, "  union {\n");
+      write_fields(fp, np, "    ");
+      fprintf(fp, "  };\n");
+    }
+    break;
+  case SEQUENCE_OF_TYPE:
+    if (np->nchildren > 1) {
+      // each repeat holds every child
+      fprintf(fp, "struct %s_item {\n", name);
+      write_fields(fp, np, "  ");
+      fprintf(fp, "};\n\n");
+    }
+    fprintf(fp, "struct %s {\n", name);
+    fprintf(fp, "  int count;\n");
+    if (np->nchildren > 1) {
+      fprintf(fp, "  struct %s_item *item;\n", name);
+    } else if (has_field(np->children[0])) {
+      write_field(fp, np->children[0], "  ", 1);
+    }
+    break;
+  }
+  fprintf(fp, "};\n\n");
+}
+
+static void write_encode_value(FILE *fp, planNode *np, const char *expr, const char *indent)
+{
+  char name[NAME_CHARS];
+  const char *kind = string_kinds[string_kind(np)];
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+  case SEQUENCE_OF_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+  case CHOICE_TYPE:
+    type_name(name, np);
+    fprintf(fp, "%sencode_%s(&%s, memBuf);\n", indent, name, expr);
+    break;
+  case INTEGER_TYPE:
+    if (np->variant == UNCONSTRAINED) {
+      fprintf(fp, "%sencodeUnconstrainedInteger(memBuf, %s);\n", indent, expr);
+    } else if (np->variant == SEMI_CONSTRAINED) {
+      fprintf(fp, "%sencodeUnsignedSemiConstrainedInteger(memBuf, %s, %ldL);\n", indent, expr, np->lb);
+    } else {
+      fprintf(fp, "%sencodeConstrainedWholeNumber(memBuf, %s, %ldL, %d);\n", indent, expr, np->lb, np->bits);
+    }
+    break;
+  case STRING_TYPE:
+  case BIT_STRING_TYPE:
+  case NUMERIC_STRING_TYPE:
+  case HEX_STRING_TYPE:
+  case OCTET_STRING_TYPE:
+    if (np->variant == SEMI_CONSTRAINED) {
+      fprintf(fp, "%sencodeSemiConstrained%s(memBuf, %s);\n", indent, kind, expr);
+    } else if (np->variant == CONSTRAINED) {
+      fprintf(fp, "%sencodeConstrained%s(memBuf, %s, %d, %d);\n", indent, kind, expr, (int)np->lb, (int)np->ub);
+    } else {
+      fprintf(fp, "%sencodeFixedLength%s(memBuf, %s, %d);\n", indent, kind, expr, np->length);
+    }
+    break;
+  case BOOLEAN_TYPE:
+    fprintf(fp, "%sencodeBoolean(memBuf, %s != 0);\n", indent, expr);
+    break;
+  case ENUMERATED_TYPE:
+    fprintf(fp, "%sencodeConstrainedWholeNumber(memBuf, %s, 0, %d);\n", indent, expr, np->bits);
+    break;
+  case CURRENCY_TYPE:
+    fprintf(fp, "%sencodeCurrency(memBuf, %s);\n", indent, expr);
+    break;
+  case DECIMAL_TYPE:
+    fprintf(fp, "%sencodeDecimal(memBuf, %s);\n", indent, expr);
+    break;
+  case IPV4_ADDRESS_TYPE:
+    fprintf(fp, "%sencodeIPv4Address(memBuf, %s);\n", indent, expr);
+    break;
+  case UTF8_STRING_TYPE:
+    fprintf(fp, "%sencodeSemiConstrainedOctetString(memBuf, %s);\n", indent, expr);
+    break;
+  case UNIX_TIME_TYPE:
+    fprintf(fp, "%sencodeUnixTime(memBuf, %s);\n", indent, expr);
+    break;
+  }
+}
+
+static void write_decode_value(FILE *fp, planNode *np, const char *expr, const char *indent)
+{
+  char name[NAME_CHARS];
+  const char *kind = string_kinds[string_kind(np)];
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+  case SEQUENCE_OF_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+  case CHOICE_TYPE:
+    type_name(name, np);
+    fprintf(fp, "%sdecode_%s(memBuf, &%s);\n", indent, name, expr);
+    break;
+  case INTEGER_TYPE:
+    if (np->variant == UNCONSTRAINED) {
+      fprintf(fp, "%s%s = decodeUnconstrainedInteger(memBuf);\n", indent, expr);
+    } else if (np->variant == SEMI_CONSTRAINED) {
+      fprintf(fp, "%s%s = decodeUnsignedSemiConstrainedInteger(memBuf, %ldL);\n", indent, expr, np->lb);
+    } else {
+      fprintf(fp, "%s%s = decodeConstrainedWholeNumber(memBuf, %ldL, %d);\n", indent, expr, np->lb, np->bits);
+    }
+    break;
+  case STRING_TYPE:
+  case BIT_STRING_TYPE:
+  case NUMERIC_STRING_TYPE:
+  case HEX_STRING_TYPE:
+  case OCTET_STRING_TYPE:
+    if (np->variant == SEMI_CONSTRAINED) {
+      fprintf(fp, "%s%s = decodeSemiConstrained%s(memBuf);\n", indent, expr, kind);
+    } else if (np->variant == CONSTRAINED) {
+      fprintf(fp, "%s%s = decodeConstrained%s(memBuf, %d, %d);\n", indent, expr, kind, (int)np->lb, (int)np->ub);
+    } else {
+      fprintf(fp, "%s%s = decodeFixedLength%s(memBuf, %d);\n", indent, expr, kind, np->length);
+    }
+    break;
+  case BOOLEAN_TYPE:
+    fprintf(fp, "%s%s = decodeBoolean(memBuf);\n", indent, expr);
+    break;
+  case ENUMERATED_TYPE:
+    fprintf(fp, "%s%s = decodeConstrainedWholeNumber(memBuf, 0, %d);\n", indent, expr, np->bits);
+    break;
+  case CURRENCY_TYPE:
+    fprintf(fp, "%s%s = decodeCurrency(memBuf);\n", indent, expr);
+    break;
+  case DECIMAL_TYPE:
+    fprintf(fp, "%s%s = decodeDecimal(memBuf);\n", indent, expr);
+    break;
+  case IPV4_ADDRESS_TYPE:
+    fprintf(fp, "%s%s = decodeIPv4Address(memBuf);\n", indent, expr);
+    break;
+  case UTF8_STRING_TYPE:
+    fprintf(fp, "%s%s = decodeSemiConstrainedOctetString(memBuf);\n", indent, expr);
+    break;
+  case UNIX_TIME_TYPE:
+    fprintf(fp, "%s%s = decodeUnixTime(memBuf);\n", indent, expr);
+    break;
+  }
+}
+
+static void write_free_value(FILE *fp, planNode *np, const char *expr, const char *indent)
+{
+  char name[NAME_CHARS];
+
+  if (!needs_free(np)) {
+    return;
+  }
+  if (is_struct(np)) {
+    type_name(name, np);
+    fprintf(fp, "%sfree_%s(memBuf, &%s);\n", indent, name, expr);
+  } else {
+    fprintf(fp, "%sdecodeRelease(memBuf, %s);\n", indent, expr);
+  }
+}
+
+// where a child's value lives in the struct for np
+static void child_expr(char *buf, planNode *np, int i)
+{
+  char ident[NAME_CHARS];
+
+  make_ident(ident, np->children[i]->name);
+  if (np->type != SEQUENCE_OF_TYPE) {
+    snprintf(buf, EXPR_CHARS, "s->%s", ident);
+  } else if (np->nchildren > 1) {
+    snprintf(buf, EXPR_CHARS, "s->item[i].%s", ident);
+  } else {
+    snprintf(buf, EXPR_CHARS, "s->%s[i]", ident);
+  }
+}
+
+static void write_encode(FILE *fp, planNode *np)
+{
+  char name[NAME_CHARS];
+  char ident[NAME_CHARS];
+  char expr[EXPR_CHARS];
+  int i;
+
+  type_name(name, np);
+  fprintf(fp, "%svoid encode_%s(struct %s *s, packedEncode *memBuf)\n{\n", (np->parent) ? "static " : "", name, name);
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+    for (i = 0; i < np->nchildren; i++) {
+      child_expr(expr, np, i);
+      write_encode_value(fp, np->children[i], expr, "  ");
+    }
+    break;
+  case SEQUENCE_OF_TYPE:
+    fprintf(fp, "  int i;\n\n");
+    if (np->unbounded) {
+      fprintf(fp, "  encodeUnsignedSemiConstrainedInteger(memBuf, s->count, %ldL);\n", np->lb);
+    } else {
+      fprintf(fp, "  encodeConstrainedWholeNumber(memBuf, s->count, %ldL, %d);\n", np->lb, np->bits);
+    }
+    fprintf(fp, "  for (i = 0; i < s->count; i++) {\n");
+    for (i = 0; i < np->nchildren; i++) {
+      child_expr(expr, np, i);
+      write_encode_value(fp, np->children[i], expr, "    ");
+    }
+    fprintf(fp, "  }\n");
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    fprintf(fp, "  unsigned long int bitmap = 0;\n\n");
+    for (i = 0; i < np->nchildren; i++) {
+      make_ident(ident, np->children[i]->name);
+      fprintf(fp, "  if (s->has_%s) bitmap |= 1UL << %d;\n", ident, i);
+    }
+    fprintf(fp, "  encodeBitmap(memBuf, bitmap, %d);\n", np->items);
+    for (i = 0; i < np->nchildren; i++) {
+      if (has_field(np->children[i])) {
+        make_ident(ident, np->children[i]->name);
+        child_expr(expr, np, i);
+        fprintf(fp, "  if (s->has_%s) {\n", ident);
+        write_encode_value(fp, np->children[i], expr, "    ");
+        fprintf(fp, "  }\n");
+      }
+    }
+    break;
+  case CHOICE_TYPE:
+    fprintf(fp, "  encodeConstrainedWholeNumber(memBuf, s->choice, 1, %d);\n", np->bits);
+    fprintf(fp, "  switch (s->choice) {\n");
+    for (i = 0; i < np->nchildren; i++) {
+      if (has_field(np->children[i])) {
+        child_expr(expr, np, i);
+        fprintf(fp, "  case %d:\n", i + 1);
+        write_encode_value(fp, np->children[i], expr, "    ");
+        fprintf(fp, "    break;\n");
+      }
+    }
+    fprintf(fp, "  }\n");
+    break;
+  }
+  fprintf(fp, "}\n\n");
+}
+
+static void write_decode(FILE *fp, planNode *np)
+{
+  char name[NAME_CHARS];
+  char ident[NAME_CHARS];
+  char expr[EXPR_CHARS];
+  int i;
+
+  type_name(name, np);
+  fprintf(fp, "%svoid decode_%s(packedDecode *memBuf, struct %s *s)\n{\n", (np->parent) ? "static " : "", name, name);
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+    break;
+  case SEQUENCE_OF_TYPE:
+    fprintf(fp, "  unsigned long int len;\n  int i;\n\n");
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    fprintf(fp, "  unsigned long int bitmap;\n\n");
+    break;
+  case CHOICE_TYPE:
+    break;
+  }
+  if (np->parent == NULL) {
+    // anything not decoded is left for free to skip
+    fprintf(fp, "  memset(s, 0, sizeof(*s));\n");
+  }
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+    for (i = 0; i < np->nchildren; i++) {
+      child_expr(expr, np, i);
+      write_decode_value(fp, np->children[i], expr, "  ");
+    }
+    break;
+  case SEQUENCE_OF_TYPE:
+    if (np->unbounded) {
+      fprintf(fp, "  len = decodeUnsignedSemiConstrainedInteger(memBuf, %ldL);\n", np->lb);
+    } else {
+      fprintf(fp, "  len = decodeConstrainedWholeNumber(memBuf, %ldL, %d);\n", np->lb, np->bits);
+    }
+    // a count the rest of the pdu can not hold fails before the calloc
+    fprintf(fp, "  checkItemCount(memBuf, len, %d);\n", plan_item_bits(np));
+    fprintf(fp, "  if (len > INT_MAX) longjmp(memBuf->env, DECODE_DOCUMENT_FAILED);\n");
+    if (np->nchildren > 1) {
+      snprintf(expr, EXPR_CHARS, "s->item");
+    } else if (has_field(np->children[0])) {
+      make_ident(ident, np->children[0]->name);
+      snprintf(expr, EXPR_CHARS, "s->%s", ident);
+    } else {
+      expr[0] = '\0';
+    }
+    if (expr[0]) {
+      fprintf(fp, "  if ((len > 0) && ((%s = calloc(len, sizeof(*%s))) == NULL)) {\n", expr, expr);
+      fprintf(fp, "    longjmp(memBuf->env, DECODE_DOCUMENT_FAILED);\n  }\n");
+    }
+    fprintf(fp, "  s->count = len;\n");
+    fprintf(fp, "  for (i = 0; i < s->count; i++) {\n");
+    for (i = 0; i < np->nchildren; i++) {
+      child_expr(expr, np, i);
+      write_decode_value(fp, np->children[i], expr, "    ");
+    }
+    fprintf(fp, "  }\n");
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    fprintf(fp, "  bitmap = decodeBitmap(memBuf, %d);\n", np->items);
+    for (i = 0; i < np->nchildren; i++) {
+      make_ident(ident, np->children[i]->name);
+      child_expr(expr, np, i);
+      fprintf(fp, "  if (bitmap & (1UL << %d)) {\n", i);
+      fprintf(fp, "    s->has_%s = 1;\n", ident);
+      write_decode_value(fp, np->children[i], expr, "    ");
+      fprintf(fp, "  }\n");
+    }
+    break;
+  case CHOICE_TYPE:
+    fprintf(fp, "  s->choice = decodeConstrainedWholeNumber(memBuf, 1, %d);\n", np->bits);
+    fprintf(fp, "  switch (s->choice) {\n");
+    for (i = 0; i < np->nchildren; i++) {
+      if (has_field(np->children[i])) {
+        child_expr(expr, np, i);
+        fprintf(fp, "  case %d:\n", i + 1);
+        write_decode_value(fp, np->children[i], expr, "    ");
+        fprintf(fp, "    break;\n");
+      }
+    }
+    fprintf(fp, "  }\n");
+    break;
+  }
+  fprintf(fp, "}\n\n");
+}
+
+static void write_free(FILE *fp, planNode *np)
+{
+  char name[NAME_CHARS];
+  char ident[NAME_CHARS];
+  char expr[EXPR_CHARS];
+  int i;
+
+  type_name(name, np);
+  fprintf(fp, "%svoid free_%s(packedDecode *memBuf, struct %s *s)\n{\n", (np->parent) ? "static " : "", name, name);
+
+  switch (np->type) {
+  case SEQUENCE_TYPE:
+    for (i = 0; i < np->nchildren; i++) {
+      child_expr(expr, np, i);
+      write_free_value(fp, np->children[i], expr, "  ");
+    }
+    break;
+  case SEQUENCE_OF_TYPE:
+    if (!needs_free(np)) break;
+    for (i = 0; i < np->nchildren; i++) {
+      if (needs_free(np->children[i])) break;
+    }
+    if (i < np->nchildren) {
+      fprintf(fp, "  int i;\n\n");
+      fprintf(fp, "  for (i = 0; i < s->count; i++) {\n");
+      for (i = 0; i < np->nchildren; i++) {
+        child_expr(expr, np, i);
+        write_free_value(fp, np->children[i], expr, "    ");
+      }
+      fprintf(fp, "  }\n");
+    }
+    if (np->nchildren > 1) {
+      fprintf(fp, "  free(s->item);\n");
+    } else {
+      make_ident(ident, np->children[0]->name);
+      fprintf(fp, "  free(s->%s);\n", ident);
+    }
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    for (i = 0; i < np->nchildren; i++) {
+      if (needs_free(np->children[i])) {
+        make_ident(ident, np->children[i]->name);
+        child_expr(expr, np, i);
+        fprintf(fp, "  if (s->has_%s) {\n", ident);
+        write_free_value(fp, np->children[i], expr, "    ");
+        fprintf(fp, "  }\n");
+      }
+    }
+    break;
+  case CHOICE_TYPE:
+    if (!needs_free(np)) break;
+    fprintf(fp, "  switch (s->choice) {\n");
+    for (i = 0; i < np->nchildren; i++) {
+      if (needs_free(np->children[i])) {
+        child_expr(expr, np, i);
+        fprintf(fp, "  case %d:\n", i + 1);
+        write_free_value(fp, np->children[i], expr, "    ");
+        fprintf(fp, "    break;\n");
+      }
+    }
+    fprintf(fp, "  }\n");
+    break;
+  }
+  fprintf(fp, "}\n\n");
+}
+
+// callees come first so nothing needs declaring
+static void write_functions(FILE *fp, planNode *np)
+{
+  int i;
+
+  if (!is_struct(np)) {
+    return;
+  }
+  for (i = 0; i < np->nchildren; i++) {
+    write_functions(fp, np->children[i]);
+  }
+  write_encode(fp, np);
+  write_decode(fp, np);
+  // only the top level free is always wanted
+  if ((np->parent == NULL) || needs_free(np)) {
+    write_free(fp, np);
+  }
+}
+
+static void write_header(const char *file, const char *base, const char *schema_file, planNode *plan)
+{
+  FILE *fp = NULL;
+  char name[NAME_CHARS];
+  char guard[NAME_CHARS];
+  int i;
+
+  if ((fp = fopen(file, "w")) == NULL) {
+    exit_with_message("could not write header file");
+  }
+  type_name(name, plan);
+  make_ident(guard, BAD_CAST base);
+  for (i = 0; guard[i]; i++) {
+    guard[i] = toupper(guard[i]);
+  }
+
+  fprintf(fp, "// generated by packedobjects-gen from %s, do not edit\n", schema_file);
+  // kept apart from the guards in the library's own headers
+  fprintf(fp, "#ifndef PACKEDOBJECTS_GEN_%s_H_\n#define PACKEDOBJECTS_GEN_%s_H_\n\n", guard, guard);
+  fprintf(fp, "#include \"ier.h\"\n\n");
+  write_structs(fp, plan);
+  fprintf(fp, "/*\n");
+  fprintf(fp, " * errors longjmp to memBuf->env as they do in the library. free gives\n");
+  fprintf(fp, " * back the strings and arrays a decode allocated and may also be called\n");
+  fprintf(fp, " * after one that failed\n");
+  fprintf(fp, " */\n");
+  fprintf(fp, "void encode_%s(struct %s *s, packedEncode *memBuf);\n", name, name);
+  fprintf(fp, "void decode_%s(packedDecode *memBuf, struct %s *s);\n", name, name);
+  fprintf(fp, "void free_%s(packedDecode *memBuf, struct %s *s);\n", name, name);
+  fprintf(fp, "\n#endif\n");
+
+  if (fclose(fp) != 0) {
+    exit_with_message("could not write header file");
+  }
+}
+
+static void write_source(const char *file, const char *base, const char *schema_file, planNode *plan)
+{
+  FILE *fp = NULL;
+
+  if ((fp = fopen(file, "w")) == NULL) {
+    exit_with_message("could not write source file");
+  }
+
+  fprintf(fp, "// generated by packedobjects-gen from %s, do not edit\n", schema_file);
+  fprintf(fp, "#include <stdlib.h>\n#include <string.h>\n#include <limits.h>\n#include <setjmp.h>\n\n");
+  fprintf(fp, "// include for error codes\n#include \"core.h\"\n");
+  fprintf(fp, "#include \"%s.h\"\n\n", base);
+  write_functions(fp, plan);
+
+  if (fclose(fp) != 0) {
+    exit_with_message("could not write source file");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int c;
+  packedobjectsSchema *ps = NULL;
+  planNode wrapper = { 0 };
+  planNode *plan = NULL;
+  const char *schema_file = NULL;
+  const char *out_name = NULL;
+  const char *base = NULL;
+  char *file = NULL;
+  int error = 0;
+
+  while(1) {
+    static struct option long_options[] =
+      {
+        {"help",  no_argument, 0, 'h'},
+        {"schema",  required_argument, 0, 's'},
+        {"out",  required_argument, 0, 'o'},
+        {0, 0, 0, 0}
+      };
+    int option_index = 0;
+
+    c = getopt_long (argc, argv, "hs:o:?", long_options, &option_index);
+
+    if (c == -1) break;
+
+    switch (c)
+      {
+      case 'h':
+        print_usage();
+        break;
+
+      case 's':
+        schema_file = optarg;
+        break;
+
+      case 'o':
+        out_name = optarg;
+        break;
+
+      case '?':
+        print_usage();
+        break;
+
+      default:
+        abort ();
+      }
+  }
+
+  if (!schema_file) exit_with_message("did not specify --schema file");
+  if (!out_name) exit_with_message("did not specify --out name");
+
+  // the generated code trusts its data so there is nothing to validate with
+  if (!strcmp(get_filename_ext(schema_file), "poc")) {
+    ps = init_packedobjects_schema_from_compiled(schema_file, 0, &error);
+  } else {
+    ps = init_packedobjects_schema(schema_file, NO_DATA_VALIDATION, &error);
+  }
+  if (ps == NULL) {
+    fprintf(stderr, "Failed to load schema with error %d.\n", error);
+    exit_with_message("failed to initialise libpackedobjects");
+  }
+  plan = ps->plan;
+  if (!is_struct(plan)) {
+    // a simple value at the top level goes in a struct of its own
+    wrapper.name = plan->name;
+    wrapper.type = SEQUENCE_TYPE;
+    wrapper.nchildren = 1;
+    wrapper.children = &ps->plan;
+    plan->parent = &wrapper;
+    plan = &wrapper;
+  }
+  check_node(plan);
+
+  if ((file = malloc(strlen(out_name) + 3)) == NULL) {
+    exit_with_message("out of memory");
+  }
+  base = (strrchr(out_name, '/')) ? strrchr(out_name, '/') + 1 : out_name;
+  sprintf(file, "%s.h", out_name);
+  write_header(file, base, schema_file, plan);
+  sprintf(file, "%s.c", out_name);
+  write_source(file, base, schema_file, plan);
+
+  free(file);
+  ps->plan->parent = NULL;
+  free_packedobjects_schema(ps);
+  xmlCleanupParser();
+  return EXIT_SUCCESS;
+}
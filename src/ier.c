@@ -14,8 +14,9 @@
 #include <sys/socket.h>
 #endif
 
-#include "packedobjects.h"
 #include "config.h"
+// include for error codes
+#include "core.h"
 #include "ier.h"
 
 #define WORD_32BIT 32
@@ -41,10 +42,6 @@
   (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
 #endif
 
-// defined in packedobject.c
-extern jmp_buf encode_exception_env;
-extern jmp_buf decode_exception_env;
-
 static char hexchar[] = {
   '0',
   '1',
@@ -85,7 +82,12 @@ static char numchar[] = {
 static int bitcount (unsigned int n);
 static int bits_required(unsigned int lb, unsigned int ub);
 static time_t rfc3339string_to_epoch(const char *timestring);
-static char *epoch_to_rfc3339string(char *buf, int size, time_t t);
+static uint64_t pack_seven_bit(const char *s);
+static void unpack_seven_bit(uint64_t n, char *s);
+static void encode_seven_bit_chars(packedEncode *memBuf, const char *s, int len);
+static void decode_seven_bit_chars(packedDecode *memBuf, char *s, int len);
+static long long bits_left(packedDecode *memBuf);
+static char *alloc_string(packedDecode *memBuf, int len, int bits);
 
 /* can not calculate for value 0 */
 static int bitcount (unsigned int n)
@@ -111,6 +113,111 @@ static int bits_required(unsigned int lb, unsigned int ub)
 
 }
 
+/* bits of the pdu not yet read, here so every string decode can inline it */
+static long long bits_left(packedDecode *memBuf)
+{
+  long long bytes = (long long)memBuf->size - (long long)memBuf->word * WORD_BYTE;
+
+  // the last word may have been only partly there
+  if (bytes < 0) bytes = 0;
+
+  return bytes * CHAR_BIT + memBuf->cacheBits;
+}
+
+/* 
+ * room for len chars of bits each and a nul, with the sum done where it
+ * can not wrap. a length the rest of the pdu can not hold is truncation,
+ * found before anything is allocated for it
+ */
+static char *alloc_string(packedDecode *memBuf, int len, int bits)
+{
+  size_t bytes = (size_t)len + 1;
+
+  // a negative length is one too large for an int
+  if ((len < 0) || ((long long)len * bits > bits_left(memBuf))) {
+    alert("String length %d runs past the end of the PDU.", len);
+    longjmp(memBuf->env, DECODE_PDU_TRUNCATED);
+  }
+  if (bytes > INT_MAX) {
+    alert("String length %d is out of range.", len);
+    return NULL;
+  }
+
+  return decodeAlloc(memBuf, bytes);
+}
+
+/* 
+ * eight chars squeezed into 56 bits, first char in the top 7 bits, as
+ * eight 7 bit encodes would write them. each step halves the number of
+ * lanes, closing the gap left by the top bit of every byte
+ */
+static uint64_t pack_seven_bit(const char *s)
+{
+  uint64_t n = 0;
+  int i;
+
+  // big endian so the first char is the most significant
+  for (i = 0; i < EIGHT_BIT; i++) {
+    n = (n << EIGHT_BIT) | (unsigned char)s[i];
+  }
+  n = ((n & 0x7f007f007f007f00ULL) >> 1) | (n & 0x007f007f007f007fULL);
+  n = ((n & 0x3fff00003fff0000ULL) >> 2) | (n & 0x00003fff00003fffULL);
+  n = ((n & 0x0fffffff00000000ULL) >> 4) | (n & 0x000000000fffffffULL);
+
+  return n;
+}
+
+/* the same steps backwards */
+static void unpack_seven_bit(uint64_t n, char *s)
+{
+  int i;
+
+  n = ((n & 0x00fffffff0000000ULL) << 4) | (n & 0x000000000fffffffULL);
+  n = ((n & 0x0fffc0000fffc000ULL) << 2) | (n & 0x00003fff00003fffULL);
+  n = ((n & 0x3f803f803f803f80ULL) << 1) | (n & 0x007f007f007f007fULL);
+  for (i = EIGHT_BIT - 1; i >= 0; i--) {
+    s[i] = n & 0xff;
+    n >>= EIGHT_BIT;
+  }
+}
+
+/*
+ * whole groups of eight chars go to the bit writer 56 bits at a time and
+ * whatever is left over, all of a short string, a char at a time. the
+ * bits are the same either way
+ */
+static void encode_seven_bit_chars(packedEncode *memBuf, const char *s, int len)
+{
+  uint64_t n;
+  int i;
+
+  for (i = 0; i + EIGHT_BIT <= len; i += EIGHT_BIT) {
+    n = pack_seven_bit(s + i);
+    // two halves keep to the writer's 32 bit fast path
+    encode(memBuf, n >> (FOUR_BIT * SEVEN_BIT), FOUR_BIT * SEVEN_BIT);
+    encode(memBuf, n, FOUR_BIT * SEVEN_BIT);
+  }
+  for (; i < len; i++) {
+    encode(memBuf, s[i], SEVEN_BIT);
+  }
+}
+
+static void decode_seven_bit_chars(packedDecode *memBuf, char *s, int len)
+{
+  uint64_t n;
+  int i;
+
+  for (i = 0; i + EIGHT_BIT <= len; i += EIGHT_BIT) {
+    // the reader takes at most 32 bits at once
+    n = decode(memBuf, FOUR_BIT * SEVEN_BIT);
+    n = (n << (FOUR_BIT * SEVEN_BIT)) | decode(memBuf, FOUR_BIT * SEVEN_BIT);
+    unpack_seven_bit(n, s + i);
+  }
+  for (; i < len; i++) {
+    s[i] = decode(memBuf, SEVEN_BIT);
+  }
+}
+
 
 void encodeBoolean(packedEncode *memBuf, int flag) {
   encode(memBuf, flag, 1);
@@ -148,7 +255,7 @@ char *decodeConstrainedBitString(packedDecode *memBuf, int lb, int ub) {
   len = decode(memBuf, bits_required(lb, ub)) + lb;
     
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, ONE_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;
   }  
@@ -181,7 +288,7 @@ char *decodeFixedLengthBitString(packedDecode *memBuf, int len) {
   char *s, *baseptr;
     
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, ONE_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;
   }   
@@ -221,7 +328,7 @@ char *decodeSemiConstrainedBitString(packedDecode *memBuf) {
   len = decodeUnsignedSemiConstrainedInteger(memBuf, 0);
 
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, ONE_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }	
@@ -264,7 +371,7 @@ char *decodeFixedLengthHexString(packedDecode *memBuf, int len) {
   unsigned int n;
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, FOUR_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;       
   }   
@@ -318,7 +425,7 @@ char *decodeConstrainedHexString(packedDecode *memBuf, int lb, int ub) {
   len = decode(memBuf, bits_required(lb, ub)) + lb;
    
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, FOUR_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;   
   }  
@@ -369,7 +476,7 @@ char *decodeSemiConstrainedHexString(packedDecode *memBuf) {
   len = decodeUnsignedSemiConstrainedInteger(memBuf, 0);  
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, FOUR_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   } 	
@@ -416,7 +523,7 @@ char *decodeFixedLengthNumericString(packedDecode *memBuf, int len) {
   unsigned int n;
     
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, FOUR_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }   
@@ -473,7 +580,7 @@ char *decodeConstrainedNumericString(packedDecode *memBuf, int lb, int ub) {
   len = decode(memBuf, bits_required(lb, ub)) + lb;
 
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, FOUR_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }  
@@ -527,7 +634,7 @@ char *decodeSemiConstrainedNumericString(packedDecode *memBuf) {
   len = decodeUnsignedSemiConstrainedInteger(memBuf, 0);
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, FOUR_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }   
@@ -548,40 +655,27 @@ char *decodeSemiConstrainedNumericString(packedDecode *memBuf) {
 //////
 
 void encodeFixedLengthString(packedEncode *memBuf, char *s, int len) {
-  int i;
-  char c;
     
-  for (i = 0; i < len; i++) {
-    c = *(s+i);
-    encode(memBuf, c, SEVEN_BIT);
-  }
+  encode_seven_bit_chars(memBuf, s, len);
 }
 
 char *decodeFixedLengthString(packedDecode *memBuf, int len) {
-  int i;
-  char *s, *baseptr;
+  char *s;
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, SEVEN_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }  
-  baseptr = s;
   
-  for (i = 0; i < len; i++) {
-    *s = decode(memBuf, SEVEN_BIT);
-    s++;
-  }
-  *s = '\0';
-  
-  s = baseptr;	
+  decode_seven_bit_chars(memBuf, s, len);
+  s[len] = '\0';
   
   return s;
 }
 
 void encodeConstrainedString(packedEncode *memBuf, char *s, int lb, int ub) {
-  int bits, len, i;
-  char c;
+  int bits, len;
   
   bits = bits_required(lb, ub);
 
@@ -591,35 +685,26 @@ void encodeConstrainedString(packedEncode *memBuf, char *s, int lb, int ub) {
   /* encode length as constrained whole number */
   encode(memBuf, len - lb, bits);
   
-  for (i = 0; i < len; i++) {
-    c = *(s+i);
-    encode(memBuf, c, SEVEN_BIT);
-  }
+  encode_seven_bit_chars(memBuf, s, len);
   
 }
 
 char *decodeConstrainedString(packedDecode *memBuf, int lb, int ub) {
 	
-  int len, i;
-  char *s, *baseptr;
+  int len;
+  char *s;
   
   /* get length as constrained whole number */
   len = decode(memBuf, bits_required(lb, ub)) + lb;
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, SEVEN_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;    
   }
-  baseptr = s;
-  
-  for (i = 0; i < len; i++) {
-    *s = decode(memBuf, SEVEN_BIT);
-    s++;
-  }
-  *s = '\0';
   
-  s = baseptr;
+  decode_seven_bit_chars(memBuf, s, len);
+  s[len] = '\0';
   
   return s;
 
@@ -627,8 +712,7 @@ char *decodeConstrainedString(packedDecode *memBuf, int lb, int ub) {
 
 
 void encodeSemiConstrainedString(packedEncode *memBuf, char *s) {
-  int len, i;
-  char c;
+  int len;
 
   // in case s is null
   (s) ? (len=strlen(s)) : (len=0);
@@ -636,33 +720,24 @@ void encodeSemiConstrainedString(packedEncode *memBuf, char *s) {
   // encode the length as semi constrained integer with 0 lb
   encodeUnsignedSemiConstrainedInteger(memBuf, len, 0);
   
-  for (i = 0; i < len; i++) {
-    c = *(s+i);
-    encode(memBuf, c, SEVEN_BIT);
-  }
+  encode_seven_bit_chars(memBuf, s, len);
   
 }
 
 char *decodeSemiConstrainedString(packedDecode *memBuf) {
-  int len, i;
-  char *s, *baseptr;
+  int len;
+  char *s;
 
   len = decodeUnsignedSemiConstrainedInteger(memBuf, 0);
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, SEVEN_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }
-  baseptr = s;
-  
-  for (i = 0; i < len; i++) {
-    *s = decode(memBuf, SEVEN_BIT);
-    s++;
-  }
-  *s = '\0';
   
-  s = baseptr;
+  decode_seven_bit_chars(memBuf, s, len);
+  s[len] = '\0';
   
   return s;
 }
@@ -682,7 +757,7 @@ char *decodeFixedLengthOctetString(packedDecode *memBuf, int len) {
   char *s, *baseptr;
 
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, EIGHT_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;       
   }  
@@ -722,7 +797,7 @@ char *decodeConstrainedOctetString(packedDecode *memBuf, int lb, int ub) {
   len = decode(memBuf, bits_required(lb, ub)) + lb;
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, EIGHT_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }	
@@ -761,7 +836,7 @@ char *decodeSemiConstrainedOctetString(packedDecode *memBuf) {
   len = decodeUnsignedSemiConstrainedInteger(memBuf, 0);
   
   // add room for string plus null terminator
-  if ((s = (char *)malloc(len + 1)) == NULL) {
+  if ((s = alloc_string(memBuf, len, EIGHT_BIT)) == NULL) {
     alert("Failed to allocate memory for string.");
     return NULL;      
   }  
@@ -823,7 +898,7 @@ signed long int decodeUnconstrainedInteger(packedDecode *memBuf) {
     return n32;
   } else {
     alert("Invalid integer prefix.");
-    longjmp(decode_exception_env, DECODE_INVALID_PREFIX);
+    longjmp(memBuf->env, DECODE_INVALID_PREFIX);
   }
 
   // dummy return
@@ -869,7 +944,7 @@ signed long int decodeUnsignedSemiConstrainedInteger(packedDecode *memBuf, signe
     n = (unsigned long)decode(memBuf, 32);
   } else {
     alert("Invalid integer prefix.");
-    longjmp(decode_exception_env, DECODE_INVALID_PREFIX);
+    longjmp(memBuf->env, DECODE_INVALID_PREFIX);
   }
 
   dbg("n: %lu, lb: %ld", n, lb);
@@ -880,13 +955,27 @@ signed long int decodeUnsignedSemiConstrainedInteger(packedDecode *memBuf, signe
 
 void encodeUnsignedConstrainedInteger(packedEncode *memBuf, signed long int n, signed long int lb, signed long int ub)
 {
-  int bits = bits_required(lb, ub);
-  encode(memBuf, (unsigned long)(n - lb), bits);
+  encodeConstrainedWholeNumber(memBuf, n, lb, bits_required(lb, ub));
 }
 
 signed long int decodeUnsignedConstrainedInteger(packedDecode *memBuf, signed long int lb, signed long int ub)
 {
-  return (decode(memBuf, (unsigned long)bits_required(lb, ub)) + lb);
+  return (decodeConstrainedWholeNumber(memBuf, lb, bits_required(lb, ub)));
+}
+
+int bitsRequired(signed long int lb, signed long int ub)
+{
+  return (bits_required(lb, ub));
+}
+
+void encodeConstrainedWholeNumber(packedEncode *memBuf, signed long int n, signed long int lb, int bits)
+{
+  encode(memBuf, (unsigned long)(n - lb), bits);
+}
+
+signed long int decodeConstrainedWholeNumber(packedDecode *memBuf, signed long int lb, int bits)
+{
+  return (decode(memBuf, bits) + lb);
 }
 
 
@@ -930,6 +1019,41 @@ int decodeSequenceOfLength(packedDecode *memBuf) {
   return (decodeUnsignedSemiConstrainedInteger(memBuf, 0));
 }
 
+int minimumBits(int type, int variant, int length, int items, int children)
+{
+  switch (type) {
+  case UNKNOWN_TYPE:
+  case NULL_TYPE:
+    return 0;
+  case SEQUENCE_TYPE:
+    return children;
+  case SEQUENCE_OPTIONAL_TYPE:
+    // the bitmap, every child may be absent
+    return items;
+  default:
+    // a length, an index or a value of at least one bit
+    if ((variant == FIXED_LENGTH) && (length == 0)) return 0;
+    return 1;
+  }
+}
+
+/* 
+ * a count is only believed while the rest of the pdu could hold that
+ * many items, so a lying count fails before anything is built for it
+ */
+void checkItemCount(packedDecode *memBuf, unsigned long int len, int bits)
+{
+  if (bits <= 0) {
+    if (len > MAX_EMPTY_ITEMS) {
+      alert("Sequence of %lu empty items is out of range.", len);
+      longjmp(memBuf->env, DECODE_DOCUMENT_FAILED);
+    }
+  } else if (len > (unsigned long long)bits_left(memBuf) / bits) {
+    alert("Sequence of %lu items runs past the end of the PDU.", len);
+    longjmp(memBuf->env, DECODE_PDU_TRUNCATED);
+  }
+}
+
 // string interface for convenience
 void encodeDecimal(packedEncode *memBuf, char *n)
 {
@@ -960,32 +1084,51 @@ void encodeCurrency(packedEncode *memBuf, char *n)
   y = round(x * 100);
   dbg("y:%ld", y);
 
-  encodeUnsignedSemiConstrainedInteger(memBuf, y, 0);  
+  encodeCurrencyCents(memBuf, y);
   
 } 
 
+// value in cents as it is held in the pdu
+void encodeCurrencyCents(packedEncode *memBuf, unsigned long int cents)
+{
+  encodeUnsignedSemiConstrainedInteger(memBuf, cents, 0);
+}
+
+// value in cents as it is held in the pdu
+unsigned long int decodeCurrencyCents(packedDecode *memBuf)
+{
+  return (decodeUnsignedSemiConstrainedInteger(memBuf, 0));
+}
+
+char *currencyString(char *buf, int size, unsigned long int cents)
+{
+  double y = 0.0;
+
+  dbg("x:%lu", cents);
+  y = cents;
+  // restore 2 dp
+  y = y/100;
+  dbg("y:%f", y);
+  snprintf(buf, size, "%.2f", y);
+
+  return buf;
+}
+
 // string interface for convenience
 char *decodeCurrency(packedDecode *memBuf)
 {
   char *n = NULL;
   unsigned long int x = 0;
-  double y = 0.0;
 
   // allocating on heap to be consistent with other string functions
-  if ((n = (char *)malloc(12)) == NULL) {
+  if ((n = decodeAlloc(memBuf, CURRENCY_CHARS)) == NULL) {
     alert("Insufficient memory.");
     return NULL;
   }
-  x = decodeUnsignedSemiConstrainedInteger(memBuf, 0);
-  dbg("x:%lu", x);
-  y = x;
-  // restore 2 dp
-  y = y/100;
-  dbg("y:%f", y);
-  sprintf(n, "%.2f", y);
+  x = decodeCurrencyCents(memBuf);
 
   // needs to be freed
-  return n;
+  return currencyString(n, CURRENCY_CHARS, x);
 }
 
 
@@ -998,34 +1141,55 @@ void encodeIPv4Address(packedEncode *memBuf, char *dottedquad)
   if(!inet_pton(AF_INET, dottedquad, &addr)) {
     alert("Could not convert address");
   }
-  dbg("ip:%u", addr.s_addr);
-  // covers the valid range
-  encodeUnsignedConstrainedInteger(memBuf, addr.s_addr, 1, 4294967263);  
+  encodeIPv4AddressValue(memBuf, addr.s_addr);
   
 } 
 
+// address in network byte order like struct in_addr
+void encodeIPv4AddressValue(packedEncode *memBuf, uint32_t s_addr)
+{
+
+  dbg("ip:%u", s_addr);
+  // covers the valid range
+  encodeUnsignedConstrainedInteger(memBuf, s_addr, 1, 4294967263);  
+  
+}
+
+// address in network byte order like struct in_addr
+uint32_t decodeIPv4AddressValue(packedDecode *memBuf)
+{
+  uint32_t s_addr;
+
+  // covers the valid range value
+  s_addr = decodeUnsignedConstrainedInteger(memBuf, 1, 4294967263);
+  dbg("ip:%u", s_addr);
+
+  return s_addr;
+}
+
+char *ipv4AddressString(char *buf, int size, uint32_t s_addr)
+{
+  if(inet_ntop(AF_INET, &s_addr, buf, size) == NULL) {
+    alert("Invalid IP address.");
+  }  
+  dbg("dotted quad:%s", buf);
+
+  return buf;
+}
+
 // string interface for convenience
 char *decodeIPv4Address(packedDecode *memBuf)
 {
   char *ip = NULL;
-  struct in_addr addr;
-    
   
   // allocating on heap to be consistent with other string functions
-  if ((ip = (char *)malloc(16)) == NULL) {
+  if ((ip = decodeAlloc(memBuf, IPV4_ADDRESS_CHARS)) == NULL) {
     alert("Insufficient memory.");
     return NULL;
   }
-  // covers the valid range value
-  addr.s_addr = decodeUnsignedConstrainedInteger(memBuf, 1, 4294967263);
-  dbg("ip:%u", addr.s_addr);
-  if(inet_ntop(AF_INET, &addr.s_addr, ip, 16) == NULL) {
-    alert("Invalid IP address.");
-  }  
-  dbg("dotted quad:%s", ip);
   
   // needs to be freed
-  return ip;
+  return ipv4AddressString(ip, IPV4_ADDRESS_CHARS, decodeIPv4AddressValue(memBuf));
 }
 
 // utility function
@@ -1077,8 +1241,7 @@ static time_t rfc3339string_to_epoch(const char *timestring)
     return t;
 }
 
-// utility function
-static char *epoch_to_rfc3339string(char *buf, int size, time_t t)
+char *unixTimeString(char *buf, int size, time_t t)
 {
   const char *format = "%FT%TZ";
   
@@ -1095,26 +1258,38 @@ void encodeUnixTime(packedEncode *memBuf, char *timestring)
   time_t t;
 
   t =  rfc3339string_to_epoch(timestring);
+  encodeUnixTimeValue(memBuf, t);
+}
+
+void encodeUnixTimeValue(packedEncode *memBuf, time_t t)
+{
+
   dbg("epoch:%ld", (long)t);
   // we are assuming time_t is signed
   encodeUnsignedConstrainedInteger(memBuf, (long)t, INT_MIN, INT_MAX);
 }
 
+time_t decodeUnixTimeValue(packedDecode *memBuf)
+{
+  time_t t;
+
+  // we are assuming time_t is signed
+  t = (time_t)decodeUnsignedConstrainedInteger(memBuf, INT_MIN, INT_MAX);
+  dbg("epoch:%ld", (long)t);
+
+  return t;
+}
+
 char *decodeUnixTime(packedDecode *memBuf)
 {
   char *timestring = NULL;
-  time_t t;
-    
   
   // allocating on heap to be consistent with other string functions
-  if ((timestring = (char *)malloc(30)) == NULL) {
+  if ((timestring = decodeAlloc(memBuf, UNIX_TIME_CHARS)) == NULL) {
     alert("Insufficient memory.");
     return NULL;
   }
-  // we are assuming time_t is signed
-  t = (time_t)decodeUnsignedConstrainedInteger(memBuf, INT_MIN, INT_MAX);
-  dbg("epoch:%ld", (long)t);
-  epoch_to_rfc3339string(timestring, 30, t);
+  unixTimeString(timestring, UNIX_TIME_CHARS, decodeUnixTimeValue(memBuf));
   dbg("timestring:%s", timestring);
   
   // needs to be freed
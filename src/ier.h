@@ -1,9 +1,17 @@
 #ifndef IER_H_
 #define IER_H_
 
+#include <stdint.h>
+#include <time.h>
+
 #include "encode.h"
 #include "decode.h"
 
+// room needed to format the typed values below
+#define CURRENCY_CHARS 24
+#define IPV4_ADDRESS_CHARS 16
+#define UNIX_TIME_CHARS 30
+
 void encodeBoolean(packedEncode *memBuf, int flag);
 int decodeBoolean(packedDecode *memBuf);
 
@@ -61,6 +69,11 @@ signed long int decodeUnsignedConstrainedInteger(packedDecode *memBuf, signed lo
 void encodeUnsignedSemiConstrainedInteger(packedEncode *memBuf, signed long int n, signed long int lb);
 signed long int decodeUnsignedSemiConstrainedInteger(packedDecode *memBuf, signed long int lb);
 
+// width precomputed by the caller with bitsRequired
+int bitsRequired(signed long int lb, signed long int ub);
+void encodeConstrainedWholeNumber(packedEncode *memBuf, signed long int n, signed long int lb, int bits);
+signed long int decodeConstrainedWholeNumber(packedDecode *memBuf, signed long int lb, int bits);
+
 void encodeEnumerated(packedEncode *memBuf, unsigned long int n, unsigned len);
 unsigned long int decodeEnumerated(packedDecode *memBuf, unsigned len);
 
@@ -74,21 +87,38 @@ unsigned long int decodeChoiceIndex(packedDecode *memBuf, unsigned len);
 void encodeSequenceOfLength(packedEncode *memBuf, int len);
 int decodeSequenceOfLength(packedDecode *memBuf);
 
+// items that take no bits at all are only taken on trust this far
+#define MAX_EMPTY_ITEMS 65536
+
+// least bits a node of type can encode to, children being its childrens' sum
+int minimumBits(int type, int variant, int length, int items, int children);
+// refuse a count of items of bits each that the rest of the pdu can not hold
+void checkItemCount(packedDecode *memBuf, unsigned long int len, int bits);
+
 // string interface for convenience
 void encodeDecimal(packedEncode *memBuf, char *n);
 char *decodeDecimal(packedDecode *memBuf);
 
 // string interface for convenience
 void encodeCurrency(packedEncode *memBuf, char *n);
+void encodeCurrencyCents(packedEncode *memBuf, unsigned long int cents);
 char *decodeCurrency(packedDecode *memBuf);
+unsigned long int decodeCurrencyCents(packedDecode *memBuf);
+char *currencyString(char *buf, int size, unsigned long int cents);
 
 // string interface
 void encodeIPv4Address(packedEncode *memBuf, char *dottedquad);
+void encodeIPv4AddressValue(packedEncode *memBuf, uint32_t s_addr);
 char *decodeIPv4Address(packedDecode *memBuf);
+uint32_t decodeIPv4AddressValue(packedDecode *memBuf);
+char *ipv4AddressString(char *buf, int size, uint32_t s_addr);
 
 // string interface
 void encodeUnixTime(packedEncode *memBuf, char *timestring);
+void encodeUnixTimeValue(packedEncode *memBuf, time_t t);
 char *decodeUnixTime(packedDecode *memBuf);
+time_t decodeUnixTimeValue(packedDecode *memBuf);
+char *unixTimeString(char *buf, int size, time_t t);
 
 
 #endif
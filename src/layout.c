@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+
+/*
+ * a field per element of the schema, each in a slot the size of a long.
+ * fixed length strings are held in place and the rest are pointers. every
+ * sequence-of starts a new item and the size of the items so far is returned
+ */
+size_t layout_struct(planNode *plan, char *path, po_field *fields, int *n, size_t offset)
+{
+  size_t len = strlen(path);
+  size_t item = 0;
+  po_field *f = NULL;
+  int i;
+
+  if ((*n > MAX_FIELDS - 2) || (len + xmlStrlen(plan->name) + 2 > MAX_PATH)) {
+    printf("Failed to run: schema is too big to lay out\n");
+    exit(EXIT_FAILURE);
+  }
+  strcat(strcat(path, "/"), (const char *)plan->name);
+  if (plan->parent && (plan->parent->type == SEQUENCE_OPTIONAL_TYPE)) {
+    f = &fields[(*n)++];
+    memset(f, 0, sizeof(po_field));
+    f->path = strdup(path);
+    f->kind = PO_FLAG;
+    f->offset = offset;
+    offset += sizeof(long);
+  }
+  f = &fields[*n];
+  memset(f, 0, sizeof(po_field));
+  f->path = strdup(path);
+  f->offset = offset;
+  switch (plan->type) {
+  case SEQUENCE_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+  case NULL_TYPE:
+    f = NULL;
+    break;
+  case SEQUENCE_OF_TYPE:
+    f->kind = PO_ARRAY;
+    f->count_offset = offset + sizeof(long);
+    offset += 2 * sizeof(long);
+    break;
+  case CHOICE_TYPE:
+    f->kind = PO_CHOICE;
+    offset += sizeof(long);
+    break;
+  case INTEGER_TYPE:
+  case BOOLEAN_TYPE:
+  case ENUMERATED_TYPE:
+  case CURRENCY_TYPE:
+  case IPV4_ADDRESS_TYPE:
+  case UNIX_TIME_TYPE:
+    f->kind = PO_LONG;
+    offset += sizeof(long);
+    break;
+  default:
+    if ((plan->variant == FIXED_LENGTH) && (plan->length < 4 * sizeof(long))) {
+      f->kind = PO_CHARS;
+      f->size = 8 * sizeof(long);
+      offset += f->size;
+    } else {
+      f->kind = PO_STRING;
+      offset += sizeof(long);
+    }
+  }
+  if (f) {
+    (*n)++;
+  } else {
+    free((char *)fields[*n].path);
+  }
+  for (i = 0; i < plan->nchildren; i++) {
+    if (plan->type == SEQUENCE_OF_TYPE) {
+      item = layout_struct(plan->children[i], path, fields, n, item);
+    } else {
+      offset = layout_struct(plan->children[i], path, fields, n, offset);
+    }
+  }
+  if (plan->type == SEQUENCE_OF_TYPE) {
+    f->size = (item) ? item : 1;
+  }
+  path[len] = '\0';
+
+  return offset;
+}
@@ -0,0 +1,13 @@
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include "packedobjects.h"
+
+// limits of the struct laid out for a schema
+#define MAX_FIELDS 1024
+#define MAX_PATH 4096
+
+// a struct for the whole schema as used by packedobjects-bench and packedobjects-check
+size_t layout_struct(planNode *plan, char *path, po_field *fields, int *n, size_t offset);
+
+#endif
@@ -8,6 +8,7 @@
 
 static int verbose_flag;
 static int fast_flag;
+static int inline_flag;
 
 static void file_encode(packedobjectsContext *pc, const char *infile, const char *outfile, int loop);
 static void file_decode(packedobjectsContext *pc, const char *infile, const char *outfile, int loop);
@@ -17,17 +18,14 @@ static const char *get_filename_ext(const char *filename);
 
 static void file_encode(packedobjectsContext *pc, const char *infile, const char *outfile, int loop)
 {
-  xmlDocPtr doc = NULL;
   char *pdu = NULL;
   FILE *fp = NULL;
   int i;
 
   // looping all file handling
   for (i=0; i<loop; i++) {
-    if ((doc = packedobjects_new_doc(infile)) == NULL) {
-      exit_with_message("did not find .xml file");
-    }
-    pdu = packedobjects_encode(pc, doc);
+    // streamed straight from the file without building a tree
+    pdu = packedobjects_encode_file(pc, infile);
     if (pc->bytes == -1) {
       fprintf(stderr, "Failed to encode with error %d.\n", pc->encode_error);
       exit(EXIT_FAILURE);
@@ -35,7 +33,6 @@ static void file_encode(packedobjectsContext *pc, const char *infile, const char
     fp = fopen(outfile, "w");
     fwrite(pdu, 1, pc->bytes, fp);
     fclose(fp);
-    xmlFreeDoc(doc);
   }
 }
 
@@ -56,7 +53,7 @@ static void file_decode(packedobjectsContext *pc, const char *infile, const char
     if (bytes==MAX_PDU) {
       exit_with_message(".po too large for MAX_PDU");
     }
-    doc = packedobjects_decode(pc, pdu);
+    doc = packedobjects_decode_n(pc, pdu, bytes);
     if (pc->decode_error) {
       fprintf(stderr, "Failed to decode with error %d.\n", pc->decode_error);
       exit(EXIT_FAILURE);
@@ -72,6 +69,7 @@ static void file_decode(packedobjectsContext *pc, const char *infile, const char
 static void print_usage(void)
 {
   printf("usage: packedobjects --schema <file> --in <file> --out <file>\n");
+  printf("       packedobjects --schema <file> --compile <file.poc>\n");
   exit(EXIT_SUCCESS);
 }
 
@@ -97,6 +95,8 @@ int main(int argc, char **argv)
   const char *out_file = NULL;
   const char *in_file_ext = NULL;
   const char *out_file_ext = NULL;
+  const char *compile_file = NULL;
+  int options = 0;
   int loop = 1;
   
   while(1) {
@@ -104,16 +104,18 @@ int main(int argc, char **argv)
       {
         {"verbose", no_argument,       &verbose_flag, 1},
         {"fast", no_argument,       &fast_flag, 1},
+        {"inline", no_argument,       &inline_flag, 1},
         {"help",  no_argument, 0, 'h'},
         {"schema",  required_argument, 0, 's'},
         {"in",  required_argument, 0, 'i'},
         {"out",  required_argument, 0, 'o'},
         {"loop",  required_argument, 0, 'l'},
+        {"compile",  required_argument, 0, 'c'},
         {0, 0, 0, 0}
       };
     int option_index = 0;
     
-    c = getopt_long (argc, argv, "hs:i:o:l:?", long_options, &option_index);
+    c = getopt_long (argc, argv, "hs:i:o:l:c:?", long_options, &option_index);
     
     if (c == -1) break;
     
@@ -145,6 +147,10 @@ int main(int argc, char **argv)
       case 'l':
         loop = atoi(optarg);
         break;
+
+      case 'c':
+        compile_file = optarg;
+        break;
         
       case '?':
         print_usage();
@@ -157,20 +163,39 @@ int main(int argc, char **argv)
 
   // do some simple checking
   if (!schema_file) exit_with_message("did not specify --schema file");
-  if (!in_file) exit_with_message("did not specify --in file");
-  if (!out_file) exit_with_message("did not specify --out file");
+  if (!compile_file) {
+    if (!in_file) exit_with_message("did not specify --in file");
+    if (!out_file) exit_with_message("did not specify --out file");
+  }
   
   // initialise packedobjects
   if (fast_flag) {
     if (verbose_flag) printf("running without any validation.\n");
-    pc = init_packedobjects(schema_file, 0, NO_SCHEMA_VALIDATION | NO_DATA_VALIDATION);
+    options = NO_SCHEMA_VALIDATION | NO_DATA_VALIDATION;
+  } else if (inline_flag) {
+    if (verbose_flag) printf("validating data while encoding and decoding.\n");
+    options = INLINE_VALIDATION;
+  }
+  // a compiled schema skips all the XSD processing
+  if (!strcmp(get_filename_ext(schema_file), "poc")) {
+    if (verbose_flag) printf("loading compiled schema.\n");
+    pc = init_packedobjects_from_compiled(schema_file, 0, options);
   } else {
-    pc = init_packedobjects(schema_file, 0, 0);
+    pc = init_packedobjects(schema_file, 0, options);
   }
 
   if (pc == NULL) {
     exit_with_message("failed to initialise libpackedobjects");    
   }
+
+  if (compile_file) {
+    if (packedobjects_write_compiled(pc->schema, compile_file) == -1) {
+      exit_with_message("failed to write compiled schema");
+    }
+    free_packedobjects(pc);
+    xmlCleanupParser();
+    return EXIT_SUCCESS;
+  }
   
   // check file endings to determine if encode or decode
   in_file_ext = get_filename_ext(in_file);
@@ -185,5 +210,6 @@ int main(int argc, char **argv)
 
   // free packedobjects
   free_packedobjects(pc);
+  xmlCleanupParser();
   return EXIT_SUCCESS;
 }
@@ -7,32 +7,19 @@
 #include <libxml/xmlschemastypes.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 
 #include "config.h"
 
-#include "ier.h"
+#include "core.h"
 
 enum STRING_TYPES { STRING, BIT_STRING, NUMERIC_STRING, HEX_STRING, OCTET_STRING };
 
-enum ERROR_CODES {
-  INIT_FAILED = 100,
-  INIT_SCHEMA_SETUP_FAILED,
-  INIT_ENCODE_SETUP_FAILED,
-  INIT_SCHEMA_VALIDATION_FAILED,
-  INIT_SETUP_VALIDATION_FAILED,
-  INIT_EXPANDED_SCHEMA_FAILED,
-  INIT_CANON_SCHEMA_FAILED,
-  INIT_XPATH_SETUP_FAILED,
-  ENCODE_VALIDATION_FAILED,
-  ENCODE_PDU_BUFFER_FULL,
-  ENCODE_XPATH_QUERY_FAILED,
-  DECODE_VALIDATION_FAILED,
-  DECODE_INVALID_PREFIX,
-};
-
 enum INIT_OPTION {
   NO_SCHEMA_VALIDATION = 1,
   NO_DATA_VALIDATION = 2,
+  DECODE_STRING_ARENA = 4,
+  INLINE_VALIDATION = 8,
 };
   
 typedef struct {
@@ -41,23 +28,73 @@ typedef struct {
   xmlSchemaValidCtxtPtr validCtxt;
 } schemaData;
 
+// compiled form of the canonical schema walked by the encoder and decoder
+typedef struct planNode {
+  const xmlChar *name;
+  xmlNodePtr schema_node;
+  struct planNode *parent;
+  struct planNode **children;
+  int nchildren;
+  int type;
+  int variant;
+  // facets resolved once from the canonical schema
+  signed long int lb;
+  signed long int ub;
+  int length;
+  int items;
+  int bits;
+  int unbounded;
+  // an integer with a maxInclusive but no minInclusive
+  int has_max;
+  // least bits the node can encode to, bounding sequence-of counts
+  int min_bits;
+  const xmlChar **enumeration;
+} planNode;
+
+// read-only compiled form of a schema which any number of contexts may share
 typedef struct {
-  xmlDoc *doc_data;
   xmlDoc *doc_schema;
   xmlDoc *doc_expanded_schema;
   xmlDoc *doc_canonical_schema;
   schemaData *schemap;
-  xmlXPathContextPtr xpathp;
+  planNode *plan;
+  // element names shared by every decoded document
+  xmlDictPtr dict;
   xmlHashTablePtr udt;
   const xmlChar *start_element_name;
+  // the same for any two schemas that encode alike
+  uint64_t hash;
+  // a mapped compiled schema, which leaves the documents above NULL
+  void *compiled;
+  size_t compiled_size;
+  int init_options;
+  int refs;
+} packedobjectsSchema;
+
+typedef struct {
+  xmlDoc *doc_data;
+  packedobjectsSchema *schema;
+  // borrowed from the schema
+  planNode *plan;
+  xmlSchemaValidCtxtPtr validCtxt;
   packedEncode *encodep;
   packedDecode *decodep;
+  // this thread's view of the schema's names, shared by the documents it decodes
+  xmlDictPtr dict;
+  // holds the bits of a container while the streaming encoder counts its children
+  packedEncode **scratch;
+  int nscratch;
+  // reused by each decode to text
+  char *text;
+  size_t text_size;
   size_t pdu_size;
   int bytes;
   int init_options;
   int init_error;
   int encode_error;
   int decode_error;
+  // fields set by packedobjects_register_struct
+  struct structBinding *binding;
 } packedobjectsContext;
 
 
@@ -70,6 +107,8 @@ void packedobjects_dump_doc_to_file(const char *fname, xmlDoc *doc);
 #include "packedobjects_init.h"
 #include "packedobjects_encode.h"
 #include "packedobjects_decode.h"
+#include "packedobjects_parallel.h"
+#include "packedobjects_struct.h"
 
 
 #endif
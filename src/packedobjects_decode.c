@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <setjmp.h>
 #include <string.h>
+#include <limits.h>
+#include <arpa/inet.h>
 
 #include "packedobjects_decode.h"
 
@@ -20,224 +22,288 @@
 
 #define CHECK_BIT(var,pos) ((var) & (1<<(pos)))
 
-// exception handling
-jmp_buf decode_exception_env;
+// starting size of the text buffer, it grows as needed
+#define TEXT_BYTES 1024
+
+// where the decoded elements go, either a tree or xml text
+typedef struct decodeOut decodeOut;
+struct decodeOut {
+  void (*start)(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+  void (*value)(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value);
+  void (*end)(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+  // typed values, formatted and passed to value when these are NULL
+  void (*integer)(packedobjectsContext *pc, decodeOut *out, planNode *plan, signed long int n);
+  void (*boolean)(packedobjectsContext *pc, decodeOut *out, planNode *plan, int b);
+  void (*enumerated)(packedobjectsContext *pc, decodeOut *out, planNode *plan, int index);
+  void (*currency)(packedobjectsContext *pc, decodeOut *out, planNode *plan, unsigned long int cents);
+  void (*ipv4_address)(packedobjectsContext *pc, decodeOut *out, planNode *plan, uint32_t s_addr);
+  void (*unix_time)(packedobjectsContext *pc, decodeOut *out, planNode *plan, time_t t);
+  // tree: the element being filled
+  xmlNodePtr node;
+  // text: bytes used and whether a start tag still needs closing
+  size_t len;
+  int open;
+  // events: the caller's callbacks
+  const po_handler *handler;
+  void *user;
+  // struct: the field being filled and the struct or item it is in
+  const po_field *field;
+  char *base;
+};
+
+static xmlDocPtr tree_new_doc(packedobjectsContext *pc);
+static xmlNodePtr tree_new_node(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value);
+static void tree_start(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void tree_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value);
+static void tree_end(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void text_write(packedobjectsContext *pc, decodeOut *out, const char *s, size_t n);
+static void text_escape(packedobjectsContext *pc, decodeOut *out, const xmlChar *value);
+static void text_start(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void text_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value);
+static void text_end(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void packedobjects_validate_text(packedobjectsContext *pc, const char *text, int len);
+static void event_start(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void event_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value);
+static void event_end(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void event_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan, signed long int n);
+static void event_boolean(packedobjectsContext *pc, decodeOut *out, planNode *plan, int b);
+static void event_enumerated(packedobjectsContext *pc, decodeOut *out, planNode *plan, int index);
+static void event_currency(packedobjectsContext *pc, decodeOut *out, planNode *plan, unsigned long int cents);
+static void event_ipv4_address(packedobjectsContext *pc, decodeOut *out, planNode *plan, uint32_t s_addr);
+static void event_unix_time(packedobjectsContext *pc, decodeOut *out, planNode *plan, time_t t);
+static void emit_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan, signed long int n);
+static void struct_store(packedobjectsContext *pc, decodeOut *out, signed long int n);
+static void struct_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value);
+static void struct_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan, signed long int n);
+static void struct_boolean(packedobjectsContext *pc, decodeOut *out, planNode *plan, int b);
+static void struct_enumerated(packedobjectsContext *pc, decodeOut *out, planNode *plan, int index);
+static void struct_currency(packedobjectsContext *pc, decodeOut *out, planNode *plan, unsigned long int cents);
+static void struct_ipv4_address(packedobjectsContext *pc, decodeOut *out, planNode *plan, uint32_t s_addr);
+static void struct_unix_time(packedobjectsContext *pc, decodeOut *out, planNode *plan, time_t t);
+static void struct_node(packedobjectsContext *pc, decodeOut *out, structNode *sn, char *base);
 
 static void packedobjects_validate_decode(packedobjectsContext *poCtxPtr, xmlDocPtr doc);
 
-static void decode_next(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_node(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_boolean(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_sequence(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_sequence_of(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_sequence_optional(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_unconstrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_semi_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void decode_semi_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void decode_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void decode_fixed_length_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void decode_decimal(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_null(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_currency(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_enumerated(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_choice(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_ipv4address(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_unix_time(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void decode_utf8_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
+static void inline_check(packedobjectsContext *pc, planNode *plan, int ok);
+static void inline_check_value(packedobjectsContext *pc, planNode *plan, xmlChar *value);
+static void decode_next(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_node(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_boolean(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_sequence(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static unsigned long decode_sequence_of_len(packedobjectsContext *pc, planNode *plan);
+static void decode_sequence_of(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_sequence_optional(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_unconstrained_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_semi_constrained_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_constrained_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type);
+static void decode_semi_constrained_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type);
+static void decode_constrained_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type);
+static void decode_fixed_length_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type);
+static void decode_decimal(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_null(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_currency(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_enumerated(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_choice(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_ipv4address(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_unix_time(packedobjectsContext *pc, decodeOut *out, planNode *plan);
+static void decode_utf8_string(packedobjectsContext *pc, decodeOut *out, planNode *plan);
 
 
 void packedobjects_validate_decode(packedobjectsContext *poCtxPtr, xmlDocPtr doc)
 {
   int result;
-  schemaData *schemap = poCtxPtr->schemap;
   
-  result = xmlSchemaValidateDoc(schemap->validCtxt, doc);
+  result = xmlSchemaValidateDoc(poCtxPtr->validCtxt, doc);
   if (result) {
     alert("Failed to validate XSD schema.");
-    longjmp(decode_exception_env, DECODE_VALIDATION_FAILED);
+    longjmp(poCtxPtr->decodep->env, DECODE_VALIDATION_FAILED);
   }  
 
 }
 
-static void decode_boolean(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+/*
+ * the walk follows the plan so the structure is always right, but a PDU
+ * can still hold numbers and lengths beyond what the facets allow
+ */
+static void inline_check(packedobjectsContext *pc, planNode *plan, int ok)
+{
+  
+  if (!ok && (pc->init_options & INLINE_VALIDATION)) {
+    alert("%s does not meet its facets in schema.", plan->name);
+    longjmp(pc->decodep->env, DECODE_VALIDATION_FAILED);
+  }
+  
+}
+
+// value is a decoded string which is released if it fails
+static void inline_check_value(packedobjectsContext *pc, planNode *plan, xmlChar *value)
+{
+
+  if ((pc->init_options & INLINE_VALIDATION) && (facets_check_value(plan, value) == -1)) {
+    decodeRelease(pc->decodep, value);
+    inline_check(pc, plan, 0);
+  }
+  
+}
+
+static void decode_boolean(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
   int result;
 
   result = decodeBoolean(pc->decodep);
   dbg("boolean:%d", result);
 
-  
-  if (result) {
-    xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST "true");    
+  if (out->boolean) {
+    out->boolean(pc, out, plan, result);
+  } else if (result) {
+    out->value(pc, out, plan, BAD_CAST "true");    
   } else {
-    xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST "false");
+    out->value(pc, out, plan, BAD_CAST "false");
   }
-
-  decode_next(pc, data_node, schema_node->children); 
 }
 
-static void decode_null(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_null(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
   dbg("null");
 
-  xmlNewChild(data_node, NULL, schema_node->name, NULL);    
-
-  decode_next(pc, data_node, schema_node->children); 
+  out->value(pc, out, plan, NULL);    
 }
 
 
-static void decode_sequence(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_sequence(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
-  xmlNodePtr np = NULL;
-  
-  np = xmlAddChild(data_node, xmlCopyNode(schema_node, 0));
-  decode_next(pc, np, schema_node->children); 
+
+  out->start(pc, out, plan);
+  decode_next(pc, out, plan); 
+  out->end(pc, out, plan);
   
 }
 
-static void decode_sequence_of(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+// how many times the children repeat
+static unsigned long decode_sequence_of_len(packedobjectsContext *pc, planNode *plan)
 {
-  xmlNodePtr np = NULL;
-  unsigned long i, len;
-  xmlChar *minOccurs = NULL;
-  xmlChar *maxOccurs = NULL;
-  unsigned long lb = 0;
-
-  minOccurs = xmlGetProp(schema_node, BAD_CAST "minOccurs");
-  maxOccurs = xmlGetProp(schema_node, BAD_CAST "maxOccurs");
-  // overide default of 0 if set
-  if (minOccurs) lb = atoi((const char *) minOccurs);  
-  dbg("lb:%lu", lb);
-  if (xmlStrEqual(maxOccurs, BAD_CAST "unbounded")) {
+  unsigned long len;
+
+  dbg("lb:%ld", plan->lb);
+  if (plan->unbounded) {
      // decode as semi-constrained
-    len = decodeUnsignedSemiConstrainedInteger(pc->decodep, lb);
+    len = decodeUnsignedSemiConstrainedInteger(pc->decodep, plan->lb);
   } else {
     // decode as constrained
-    unsigned long ub = atoi((const char *) maxOccurs);
-    dbg("ub:%lu", ub);
-    len = decodeUnsignedConstrainedInteger(pc->decodep, lb, ub);
-  }
-  xmlFree(minOccurs);
-  xmlFree(maxOccurs);  
-  dbg("sequence_of len:%d", len);
-  np = xmlAddChild(data_node, xmlCopyNode(schema_node, 0));
+    dbg("ub:%ld", plan->ub);
+    len = decodeConstrainedWholeNumber(pc->decodep, plan->lb, plan->bits);
+  }
+  dbg("sequence_of len:%lu", len);
+  inline_check(pc, plan, plan->unbounded || (len <= plan->ub));
+  checkItemCount(pc->decodep, len, plan_item_bits(plan));
+
+  return len;
+}
+
+static void decode_sequence_of(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+  unsigned long i, len;
+
+  len = decode_sequence_of_len(pc, plan);
+  out->start(pc, out, plan);
   for (i=0; i<len; i++) {
-    decode_next(pc, np, schema_node->children); 
+    decode_next(pc, out, plan); 
   }
+  out->end(pc, out, plan);
   
 }
 
-static void decode_sequence_optional(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_sequence_optional(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
-  xmlNodePtr dp = NULL;
-  xmlNodePtr sp = NULL;
-  char *items;
-  unsigned long int n;
   unsigned long int bitmap;
   int i;
   
-  items = xmlGetProp(schema_node, BAD_CAST "items");
-  n = atoi((const char *) items);
-  dbg("n:%d", n);
-  bitmap = decodeBitmap(pc->decodep, n);
-  xmlFree(items);
+  dbg("n:%d", plan->items);
+  bitmap = decodeBitmap(pc->decodep, plan->items);
   dbg("bitmap:%lu", bitmap);
-  dp = xmlAddChild(data_node, xmlCopyNode(schema_node, 0));
-  sp = schema_node->children;
-  for (i=0; i<n; i++) {
+  out->start(pc, out, plan);
+  for (i=0; i<plan->items; i++) {
     if (CHECK_BIT(bitmap, i)) {
-      decode_node(pc, dp, sp);
+      decode_node(pc, out, plan->children[i]);
     }
-    sp = sp->next;
   }  
+  out->end(pc, out, plan);
   
 }
 
-static void decode_unconstrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_unconstrained_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
   signed long int n;
-  char value[12];
   
   n = decodeUnconstrainedInteger(pc->decodep);
   dbg("n:%ld", n);
-  sprintf(value, "%ld", n);
-  xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST value);    
-
-  decode_next(pc, data_node, schema_node->children);   
+  emit_integer(pc, out, plan, n);
 
 }
 
-static void decode_semi_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_semi_constrained_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
   signed long int n;
-  char value[12];
-  xmlChar *minInclusive = NULL;
-  int lb;
 
-  minInclusive = xmlGetProp(schema_node, BAD_CAST "minInclusive");
-  lb = atoi((const char *) minInclusive);
-  n = decodeUnsignedSemiConstrainedInteger(pc->decodep, lb);
+  n = decodeUnsignedSemiConstrainedInteger(pc->decodep, plan->lb);
   dbg("n:%ld", n);
-  sprintf(value, "%ld", n);
-  xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST value);    
-
-  xmlFree(minInclusive);
-  
-  decode_next(pc, data_node, schema_node->children);   
-  
+  emit_integer(pc, out, plan, n);
   
 }
 
-static void decode_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_constrained_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
   signed long int n;
-  char value[12];
-  xmlChar *minInclusive = NULL;
-  xmlChar *maxInclusive = NULL;
-  int lb, ub;
-
-  minInclusive = xmlGetProp(schema_node, BAD_CAST "minInclusive");
-  lb = atoi((const char *) minInclusive);
-  maxInclusive = xmlGetProp(schema_node, BAD_CAST "maxInclusive");
-  ub = atoi((const char *) maxInclusive); 
-  n = decodeUnsignedConstrainedInteger(pc->decodep, lb, ub);
-  dbg("n:%ld", n);
-  sprintf(value, "%ld", n);
-  xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST value);    
 
-  xmlFree(minInclusive);
-  xmlFree(maxInclusive);
-  
-  decode_next(pc, data_node, schema_node->children);   
+  n = decodeConstrainedWholeNumber(pc->decodep, plan->lb, plan->bits);
+  dbg("n:%ld", n);
+  emit_integer(pc, out, plan, n);
   
 }
 
-static void decode_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+// hand over an integer as is or as text
+static void emit_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan, signed long int n)
 {
-  xmlChar *variant = NULL;
+  char value[24];
 
-  variant = xmlGetProp(schema_node, BAD_CAST "variant");
-  if (xmlStrEqual(variant, BAD_CAST "unconstrained")) {
-    decode_unconstrained_integer(pc, data_node, schema_node);
-  } else if (xmlStrEqual(variant, BAD_CAST "semi-constrained")) {
-    decode_semi_constrained_integer(pc, data_node, schema_node);
-  } else if (xmlStrEqual(variant, BAD_CAST "constrained")) {
-    decode_constrained_integer(pc, data_node, schema_node);    
-  } else {
-    alert("Found an integer variant I can't decode.");    
+  if (pc->init_options & INLINE_VALIDATION) {
+    inline_check(pc, plan, facets_check_integer(plan, n) == 0);
+  }
+  if (out->integer) {
+    out->integer(pc, out, plan, n);
+    return;
   }
-  xmlFree(variant); 
+  sprintf(value, "%ld", n);
+  out->value(pc, out, plan, BAD_CAST value);    
+}
+
+static void decode_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+
+  switch (plan->variant) {
+  case UNCONSTRAINED:
+    decode_unconstrained_integer(pc, out, plan);
+    break;
+  case SEMI_CONSTRAINED:
+    decode_semi_constrained_integer(pc, out, plan);
+    break;
+  case CONSTRAINED:
+    decode_constrained_integer(pc, out, plan);
+    break;
+  default:
+    alert("Found an integer variant I can't decode.");
+  }
+
 }
 
 
-static void decode_semi_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void decode_semi_constrained_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type)
 {
 
   char *value = NULL;
@@ -260,24 +326,19 @@ static void decode_semi_constrained_string(packedobjectsContext *pc, xmlNodePtr
     break;  
   }
 
-  xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST value);    
-  free(value);
+  inline_check_value(pc, plan, BAD_CAST value);
+  out->value(pc, out, plan, BAD_CAST value);    
+  decodeRelease(pc->decodep, value);
   
 }
 
   
-static void decode_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void decode_constrained_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type)
 {
 
   char *value = NULL;
-  xmlChar *minLength = NULL;
-  xmlChar *maxLength = NULL;
-  int lb, ub;
-  
-  minLength = xmlGetProp(schema_node, BAD_CAST "minLength");
-  maxLength = xmlGetProp(schema_node, BAD_CAST "maxLength");
-  lb = atoi((const char *) minLength);
-  ub = atoi((const char *) maxLength);
+  int lb = plan->lb;
+  int ub = plan->ub;
   
   dbg("lb:%d, ub:%d", lb, ub);
   
@@ -299,22 +360,17 @@ static void decode_constrained_string(packedobjectsContext *pc, xmlNodePtr data_
     break;  
   }
 
-  xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST value);
-  xmlFree(minLength);
-  xmlFree(maxLength);
-  free(value);
+  inline_check_value(pc, plan, BAD_CAST value);
+  out->value(pc, out, plan, BAD_CAST value);
+  decodeRelease(pc->decodep, value);
   
 }
 
-static void decode_fixed_length_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void decode_fixed_length_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type)
 {
 
   char *value = NULL;
-  xmlChar *length = NULL;
-  int len;
-  
-  length = xmlGetProp(schema_node, BAD_CAST "length");
-  len = atoi((const char *) length);
+  int len = plan->length;
 
   dbg("len:%d", len);
   
@@ -336,235 +392,254 @@ static void decode_fixed_length_string(packedobjectsContext *pc, xmlNodePtr data
     break;  
   }
 
-  xmlNewChild(data_node, NULL, schema_node->name, BAD_CAST value);    
-  xmlFree(length);
-  free(value);
+  inline_check_value(pc, plan, BAD_CAST value);
+  out->value(pc, out, plan, BAD_CAST value);    
+  decodeRelease(pc->decodep, value);
   
 }
 
-static void decode_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void decode_string(packedobjectsContext *pc, decodeOut *out, planNode *plan, int type)
 {
 
-  xmlChar *variant = NULL;
-
-  variant = xmlGetProp(schema_node, BAD_CAST "variant");
-  if (xmlStrEqual(variant, BAD_CAST "semi-constrained")) {
-    decode_semi_constrained_string(pc, data_node, schema_node, type);
-  } else if (xmlStrEqual(variant, BAD_CAST "constrained")) {
-    decode_constrained_string(pc, data_node, schema_node, type);
-  } else if (xmlStrEqual(variant, BAD_CAST "fixed-length")) {
-    decode_fixed_length_string(pc, data_node, schema_node, type);
-  } else {
+  switch (plan->variant) {
+  case SEMI_CONSTRAINED:
+    decode_semi_constrained_string(pc, out, plan, type);
+    break;
+  case CONSTRAINED:
+    decode_constrained_string(pc, out, plan, type);
+    break;
+  case FIXED_LENGTH:
+    decode_fixed_length_string(pc, out, plan, type);
+    break;
+  default:
     alert("Found a string variant I can't decode.");
   }
-  xmlFree(variant);  
 
 }
 
 
-static void decode_decimal(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_decimal(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
   xmlChar *value = NULL;
 
   value = BAD_CAST decodeDecimal(pc->decodep);
-  xmlNewChild(data_node, NULL, schema_node->name, value);    
-  xmlFree(value);  
+  inline_check_value(pc, plan, value);
+  out->value(pc, out, plan, value);    
+  decodeRelease(pc->decodep, value);
   
 }
 
-static void decode_currency(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_currency(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
-  xmlChar *value = NULL;
+  unsigned long int cents;
+  char value[CURRENCY_CHARS];
 
-  value = BAD_CAST decodeCurrency(pc->decodep);
-  xmlNewChild(data_node, NULL, schema_node->name, value);  
-  xmlFree(value);
+  cents = decodeCurrencyCents(pc->decodep);
+  if (out->currency) {
+    out->currency(pc, out, plan, cents);
+    return;
+  }
+  currencyString(value, CURRENCY_CHARS, cents);
+  out->value(pc, out, plan, BAD_CAST value);  
 }
 
-static void decode_ipv4address(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_ipv4address(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
-  xmlChar *value = NULL;
+  uint32_t s_addr;
+  char value[IPV4_ADDRESS_CHARS];
 
-  value = BAD_CAST decodeIPv4Address(pc->decodep); 
-  xmlNewChild(data_node, NULL, schema_node->name, value);  
-  xmlFree(value);
+  s_addr = decodeIPv4AddressValue(pc->decodep); 
+  if (out->ipv4_address) {
+    out->ipv4_address(pc, out, plan, s_addr);
+    return;
+  }
+  ipv4AddressString(value, IPV4_ADDRESS_CHARS, s_addr);
+  out->value(pc, out, plan, BAD_CAST value);  
 }
 
-static void decode_unix_time(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_unix_time(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
-  xmlChar *value = NULL;
+  time_t t;
+  char value[UNIX_TIME_CHARS];
 
-  value = BAD_CAST decodeUnixTime(pc->decodep);
-  xmlNewChild(data_node, NULL, schema_node->name, value);  
-  xmlFree(value);
+  t = decodeUnixTimeValue(pc->decodep);
+  if (out->unix_time) {
+    out->unix_time(pc, out, plan, t);
+    return;
+  }
+  unixTimeString(value, UNIX_TIME_CHARS, t);
+  out->value(pc, out, plan, BAD_CAST value);  
 }
 
-static void decode_utf8_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_utf8_string(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
   xmlChar *value = NULL;
 
   value = BAD_CAST decodeSemiConstrainedOctetString(pc->decodep);
-  xmlNewChild(data_node, NULL, schema_node->name, value);  
-  xmlFree(value);
+  out->value(pc, out, plan, value);  
+  decodeRelease(pc->decodep, value);
 }
 
-static void decode_enumerated(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_enumerated(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
-  xmlChar *value = NULL;
-  xmlChar *items = NULL;
-  xmlNodePtr snp = NULL;
-  xmlAttrPtr attr = NULL;
-  unsigned long int n = 0;
-  int i = 0, index = 0;
+  int index = 0;
   
-  items = xmlGetProp(schema_node, BAD_CAST "items");
-  n = atoi((const char *) items);
-  xmlFree(items);
-  dbg("n:%lu", n);
-  index = decodeEnumerated(pc->decodep, n);
+  dbg("n:%d", plan->items);
+  index = decodeConstrainedWholeNumber(pc->decodep, 0, plan->bits);
   dbg("index:%d", index);
-  snp = schema_node;
-  for(attr = snp->properties; NULL != attr; attr = attr->next) {
-    if (xmlStrEqual(attr->name, BAD_CAST "enumeration")) {
-      if (i == index) {
-        value = xmlNodeListGetString(pc->doc_canonical_schema, attr->children, 1);
-        xmlNewChild(data_node, NULL, schema_node->name, value);  
-        xmlFree(value);
-        break;
-      }
-      i++;
-    }
+  inline_check(pc, plan, index < plan->items);
+  if (index >= plan->items) {
+    // nothing to report
+  } else if (out->enumerated) {
+    out->enumerated(pc, out, plan, index);
+  } else {
+    out->value(pc, out, plan, plan->enumeration[index]);  
   }
 }
 
-static void decode_choice(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_choice(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
-  xmlChar *items = NULL;
-  xmlNodePtr sp = NULL;
-  xmlNodePtr dp = NULL;
-  unsigned long int n = 0;
-  int i = 0, index = 0;
+  int index = 0;
   
-  items = xmlGetProp(schema_node, BAD_CAST "items");
-  n = atoi((const char *) items);
-  dbg("items:%s", items);
-  xmlFree(items);
-  index = decodeChoiceIndex(pc->decodep, n);
+  dbg("items:%d", plan->items);
+  index = decodeConstrainedWholeNumber(pc->decodep, 1, plan->bits);
   dbg("index:%d", index);
+  inline_check(pc, plan, (index >= 1) && (index <= plan->nchildren));
 
-  dp = xmlAddChild(data_node, xmlCopyNode(schema_node, 0));
-  sp = schema_node->children;
-  while (sp) {
-    i++;
-    dbg("snp->name:%s", sp->name);
-    if (i == index) {
-      decode_node(pc, dp, sp);
-      break;
-    }
-    sp = sp->next;
+  out->start(pc, out, plan);
+  if ((index >= 1) && (index <= plan->nchildren)) {
+    dbg("name:%s", plan->children[index-1]->name);
+    decode_node(pc, out, plan->children[index-1]);
   }
+  out->end(pc, out, plan);
 }
 
-static void decode_next(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_next(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
-  xmlNode *cur_node = NULL;
+  int i;
 
-  for (cur_node = schema_node; cur_node; cur_node = cur_node->next) {
-    if (cur_node->type == XML_ELEMENT_NODE) {
-      decode_node(pc, data_node, cur_node);
-    }
+  for (i = 0; i < plan->nchildren; i++) {
+    decode_node(pc, out, plan->children[i]);
   }
 }
 
-static void decode_node(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void decode_node(packedobjectsContext *pc, decodeOut *out, planNode *plan)
 {
 
-  xmlChar *type = NULL;
-  
-  type = xmlGetProp(schema_node, BAD_CAST "type");
-  dbg("type:%s", type);
+  dbg("type:%d", plan->type);
   
-  if (xmlStrEqual(type, BAD_CAST "integer")) {
-    decode_integer(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "string")) {
-    decode_string(pc, data_node, schema_node, STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "bit-string")) {
-    decode_string(pc, data_node, schema_node, BIT_STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "numeric-string")) {
-    decode_string(pc, data_node, schema_node, NUMERIC_STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "hex-string")) {
-    decode_string(pc, data_node, schema_node, HEX_STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "octet-string")) {
-    decode_string(pc, data_node, schema_node, OCTET_STRING);   
-  } else if (xmlStrEqual(type, BAD_CAST "decimal")) {
-    decode_decimal(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "currency")) {
-    decode_currency(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "ipv4-address")) {
-    decode_ipv4address(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "unix-time")) {
-    decode_unix_time(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "utf8-string")) {
-    decode_utf8_string(pc, data_node, schema_node);    
-  } else if (xmlStrEqual(type, BAD_CAST "boolean")) {
-    decode_boolean(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "null")) {
-    decode_null(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "enumerated")) {
-    decode_enumerated(pc, data_node, schema_node);    
-  } else if (xmlStrEqual(type, BAD_CAST "sequence")) {
-    decode_sequence(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "sequence-of")) {
-    decode_sequence_of(pc, data_node, schema_node);    
-  } else if (xmlStrEqual(type, BAD_CAST "sequence-optional")) {
-    decode_sequence_optional(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "choice")) {
-    decode_choice(pc, data_node, schema_node);    
-  } else {
+  switch (plan->type) {
+  case INTEGER_TYPE:
+    decode_integer(pc, out, plan);
+    break;
+  case STRING_TYPE:
+    decode_string(pc, out, plan, STRING);
+    break;
+  case BIT_STRING_TYPE:
+    decode_string(pc, out, plan, BIT_STRING);
+    break;
+  case NUMERIC_STRING_TYPE:
+    decode_string(pc, out, plan, NUMERIC_STRING);
+    break;
+  case HEX_STRING_TYPE:
+    decode_string(pc, out, plan, HEX_STRING);
+    break;
+  case OCTET_STRING_TYPE:
+    decode_string(pc, out, plan, OCTET_STRING);
+    break;
+  case SEQUENCE_TYPE:
+    decode_sequence(pc, out, plan);
+    break;
+  case SEQUENCE_OF_TYPE:
+    decode_sequence_of(pc, out, plan);
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    decode_sequence_optional(pc, out, plan);
+    break;
+  case NULL_TYPE:
+    decode_null(pc, out, plan);
+    break;
+  case BOOLEAN_TYPE:
+    decode_boolean(pc, out, plan);
+    break;
+  case CHOICE_TYPE:
+    decode_choice(pc, out, plan);
+    break;
+  case ENUMERATED_TYPE:
+    decode_enumerated(pc, out, plan);
+    break;
+  case CURRENCY_TYPE:
+    decode_currency(pc, out, plan);
+    break;
+  case DECIMAL_TYPE:
+    decode_decimal(pc, out, plan);
+    break;
+  case IPV4_ADDRESS_TYPE:
+    decode_ipv4address(pc, out, plan);
+    break;
+  case UTF8_STRING_TYPE:
+    decode_utf8_string(pc, out, plan);
+    break;
+  case UNIX_TIME_TYPE:
+    decode_unix_time(pc, out, plan);
+    break;
+  default:
     alert("Found a type I can't decode.");
   }
-  xmlFree(type);
 
 }
 
 
 xmlDocPtr packedobjects_decode(packedobjectsContext *pc, char *pdu)
 {
-  xmlDocPtr doc_data = NULL;
-  xmlNodePtr data_node = NULL;
-  xmlNodePtr schema_node = NULL;
+  // the caller vouches for the pdu so no limit is placed on the reader
+  return packedobjects_decode_n(pc, pdu, INT_MAX);
+}
+
+xmlDocPtr packedobjects_decode_n(packedobjectsContext *pc, char *pdu, int len)
+{
+  // modified between setjmp and longjmp
+  xmlDocPtr volatile doc_data = NULL;
+  decodeOut out = { .start = tree_start, .value = tree_value, .end = tree_end };
 
   // make sure we reset this on each call
   pc->decode_error = 0;
 
   // exception handler
-  switch (setjmp(decode_exception_env)) {
+  switch (setjmp(pc->decodep->env)) {
   case DECODE_VALIDATION_FAILED:  
     pc->decode_error = DECODE_VALIDATION_FAILED;
     break;
   case DECODE_INVALID_PREFIX:  
     pc->decode_error = DECODE_INVALID_PREFIX;
+    xmlFreeDoc(doc_data);
+    doc_data = NULL;
+    break;  
+  case DECODE_PDU_TRUNCATED:  
+    pc->decode_error = DECODE_PDU_TRUNCATED;
+    xmlFreeDoc(doc_data);
+    doc_data = NULL;
+    break;  
+  case DECODE_DOCUMENT_FAILED:  
+    pc->decode_error = DECODE_DOCUMENT_FAILED;
+    xmlFreeDoc(doc_data);
+    doc_data = NULL;
     break;  
   case 0:
-    pc->decodep = initializeDecode(pdu);
+    resetDecode(pc->decodep, pdu, len);
     pc->doc_data = doc_data;
-    schema_node = xmlDocGetRootElement(pc->doc_canonical_schema);
-    // add a temporary root for convenience
-    data_node = xmlNewNode(NULL, BAD_CAST "root");  
-    decode_node(pc, data_node, schema_node);
-    freeDecode(pc->decodep);
     dbg("creating XML data:");
-    doc_data = xmlNewDoc(BAD_CAST "1.0");
-    // ignore the temporary root
-    xmlDocSetRootElement(doc_data, data_node->children);
-    xmlFreeNode(data_node);
+    doc_data = tree_new_doc(pc);
+    // the root element is added straight to the document
+    out.node = (xmlNodePtr)doc_data;
+    decode_node(pc, &out, pc->plan);
     if ((pc->init_options & NO_DATA_VALIDATION) == 0) {
       // validate data against schema
       packedobjects_validate_decode(pc, doc_data);
@@ -574,6 +649,38 @@ xmlDocPtr packedobjects_decode(packedobjectsContext *pc, char *pdu)
   return doc_data;
 }
 
+int decode_make_memory(packedobjectsContext *pc)
+{
+  // the pdu is supplied on each call to decode
+  if ((pc->decodep = initializeDecode(NULL, 0)) == NULL) {
+    alert("Failed to initialise decoder.");
+    return -1;
+  }
+  /* 
+   * element names are interned in the schema's dictionary. anything a
+   * caller adds to a decoded document goes into this sub dictionary so
+   * the shared one is never written to by more than one thread
+   */
+  if ((pc->dict = xmlDictCreateSub(pc->schema->dict)) == NULL) {
+    alert("Failed to create dictionary.");
+    return -1;
+  }
+  // decoded strings only need to last until the next decode
+  if (pc->init_options & DECODE_STRING_ARENA) {
+    pc->decodep->arena = 1;
+  }
+
+  return 0;
+}
+
+void decode_free_memory(packedobjectsContext *pc)
+{
+  freeDecode(pc->decodep);
+  // documents still in use keep their own reference
+  xmlDictFree(pc->dict);
+  free(pc->text);
+}
+
 char *packedobjects_decode_to_string(packedobjectsContext *pc, char *pdu) {
 
   xmlDocPtr doc = NULL;
@@ -592,3 +699,498 @@ char *packedobjects_decode_to_string(packedobjectsContext *pc, char *pdu) {
   return xml;
 
 }
+
+char *packedobjects_decode_to_text(packedobjectsContext *pc, char *pdu, int len, int *size)
+{
+  decodeOut out = { .start = text_start, .value = text_value, .end = text_end };
+
+  // default value indicates error
+  *size = -1;
+  // make sure we reset this on each call
+  pc->decode_error = 0;
+
+  // exception handler
+  switch (setjmp(pc->decodep->env)) {
+  case DECODE_VALIDATION_FAILED:  
+    pc->decode_error = DECODE_VALIDATION_FAILED;
+    break;
+  case DECODE_INVALID_PREFIX:  
+    pc->decode_error = DECODE_INVALID_PREFIX;
+    break;  
+  case DECODE_PDU_TRUNCATED:  
+    pc->decode_error = DECODE_PDU_TRUNCATED;
+    break;  
+  case DECODE_TEXT_BUFFER_FULL:  
+    pc->decode_error = DECODE_TEXT_BUFFER_FULL;
+    break;  
+  case DECODE_DOCUMENT_FAILED:  
+    pc->decode_error = DECODE_DOCUMENT_FAILED;
+    break;  
+  case 0:
+    resetDecode(pc->decodep, pdu, len);
+    // same layout as xmlDocDumpMemory
+    text_write(pc, &out, "<?xml version=\"1.0\"?>\n", 22);
+    decode_node(pc, &out, pc->plan);
+    // newline plus a terminating nul which size leaves out
+    text_write(pc, &out, "\n", 2);
+    if ((pc->init_options & NO_DATA_VALIDATION) == 0) {
+      // there is no tree so validate by reading the text back
+      packedobjects_validate_text(pc, pc->text, out.len - 1);
+    }
+    *size = out.len - 1;
+  }
+
+  return (pc->decode_error) ? NULL : pc->text;
+}
+
+static void packedobjects_validate_text(packedobjectsContext *pc, const char *text, int len)
+{
+  xmlTextReaderPtr reader = NULL;
+  int ret = -1;
+
+  if ((reader = xmlReaderForMemory(text, len, NULL, NULL, 0)) != NULL) {
+    if (xmlTextReaderSchemaValidateCtxt(reader, pc->validCtxt, 0) == 0) {
+      while ((ret = xmlTextReaderRead(reader)) == 1);
+      if (xmlTextReaderIsValid(reader) != 1) ret = -1;
+    }
+    xmlFreeTextReader(reader);
+    // the context outlives the reader so must not report errors through it
+    xmlSchemaValidateSetLocator(pc->validCtxt, NULL, NULL);
+  }
+  if (ret) {
+    alert("Failed to validate XSD schema.");
+    longjmp(pc->decodep->env, DECODE_VALIDATION_FAILED);
+  }
+
+}
+
+// the document holds a reference to the context's dictionary
+static xmlDocPtr tree_new_doc(packedobjectsContext *pc)
+{
+  xmlDocPtr doc = NULL;
+
+  if ((doc = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+    alert("Failed to create document.");
+    longjmp(pc->decodep->env, DECODE_DOCUMENT_FAILED);
+  }
+  doc->dict = pc->dict;
+  xmlDictReference(doc->dict);
+  
+  return doc;
+}
+
+// the interned name is shared with the document rather than copied
+static xmlNodePtr tree_new_node(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value)
+{
+  xmlNodePtr node = NULL;
+
+  if ((node = xmlNewDocNodeEatName(out->node->doc, NULL, (xmlChar *)plan->name, value)) == NULL) {
+    alert("Failed to create node %s.", plan->name);
+    longjmp(pc->decodep->env, DECODE_DOCUMENT_FAILED);
+  }
+  
+  return xmlAddChild(out->node, node);
+}
+
+static void tree_start(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+  out->node = tree_new_node(pc, out, plan, NULL);
+}
+
+static void tree_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value)
+{
+  tree_new_node(pc, out, plan, value);
+}
+
+static void tree_end(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+  out->node = out->node->parent;
+}
+
+// append n bytes to the context's text buffer, growing it if need be
+static void text_write(packedobjectsContext *pc, decodeOut *out, const char *s, size_t n)
+{
+  char *text = NULL;
+  size_t size;
+
+  if (out->len + n > pc->text_size) {
+    size = (pc->text_size) ? pc->text_size * 2 : TEXT_BYTES;
+    while (size < out->len + n) size = size * 2;
+    if ((text = realloc(pc->text, size)) == NULL) {
+      alert("Failed to grow text buffer to %zu bytes.", size);
+      longjmp(pc->decodep->env, DECODE_TEXT_BUFFER_FULL);
+    }
+    pc->text = text;
+    pc->text_size = size;
+  }
+  memcpy(pc->text + out->len, s, n);
+  out->len += n;
+}
+
+// character data escaped the same way xmlDocDumpMemory does, which
+// writes anything outside ascii as a character reference
+static void text_escape(packedobjectsContext *pc, decodeOut *out, const xmlChar *value)
+{
+  const xmlChar *run = value;
+  const xmlChar *cur = value;
+  const char *entity = NULL;
+  char ref[16];
+  int c, len;
+
+  while (*cur) {
+    len = 1;
+    switch (*cur) {
+    case '<': entity = "&lt;"; break;
+    case '>': entity = "&gt;"; break;
+    case '&': entity = "&amp;"; break;
+    case '\r': entity = "&#13;"; break;
+    default:
+      if (*cur < 0x80) {
+        cur++;
+        continue;
+      }
+      len = 4;
+      if ((c = xmlGetUTF8Char(cur, &len)) == -1) {
+        // not utf-8 so leave it for the reader to reject
+        cur++;
+        continue;
+      }
+      snprintf(ref, sizeof(ref), "&#x%X;", c);
+      entity = ref;
+    }
+    text_write(pc, out, (const char *)run, cur - run);
+    text_write(pc, out, entity, strlen(entity));
+    cur += len;
+    run = cur;
+  }
+  text_write(pc, out, (const char *)run, cur - run);
+}
+
+static void text_start(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+  if (out->open) text_write(pc, out, ">", 1);
+  text_write(pc, out, "<", 1);
+  text_write(pc, out, (const char *)plan->name, xmlStrlen(plan->name));
+  // closed by the first child or as an empty element
+  out->open = 1;
+}
+
+static void text_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value)
+{
+  int n = xmlStrlen(plan->name);
+  
+  if (out->open) text_write(pc, out, ">", 1);
+  out->open = 0;
+  text_write(pc, out, "<", 1);
+  text_write(pc, out, (const char *)plan->name, n);
+  if ((value == NULL) || (*value == '\0')) {
+    text_write(pc, out, "/>", 2);
+    return;
+  }
+  text_write(pc, out, ">", 1);
+  text_escape(pc, out, value);
+  text_write(pc, out, "</", 2);
+  text_write(pc, out, (const char *)plan->name, n);
+  text_write(pc, out, ">", 1);
+}
+
+static void text_end(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+  if (out->open) {
+    text_write(pc, out, "/>", 2);
+    out->open = 0;
+    return;
+  }
+  text_write(pc, out, "</", 2);
+  text_write(pc, out, (const char *)plan->name, xmlStrlen(plan->name));
+  text_write(pc, out, ">", 1);
+}
+
+int packedobjects_decode_events(packedobjectsContext *pc, char *pdu, int len, const po_handler *h, void *user)
+{
+  decodeOut out = { .start = event_start, .value = event_value, .end = event_end,
+                    .integer = event_integer, .boolean = event_boolean, .enumerated = event_enumerated,
+                    .currency = event_currency, .ipv4_address = event_ipv4_address, .unix_time = event_unix_time,
+                    .handler = h, .user = user };
+
+  // make sure we reset this on each call
+  pc->decode_error = 0;
+
+  // exception handler
+  switch (setjmp(pc->decodep->env)) {
+  case DECODE_VALIDATION_FAILED:  
+    pc->decode_error = DECODE_VALIDATION_FAILED;
+    break;
+  case DECODE_INVALID_PREFIX:  
+    pc->decode_error = DECODE_INVALID_PREFIX;
+    break;  
+  case DECODE_PDU_TRUNCATED:  
+    pc->decode_error = DECODE_PDU_TRUNCATED;
+    break;  
+  case DECODE_DOCUMENT_FAILED:  
+    pc->decode_error = DECODE_DOCUMENT_FAILED;
+    break;  
+  case 0:
+    resetDecode(pc->decodep, pdu, len);
+    // no document is built so only the inline checks can validate
+    decode_node(pc, &out, pc->plan);
+  }
+
+  return pc->decode_error;
+}
+
+static void event_start(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+  if (out->handler->start_element) out->handler->start_element(out->user, plan->name);
+}
+
+static void event_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value)
+{
+  if (plan->type == NULL_TYPE) {
+    // an empty element has no value to report
+    event_start(pc, out, plan);
+    event_end(pc, out, plan);
+  } else if (out->handler->string) {
+    out->handler->string(out->user, plan->name, (const char *)value, xmlStrlen(value));
+  }
+}
+
+static void event_end(packedobjectsContext *pc, decodeOut *out, planNode *plan)
+{
+  if (out->handler->end_element) out->handler->end_element(out->user, plan->name);
+}
+
+static void event_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan, signed long int n)
+{
+  if (out->handler->integer) out->handler->integer(out->user, plan->name, n);
+}
+
+static void event_boolean(packedobjectsContext *pc, decodeOut *out, planNode *plan, int b)
+{
+  if (out->handler->boolean) out->handler->boolean(out->user, plan->name, b);
+}
+
+static void event_enumerated(packedobjectsContext *pc, decodeOut *out, planNode *plan, int index)
+{
+  if (out->handler->enumerated) out->handler->enumerated(out->user, plan->name, index, plan->enumeration[index]);
+}
+
+// typed callbacks left out by the caller fall back to the string
+static void event_currency(packedobjectsContext *pc, decodeOut *out, planNode *plan, unsigned long int cents)
+{
+  char value[CURRENCY_CHARS];
+
+  if (out->handler->currency) {
+    out->handler->currency(out->user, plan->name, cents);
+  } else if (out->handler->string) {
+    currencyString(value, CURRENCY_CHARS, cents);
+    out->handler->string(out->user, plan->name, value, strlen(value));
+  }
+}
+
+static void event_ipv4_address(packedobjectsContext *pc, decodeOut *out, planNode *plan, uint32_t s_addr)
+{
+  char value[IPV4_ADDRESS_CHARS];
+
+  if (out->handler->ipv4_address) {
+    out->handler->ipv4_address(out->user, plan->name, ntohl(s_addr));
+  } else if (out->handler->string) {
+    ipv4AddressString(value, IPV4_ADDRESS_CHARS, s_addr);
+    out->handler->string(out->user, plan->name, value, strlen(value));
+  }
+}
+
+static void event_unix_time(packedobjectsContext *pc, decodeOut *out, planNode *plan, time_t t)
+{
+  char value[UNIX_TIME_CHARS];
+
+  if (out->handler->unix_time) {
+    out->handler->unix_time(out->user, plan->name, t);
+  } else if (out->handler->string) {
+    unixTimeString(value, UNIX_TIME_CHARS, t);
+    out->handler->string(out->user, plan->name, value, strlen(value));
+  }
+}
+
+/*
+ * fills in the struct given to packedobjects_register_struct. arrays and
+ * strings are allocated as they are reached and stored straight away so
+ * a decode that fails part way can still be freed
+ */
+int packedobjects_decode_struct(packedobjectsContext *pc, char *pdu, int len, void *msg)
+{
+  // only simple types are passed to decode_node so there are no containers
+  decodeOut out = { .value = struct_value, .integer = struct_integer, .boolean = struct_boolean,
+                    .enumerated = struct_enumerated, .currency = struct_currency,
+                    .ipv4_address = struct_ipv4_address, .unix_time = struct_unix_time };
+
+  // make sure we reset this on each call
+  pc->decode_error = 0;
+
+  if (pc->binding == NULL) {
+    alert("No struct has been registered.");
+    pc->decode_error = DECODE_DOCUMENT_FAILED;
+    return pc->decode_error;
+  }
+  memset(msg, 0, pc->binding->size);
+
+  // exception handler
+  switch (setjmp(pc->decodep->env)) {
+  case DECODE_VALIDATION_FAILED:  
+    pc->decode_error = DECODE_VALIDATION_FAILED;
+    break;
+  case DECODE_INVALID_PREFIX:  
+    pc->decode_error = DECODE_INVALID_PREFIX;
+    break;  
+  case DECODE_PDU_TRUNCATED:  
+    pc->decode_error = DECODE_PDU_TRUNCATED;
+    break;  
+  case DECODE_DOCUMENT_FAILED:  
+    pc->decode_error = DECODE_DOCUMENT_FAILED;
+    break;  
+  case 0:
+    resetDecode(pc->decodep, pdu, len);
+    // no document is built so there is nothing to validate
+    struct_node(pc, &out, pc->binding->root, msg);
+  }
+  if (pc->decode_error) {
+    struct_free_node(pc->binding->root, msg);
+  }
+
+  return pc->decode_error;
+}
+
+static void struct_store(packedobjectsContext *pc, decodeOut *out, signed long int n)
+{
+
+  if (out->field->kind == PO_INT) {
+    *STRUCT_FIELD(out->base, out->field, int) = n;
+  } else {
+    *STRUCT_FIELD(out->base, out->field, long) = n;
+  }
+
+}
+
+// value is released once we return so is copied
+static void struct_value(packedobjectsContext *pc, decodeOut *out, planNode *plan, const xmlChar *value)
+{
+  const po_field *f = out->field;
+  char *s = NULL;
+  size_t n = xmlStrlen(value);
+
+  if (f->kind == PO_CHARS) {
+    if (n >= f->size) {
+      alert("%s is too long for its field.", plan->name);
+      longjmp(pc->decodep->env, DECODE_DOCUMENT_FAILED);
+    }
+    memcpy(STRUCT_FIELD(out->base, f, char), value, n);
+    return;
+  }
+  if ((s = malloc(n + 1)) == NULL) {
+    alert("Could not allocate memory.");
+    longjmp(pc->decodep->env, DECODE_DOCUMENT_FAILED);
+  }
+  memcpy(s, value, n);
+  s[n] = '\0';
+  *STRUCT_FIELD(out->base, f, char *) = s;
+}
+
+static void struct_integer(packedobjectsContext *pc, decodeOut *out, planNode *plan, signed long int n)
+{
+  struct_store(pc, out, n);
+}
+
+static void struct_boolean(packedobjectsContext *pc, decodeOut *out, planNode *plan, int b)
+{
+  struct_store(pc, out, b);
+}
+
+static void struct_enumerated(packedobjectsContext *pc, decodeOut *out, planNode *plan, int index)
+{
+  struct_store(pc, out, index);
+}
+
+static void struct_currency(packedobjectsContext *pc, decodeOut *out, planNode *plan, unsigned long int cents)
+{
+  struct_store(pc, out, cents);
+}
+
+static void struct_ipv4_address(packedobjectsContext *pc, decodeOut *out, planNode *plan, uint32_t s_addr)
+{
+  struct_store(pc, out, ntohl(s_addr));
+}
+
+static void struct_unix_time(packedobjectsContext *pc, decodeOut *out, planNode *plan, time_t t)
+{
+  struct_store(pc, out, t);
+}
+
+// the containers are walked here and only their contents go through decode_node
+static void struct_node(packedobjectsContext *pc, decodeOut *out, structNode *sn, char *base)
+{
+  planNode *plan = sn->plan;
+  const po_field *f = sn->value;
+  unsigned long bitmap, i, len;
+  char *items = NULL;
+  int j, choice;
+
+  dbg("name:%s", plan->name);
+
+  switch (plan->type) {
+  case SEQUENCE_TYPE:
+    for (j = 0; j < plan->nchildren; j++) {
+      struct_node(pc, out, sn->children[j], base);
+    }
+    break;
+  case SEQUENCE_OF_TYPE:
+    // a count the rest of the pdu can not hold has failed already, so
+    // the array is never much bigger than the pdu
+    len = decode_sequence_of_len(pc, plan);
+    if (len > INT_MAX) {
+      alert("%s repeats too many times.", plan->name);
+      longjmp(pc->decodep->env, DECODE_DOCUMENT_FAILED);
+    }
+    if ((len > 0) && ((items = calloc(len, f->size)) == NULL)) {
+      alert("Could not allocate memory.");
+      longjmp(pc->decodep->env, DECODE_DOCUMENT_FAILED);
+    }
+    *STRUCT_FIELD(base, f, char *) = items;
+    *STRUCT_COUNT(base, f) = len;
+    for (i = 0; i < len; i++) {
+      for (j = 0; j < plan->nchildren; j++) {
+        struct_node(pc, out, sn->children[j], items + i * f->size);
+      }
+    }
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    bitmap = decodeBitmap(pc->decodep, plan->items);
+    dbg("bitmap:%lu", bitmap);
+    for (j = 0; j < plan->items; j++) {
+      if (sn->children[j]->flag) {
+        *STRUCT_FIELD(base, sn->children[j]->flag, int) = CHECK_BIT(bitmap, j) != 0;
+      }
+      if (CHECK_BIT(bitmap, j)) {
+        struct_node(pc, out, sn->children[j], base);
+      }
+    }
+    break;
+  case CHOICE_TYPE:
+    choice = decodeConstrainedWholeNumber(pc->decodep, 1, plan->bits);
+    dbg("choice:%d", choice);
+    // the tree leaves an unknown choice empty but a struct has nowhere to do that
+    if ((choice < 1) || (choice > plan->nchildren)) {
+      alert("%s has no choice %d.", plan->name, choice);
+      longjmp(pc->decodep->env, DECODE_DOCUMENT_FAILED);
+    }
+    *STRUCT_FIELD(base, f, int) = choice;
+    struct_node(pc, out, sn->children[choice - 1], base);
+    break;
+  case NULL_TYPE:
+    break;
+  default:
+    out->field = f;
+    out->base = base;
+    decode_node(pc, out, plan);
+  }
+
+}
@@ -1,12 +1,46 @@
 #ifndef PACKEDOBJECTS_DECODE_H_
 #define PACKEDOBJECTS_DECODE_H_
 
+#include <stdint.h>
+#include <time.h>
+
 #include "packedobjects.h"
 
+// callbacks for packedobjects_decode_events, any of which may be NULL.
+// complex elements get start and end, simple ones a single value.
+typedef struct {
+  void (*start_element)(void *user, const xmlChar *name);
+  void (*end_element)(void *user, const xmlChar *name);
+  void (*integer)(void *user, const xmlChar *name, int64_t value);
+  // value is only valid during the call and need not be nul terminated
+  void (*string)(void *user, const xmlChar *name, const char *value, size_t len);
+  void (*boolean)(void *user, const xmlChar *name, int value);
+  void (*enumerated)(void *user, const xmlChar *name, int index, const xmlChar *value);
+  // typed forms of currency, ipv4-address and unix-time, which go to
+  // string as text when left out. the address is in host byte order.
+  void (*currency)(void *user, const xmlChar *name, int64_t cents);
+  void (*ipv4_address)(void *user, const xmlChar *name, uint32_t address);
+  void (*unix_time)(void *user, const xmlChar *name, time_t t);
+} po_handler;
+
 // main api function
 xmlDocPtr packedobjects_decode(packedobjectsContext *pc, char *pdu);
+// as above but never reads beyond len bytes of pdu
+xmlDocPtr packedobjects_decode_n(packedobjectsContext *pc, char *pdu, int len);
 
 // convenience function
 char *packedobjects_decode_to_string(packedobjectsContext *pc, char *pdu);
+// xml text written straight from the pdu into a buffer owned by pc
+char *packedobjects_decode_to_text(packedobjectsContext *pc, char *pdu, int len, int *size);
+// walk the pdu calling h for each element instead of building a tree
+int packedobjects_decode_events(packedobjectsContext *pc, char *pdu, int len, const po_handler *h, void *user);
+
+// fill in a struct registered with packedobjects_register_struct, which
+// packedobjects_free_struct releases. returns the decode error
+int packedobjects_decode_struct(packedobjectsContext *pc, char *pdu, int len, void *msg);
+
+// auxillary functions
+int decode_make_memory(packedobjectsContext *pc);
+void decode_free_memory(packedobjectsContext *pc);
 
 #endif
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <setjmp.h>
 #include <string.h>
+#include <limits.h>
+#include <arpa/inet.h>
 
 #include "packedobjects_encode.h"
 
@@ -20,97 +22,103 @@
 
 #define CHECK_BIT(var,pos) ((var) & (1<<(pos)))
 
-// exception handling
-jmp_buf encode_exception_env;
+// starting size of a streaming scratch buffer, it grows as needed
+#define SCRATCH_BYTES 256
 
 static void packedobjects_validate_encode(packedobjectsContext *poCtxPtr, xmlDocPtr doc);
-static void traverse_doc_data(packedobjectsContext *pc, xmlNode *node);
-static xmlNodePtr query_schema(packedobjectsContext *pc, xmlChar *xpath);
-static void make_schema_query(char new_path[], char old_path[]);
-static void encode_node(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void encode_sequence(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_sequence_of(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_sequence_optional(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_semi_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void encode_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void encode_fixed_length_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type);
-static void encode_unconstrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_semi_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_null(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_boolean(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_choice(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_enumerated(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_currency(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_ipv4address(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_unix_time(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-static void encode_utf8_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node);
-
-static xmlNodePtr query_schema(packedobjectsContext *pc, xmlChar *xpath)
-{
-  
-  
-  xmlXPathObjectPtr result = NULL;
-  xmlNodeSetPtr nodes = NULL;
-  xmlNodePtr node = NULL;
-  
-  result = xmlXPathEvalExpression(xpath, pc->xpathp);
-
-  if (result == NULL) {
-    alert("Error in xmlXPathEvalExpression.");
-    return NULL;
-  }
-  if(xmlXPathNodeSetIsEmpty(result->nodesetval)){
-    xmlXPathFreeObject(result);
-    alert("xpath:%s failed to query schema.", xpath);
-    return NULL;
-  }
+static void encode_doc(packedobjectsContext *pc, xmlDocPtr doc);
+static void traverse_doc_data(packedobjectsContext *pc, xmlNode *node, planNode *plan);
+static planNode *inline_child(packedobjectsContext *pc, planNode *plan, const xmlChar *name, facetsCursor *fc);
+static void inline_end(packedobjectsContext *pc, planNode *plan, facetsCursor *fc);
+static void inline_value(packedobjectsContext *pc, planNode *plan, xmlChar *value);
+static void encode_node(packedobjectsContext *pc, xmlNodePtr data_node, planNode *plan);
+static void encode_value(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type);
+static void encode_sequence(packedobjectsContext *pc, planNode *plan);
+static void encode_sequence_of(packedobjectsContext *pc, unsigned long n, planNode *plan);
+static int optional_bit(planNode *plan, const xmlChar *name, int bit, unsigned long *bitmap);
+static void encode_sequence_optional(packedobjectsContext *pc, unsigned long bitmap, planNode *plan);
+static void encode_semi_constrained_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type);
+static void encode_constrained_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type);
+static void encode_fixed_length_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type);
+static void encode_unconstrained_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_semi_constrained_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_constrained_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_null(packedobjectsContext *pc, planNode *plan);
+static void encode_boolean(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_choice(packedobjectsContext *pc, const xmlChar *name, planNode *plan);
+static void encode_enumerated(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_decimal(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_currency(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_ipv4address(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_unix_time(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static void encode_utf8_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan);
+static int stream_read(packedobjectsContext *pc, xmlTextReaderPtr reader);
+static xmlChar *stream_value(packedobjectsContext *pc, xmlTextReaderPtr reader, planNode *plan);
+static packedEncode *stream_scratch(packedobjectsContext *pc, int level);
+static void stream_element(packedobjectsContext *pc, xmlTextReaderPtr reader, planNode *plan, int level);
+static void struct_check(packedobjectsContext *pc, planNode *plan, int ok);
+static int struct_present(structNode *sn, char *base);
+static void struct_number(packedobjectsContext *pc, planNode *plan, signed long int n);
+static void struct_node(packedobjectsContext *pc, structNode *sn, char *base);
 
-  nodes = result->nodesetval;
-  if ((nodes->nodeNr) == 1) {
-    node = nodes->nodeTab[0];
-  } else {
-    alert("xpath:%s did not find 1 node only.", xpath);
-    return NULL;    
-    
+// the real function
+static char *_packedobjects_encode(packedobjectsContext *pc, xmlDocPtr doc)
+{
+  // default value indicates error
+  pc->bytes = -1;
+  // make sure we reset this on each call
+  pc->encode_error = 0;
+  
+  // exception handler
+  switch (setjmp(pc->encodep->env)) {
+  case ENCODE_VALIDATION_FAILED:  
+    pc->encode_error = ENCODE_VALIDATION_FAILED;
+    break;
+  case ENCODE_PDU_BUFFER_FULL:
+    pc->encode_error = ENCODE_PDU_BUFFER_FULL;
+    break;
+  case ENCODE_XPATH_QUERY_FAILED:
+    pc->encode_error = ENCODE_XPATH_QUERY_FAILED;
+    break;    
+  case 0:
+    // an earlier encode may have been abandoned part way through
+    resetEncode(pc->encodep);
+    encode_doc(pc, doc);
+    pc->bytes = finalizeEncode(pc->encodep);
   }
-  xmlXPathFreeObject(result);     
+  // the writer may have grown the pdu
+  pc->pdu_size = pc->encodep->size;
   
-  return node;
+  return (pc->encodep->pdu);
 }
 
-
-// needed to remove any [] which come from repeating sequences
-static void make_schema_query(char new_path[], char old_path[])
+// shared by single and batch encodes, errors longjmp out
+static void encode_doc(packedobjectsContext *pc, xmlDocPtr doc)
 {
-  char *p1 = old_path;
-  char *p2 = new_path;
-  int copying = 1;
-  while (*p1 != '\0') {
-    if (*p1 == '[') copying = 0;
-    if (copying) {
-      *p2 = *p1;
-      p2++;
-    }
-    if (*p1 == ']') copying = 1;
-    p1++;
+  xmlNodePtr root_node = NULL;
+  
+  if ((pc->init_options & NO_DATA_VALIDATION) == 0) {
+    // validate data against schema depending on flag
+    packedobjects_validate_encode(pc, doc);
+  }
+  root_node = xmlDocGetRootElement(doc);
+  if ((root_node == NULL) || (!xmlStrEqual(root_node->name, pc->plan->name))) {
+    alert("Data does not start with element %s.", pc->plan->name);
+    longjmp(pc->encodep->env, ENCODE_XPATH_QUERY_FAILED);
   }
-  // add null terminator
-  *p2 = '\0';
+  traverse_doc_data(pc, root_node, pc->plan);
 }
 
-// the real function
-static char *_packedobjects_encode(packedobjectsContext *pc, xmlDocPtr doc)
+// encode one document of a batch after the PDUs already in the buffer
+int encode_append_doc(packedobjectsContext *pc, xmlDocPtr doc, int offset)
 {
-  // default value indicates error
-  pc->bytes = -1;
-  // make sure we reset this on each call
+  // make sure we reset this for each document
   pc->encode_error = 0;
   
   // exception handler
-  switch (setjmp(encode_exception_env)) {
+  switch (setjmp(pc->encodep->env)) {
   case ENCODE_VALIDATION_FAILED:  
     pc->encode_error = ENCODE_VALIDATION_FAILED;
     break;
@@ -121,15 +129,14 @@ static char *_packedobjects_encode(packedobjectsContext *pc, xmlDocPtr doc)
     pc->encode_error = ENCODE_XPATH_QUERY_FAILED;
     break;    
   case 0:
-    if ((pc->init_options & NO_DATA_VALIDATION) == 0) {
-      // validate data against schema depending on flag
-      packedobjects_validate_encode(pc, doc);
-    }
-    traverse_doc_data(pc, xmlDocGetRootElement(doc));
-    pc->bytes = finalizeEncode(pc->encodep);
+    // drop anything a failed document left behind
+    resetEncode(pc->encodep);
+    pc->encodep->pduBytes = offset;
+    encode_doc(pc, doc);
+    return finalizeEncode(pc->encodep) - offset;
   }
   
-  return (pc->encodep->pdu);
+  return -pc->encode_error;
 }
 
 int encode_make_memory(packedobjectsContext *pc, size_t bytes)
@@ -152,8 +159,11 @@ int encode_make_memory(packedobjectsContext *pc, size_t bytes)
   // setup encode structure
   if ((encodep = initializeEncode(pdu, pc->pdu_size)) == NULL) {
     alert("Failed to initialise encoder.");
+    free(pdu);
     return -1;    
   }
+  // ours to grow if a large document does not fit
+  encodep->growable = 1;
   pc->encodep = encodep;
 
   return 0;
@@ -162,26 +172,169 @@ int encode_make_memory(packedobjectsContext *pc, size_t bytes)
 
 void encode_free_memory(packedobjectsContext *pc)
 {
+  int i;
+
   // we created the pdu in our init function
   free(pc->encodep->pdu);
   freeEncode(pc->encodep);
+  // streaming encoders made on demand
+  for (i = 0; i < pc->nscratch; i++) {
+    free(pc->scratch[i]->pdu);
+    freeEncode(pc->scratch[i]);
+  }
+  free(pc->scratch);
 }
 
 char *packedobjects_encode(packedobjectsContext *pc, xmlDocPtr doc)
 {
-  char *pdu = NULL;
-  size_t bytes = -1;
+  // the pdu grows in place so a single pass is always enough
+  return _packedobjects_encode(pc, doc);
+}
 
-  // let's hope this works first time
-  pdu = _packedobjects_encode(pc, doc);
+int packedobjects_encode_into(packedobjectsContext *pc, xmlDocPtr doc, void *dst, size_t cap, size_t *out_len)
+{
+  packedEncode *encodep = pc->encodep;
+  char *pdu = encodep->pdu;
+  int size = encodep->size;
+  int growable = encodep->growable;
+
+  // point the writer at the caller's buffer for this encode only
+  encodep->pdu = dst;
+  encodep->size = (cap > INT_MAX) ? INT_MAX : cap;
+  encodep->growable = 0;
+  _packedobjects_encode(pc, doc);
+  if (pc->bytes > encodep->size) {
+    // the writer counted on past the end so we know what was needed
+    alert("PDU needs %d bytes but the buffer holds %d.", pc->bytes, encodep->size);
+    pc->encode_error = ENCODE_PDU_BUFFER_FULL;
+    *out_len = pc->bytes;
+    pc->bytes = -1;
+  } else {
+    *out_len = (pc->bytes == -1) ? 0 : pc->bytes;
+  }
+  encodep->pdu = pdu;
+  encodep->size = size;
+  encodep->growable = growable;
+  pc->pdu_size = size;
 
-  // otherwise we will keep trying by doubling the memory
-  while (pc->encode_error == ENCODE_PDU_BUFFER_FULL) {
-    bytes = pc->pdu_size;
-    encode_free_memory(pc);
-    encode_make_memory(pc, bytes*2);
-    pdu = _packedobjects_encode(pc, doc);
+  return pc->encode_error;
+}
+
+/* 
+ * every PDU is written after the previous one in the context's buffer so
+ * nothing is copied out between documents. a document that fails gets
+ * minus its error code in out_lens and a NULL buffer, and the rest of the
+ * batch carries on. returns the number of documents that failed
+ */
+int packedobjects_encode_batch(packedobjectsContext *pc, xmlDocPtr *docs, int n, char **out_bufs, int *out_lens)
+{
+  int i, offset = 0, failed = 0;
+
+  for (i = 0; i < n; i++) {
+    if ((out_lens[i] = encode_append_doc(pc, docs[i], offset)) < 0) {
+      alert("Failed to encode document %d with error %d.", i, -out_lens[i]);
+      failed++;
+    } else {
+      offset += out_lens[i];
+    }
   }
+  // the buffer may have moved as it grew so hand out pointers last
+  offset = 0;
+  for (i = 0; i < n; i++) {
+    if (out_lens[i] < 0) {
+      out_bufs[i] = NULL;
+    } else {
+      out_bufs[i] = pc->encodep->pdu + offset;
+      offset += out_lens[i];
+    }
+  }
+  pc->bytes = offset;
+  pc->encode_error = 0;
+  pc->pdu_size = pc->encodep->size;
+
+  return failed;
+}
+
+// the real streaming function, the data is read once and never held as a tree
+static char *_packedobjects_encode_reader(packedobjectsContext *pc, xmlTextReaderPtr reader)
+{
+  packedEncode *encodep = pc->encodep;
+  int validate = ((pc->init_options & NO_DATA_VALIDATION) == 0);
+  
+  // default value indicates error
+  pc->bytes = -1;
+  // make sure we reset this on each call
+  pc->encode_error = 0;
+  
+  // exception handler, scratch encoders share this env
+  switch (setjmp(encodep->env)) {
+  case ENCODE_VALIDATION_FAILED:  
+    pc->encode_error = ENCODE_VALIDATION_FAILED;
+    break;
+  case ENCODE_PDU_BUFFER_FULL:
+    pc->encode_error = ENCODE_PDU_BUFFER_FULL;
+    break;
+  case ENCODE_XPATH_QUERY_FAILED:
+    pc->encode_error = ENCODE_XPATH_QUERY_FAILED;
+    break;    
+  case ENCODE_PARSE_FAILED:
+    pc->encode_error = ENCODE_PARSE_FAILED;
+    break;    
+  case 0:
+    resetEncode(encodep);
+    // validate as we read depending on flag
+    if (validate && (xmlTextReaderSchemaValidateCtxt(reader, pc->validCtxt, 0) != 0)) {
+      alert("Failed to validate XSD schema.");
+      longjmp(encodep->env, ENCODE_VALIDATION_FAILED);
+    }
+    // skip anything before the root element
+    do {
+      if (stream_read(pc, reader) == 0) {
+        alert("Data does not start with element %s.", pc->plan->name);
+        longjmp(encodep->env, ENCODE_XPATH_QUERY_FAILED);
+      }
+    } while (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT);
+    if (!xmlStrEqual(xmlTextReaderConstLocalName(reader), pc->plan->name)) {
+      alert("Data does not start with element %s.", pc->plan->name);
+      longjmp(encodep->env, ENCODE_XPATH_QUERY_FAILED);
+    }
+    stream_element(pc, reader, pc->plan, 0);
+    // the document is only known to be valid once it has all been read
+    while (stream_read(pc, reader));
+    pc->bytes = finalizeEncode(encodep);
+  }
+  // an error may leave a scratch encoder in charge
+  pc->encodep = encodep;
+  // the context outlives the reader so must not report errors through it
+  if (validate) {
+    xmlSchemaValidateSetLocator(pc->validCtxt, NULL, NULL);
+  }
+  // the writer may have grown the pdu
+  pc->pdu_size = encodep->size;
+  
+  return (encodep->pdu);
+}
+
+char *packedobjects_encode_reader(packedobjectsContext *pc, xmlTextReaderPtr reader)
+{
+  // the reader must not have been read from yet
+  return _packedobjects_encode_reader(pc, reader);
+}
+
+char *packedobjects_encode_file(packedobjectsContext *pc, const char *file)
+{
+  char *pdu = NULL;
+  xmlTextReaderPtr reader = NULL;
+
+  if ((reader = xmlReaderForFile(file, NULL, XML_PARSE_NOBLANKS)) == NULL) {
+    alert("could not open file %s", file);
+    pc->bytes = -1;
+    pc->encode_error = ENCODE_PARSE_FAILED;
+    return NULL;
+  }
+
+  pdu = _packedobjects_encode_reader(pc, reader);
+  xmlFreeTextReader(reader);
 
   return pdu;
 }
@@ -189,138 +342,186 @@ char *packedobjects_encode(packedobjectsContext *pc, xmlDocPtr doc)
 char *packedobjects_encode_with_string(packedobjectsContext *pc, const char *xml) {
 
   char *pdu = NULL;
-  xmlDocPtr doc = NULL;
+  xmlTextReaderPtr reader = NULL;
 
-  if ((doc = xmlParseMemory(xml, strlen(xml))) == NULL) {
+  if ((reader = xmlReaderForMemory(xml, strlen(xml), NULL, NULL, XML_PARSE_NOBLANKS)) == NULL) {
     alert("Failed to parse XML string.");
     return NULL;
   }
 
-  pdu = packedobjects_encode(pc, doc);
+  pdu = _packedobjects_encode_reader(pc, reader);
   if (pc->encode_error) {
     alert("Failed to encode with error %d.", pc->encode_error);
   }
 
-  xmlFreeDoc(doc);
+  xmlFreeTextReader(reader);
 
   return pdu;
 
 }
 
+/*
+ * the struct is walked with the plan as a document would be. there is no
+ * document to validate so only what would otherwise corrupt the PDU is
+ * checked, along with the string facets when validating inline
+ */
+char *packedobjects_encode_struct(packedobjectsContext *pc, const void *msg)
+{
+  // default value indicates error
+  pc->bytes = -1;
+  // make sure we reset this on each call
+  pc->encode_error = 0;
+
+  if (pc->binding == NULL) {
+    alert("No struct has been registered.");
+    pc->encode_error = ENCODE_VALIDATION_FAILED;
+    return NULL;
+  }
+  
+  // exception handler
+  switch (setjmp(pc->encodep->env)) {
+  case ENCODE_VALIDATION_FAILED:  
+    pc->encode_error = ENCODE_VALIDATION_FAILED;
+    break;
+  case ENCODE_PDU_BUFFER_FULL:
+    pc->encode_error = ENCODE_PDU_BUFFER_FULL;
+    break;
+  case 0:
+    resetEncode(pc->encodep);
+    struct_node(pc, pc->binding->root, (char *)msg);
+    pc->bytes = finalizeEncode(pc->encodep);
+  }
+  // the writer may have grown the pdu
+  pc->pdu_size = pc->encodep->size;
+  
+  return (pc->encodep->pdu);
+}
+
 void packedobjects_validate_encode(packedobjectsContext *poCtxPtr, xmlDocPtr doc)
 {
   int result;
-  schemaData *schemap = poCtxPtr->schemap;
   
-  result = xmlSchemaValidateDoc(schemap->validCtxt, doc);
+  result = xmlSchemaValidateDoc(poCtxPtr->validCtxt, doc);
   if (result) {
     alert("Failed to validate XSD schema.");
-    longjmp(encode_exception_env, ENCODE_VALIDATION_FAILED);
+    longjmp(poCtxPtr->encodep->env, ENCODE_VALIDATION_FAILED);
   }  
 
 }
 
-static void traverse_doc_data(packedobjectsContext *pc, xmlNode *node)
+// the next child when checking structure inline rather than with libxml2
+static planNode *inline_child(packedobjectsContext *pc, planNode *plan, const xmlChar *name, facetsCursor *fc)
+{
+  planNode *np = NULL;
+  
+  if ((np = facets_next_child(plan, name, fc)) == NULL) {
+    alert("%s is not allowed here in %s.", name, plan->name);
+    longjmp(pc->encodep->env, ENCODE_VALIDATION_FAILED);
+  }
+
+  return np;
+}
+
+// value is the element's text which is freed if it fails
+static void inline_value(packedobjectsContext *pc, planNode *plan, xmlChar *value)
+{
+
+  if (facets_check_value(plan, value) == -1) {
+    alert("%s does not meet its facets in schema.", plan->name);
+    xmlFree(value);
+    longjmp(pc->encodep->env, ENCODE_VALIDATION_FAILED);
+  }
+  
+}
+
+static void inline_end(packedobjectsContext *pc, planNode *plan, facetsCursor *fc)
+{
+  
+  if (facets_end_children(plan, fc) == -1) {
+    alert("%s does not have the children required by schema.", plan->name);
+    longjmp(pc->encodep->env, ENCODE_VALIDATION_FAILED);
+  }
+  
+}
+
+// walk the data in lockstep with the plan built from the canonical schema
+static void traverse_doc_data(packedobjectsContext *pc, xmlNode *node, planNode *plan)
 {
   xmlNode *cur_node = NULL;
-  xmlChar *path = NULL;
-  xmlNodePtr schema_node = NULL;
-  // needs to hold the longest xpath
-  char new_path[4096];
+  planNode *np = NULL;
+  facetsCursor fc = { 0, 0 };
+  int check = pc->init_options & INLINE_VALIDATION;
+  int cursor = 0;
+
+  dbg("name:%s", node->name);
+  encode_node(pc, node, plan);
   
-  for (cur_node = node; cur_node; cur_node = cur_node->next) {
+  for (cur_node = node->children; cur_node; cur_node = cur_node->next) {
     if (cur_node->type == XML_ELEMENT_NODE) {
-      path = xmlGetNodePath(cur_node);
-      make_schema_query(new_path, (char *)path);
-      free(path);
-      if ((schema_node = query_schema(pc, BAD_CAST new_path))) {
-        dbg("new_path:%s", new_path);
-        encode_node(pc, cur_node, schema_node);
-      } else {
-        longjmp(encode_exception_env, ENCODE_XPATH_QUERY_FAILED);
+      if (check) {
+        np = inline_child(pc, plan, cur_node->name, &fc);
+      } else if ((np = plan_find_child(plan, cur_node->name, &cursor)) == NULL) {
+        alert("%s is not a child of %s in schema.", cur_node->name, plan->name);
+        longjmp(pc->encodep->env, ENCODE_XPATH_QUERY_FAILED);
       }
+      traverse_doc_data(pc, cur_node, np);
     }
-    traverse_doc_data(pc, cur_node->children);
+  }
+  if (check) {
+    inline_end(pc, plan, &fc);
   }
 }
 
-static void encode_unconstrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_unconstrained_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
   signed long int n = 0;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   n = atoi((const char *) value);
   encodeUnconstrainedInteger(pc->encodep, n);
-  xmlFree(value);  
 
 }
 
-static void encode_semi_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_semi_constrained_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
-  xmlChar *minInclusive = NULL;
-  int lb;
   signed long int n = 0;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   n = atoi((const char *) value);
   dbg("n:%ld", n);
-  minInclusive = xmlGetProp(schema_node, BAD_CAST "minInclusive");
-  lb = atoi((const char *) minInclusive);  
-  encodeUnsignedSemiConstrainedInteger(pc->encodep, n, lb);
-  xmlFree(minInclusive);
-  xmlFree(value);  
+  encodeUnsignedSemiConstrainedInteger(pc->encodep, n, plan->lb);
 
 }
 
-static void encode_constrained_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_constrained_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
-  xmlChar *minInclusive = NULL;
-  xmlChar *maxInclusive = NULL;
-  int lb, ub;
   signed long int n = 0;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   n = atoi((const char *) value);
-  minInclusive = xmlGetProp(schema_node, BAD_CAST "minInclusive");
-  lb = atoi((const char *) minInclusive);
-  maxInclusive = xmlGetProp(schema_node, BAD_CAST "maxInclusive");
-  ub = atoi((const char *) maxInclusive);  
-  encodeUnsignedConstrainedInteger(pc->encodep, n, lb, ub);
-  xmlFree(minInclusive);
-  xmlFree(maxInclusive);
-  xmlFree(value);  
+  encodeConstrainedWholeNumber(pc->encodep, n, plan->lb, plan->bits);
 
 }
 
-static void encode_integer(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_integer(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
 
-  xmlChar *variant = NULL;
-
-  variant = xmlGetProp(schema_node, BAD_CAST "variant");
-  if (xmlStrEqual(variant, BAD_CAST "unconstrained")) {
-    encode_unconstrained_integer(pc, data_node, schema_node);
-  } else if (xmlStrEqual(variant, BAD_CAST "semi-constrained")) {
-    encode_semi_constrained_integer(pc, data_node, schema_node);
-  } else if (xmlStrEqual(variant, BAD_CAST "constrained")) {
-    encode_constrained_integer(pc, data_node, schema_node);    
-  } else {
+  switch (plan->variant) {
+  case UNCONSTRAINED:
+    encode_unconstrained_integer(pc, value, plan);
+    break;
+  case SEMI_CONSTRAINED:
+    encode_semi_constrained_integer(pc, value, plan);
+    break;
+  case CONSTRAINED:
+    encode_constrained_integer(pc, value, plan);
+    break;
+  default:
     alert("Found an integer variant I can't encode.");
   }
-  xmlFree(variant);  
 
 }
 
-static void encode_semi_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void encode_semi_constrained_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type)
 {
 
-  xmlChar *value = NULL;
-  
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
-  
   switch(type) {
   case STRING:
     encodeSemiConstrainedString(pc->encodep, (char *)value);
@@ -338,23 +539,14 @@ static void encode_semi_constrained_string(packedobjectsContext *pc, xmlNodePtr
     encodeSemiConstrainedOctetString(pc->encodep, (char *)value);
     break;  
   }
-  
-  xmlFree(value);  
 
 }
 
-static void encode_constrained_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void encode_constrained_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type)
 {
-  xmlChar *value = NULL;
-  xmlChar *minLength = NULL;
-  xmlChar *maxLength = NULL;
-  int lb, ub;
-  
-  minLength = xmlGetProp(schema_node, BAD_CAST "minLength");
-  maxLength = xmlGetProp(schema_node, BAD_CAST "maxLength");
-  lb = atoi((const char *) minLength);
-  ub = atoi((const char *) maxLength);
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
+  int lb = plan->lb;
+  int ub = plan->ub;
+  
   switch(type) {
   case STRING:
     encodeConstrainedString(pc->encodep, (char *)value, lb, ub);
@@ -373,20 +565,12 @@ static void encode_constrained_string(packedobjectsContext *pc, xmlNodePtr data_
     break;  
   }
   
-  xmlFree(minLength);
-  xmlFree(maxLength);
-  xmlFree(value);
 }
 
-static void encode_fixed_length_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void encode_fixed_length_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type)
 {
-  xmlChar *value = NULL;
-  xmlChar *length = NULL;
-  int len;
+  int len = plan->length;
   
-  length = xmlGetProp(schema_node, BAD_CAST "length");
-  len = atoi((const char *) length);
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   switch(type) {
   case STRING:
     encodeFixedLengthString(pc->encodep, (char *)value, len);
@@ -404,170 +588,112 @@ static void encode_fixed_length_string(packedobjectsContext *pc, xmlNodePtr data
     encodeFixedLengthOctetString(pc->encodep, (char *)value, len);
     break;  
   }
-  
-  xmlFree(length);
-  xmlFree(value);
 
 }
 
-static void encode_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node, int type)
+static void encode_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan, int type)
 {
-  xmlChar *variant = NULL;
 
-  variant = xmlGetProp(schema_node, BAD_CAST "variant");
-  if (xmlStrEqual(variant, BAD_CAST "semi-constrained")) {
-    encode_semi_constrained_string(pc, data_node, schema_node, type);
-  } else if (xmlStrEqual(variant, BAD_CAST "constrained")) {
-    encode_constrained_string(pc, data_node, schema_node, type);
-  } else if (xmlStrEqual(variant, BAD_CAST "fixed-length")) {
-    encode_fixed_length_string(pc, data_node, schema_node, type);
-  } else {
+  switch (plan->variant) {
+  case SEMI_CONSTRAINED:
+    encode_semi_constrained_string(pc, value, plan, type);
+    break;
+  case CONSTRAINED:
+    encode_constrained_string(pc, value, plan, type);
+    break;
+  case FIXED_LENGTH:
+    encode_fixed_length_string(pc, value, plan, type);
+    break;
+  default:
     alert("Found a string variant I can't encode.");
   }
-  xmlFree(variant);
+
 }
                                                                                                
-static void encode_sequence(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_sequence(packedobjectsContext *pc, planNode *plan)
 {
   // don't need to encode anything
 }
 
-static void encode_sequence_of(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+// n is the number of child elements found in the data
+static void encode_sequence_of(packedobjectsContext *pc, unsigned long n, planNode *plan)
 {
-  xmlChar *items = NULL;
-  xmlChar *minOccurs = NULL;
-  xmlChar *maxOccurs = NULL;
-  unsigned long n = 0;
-  unsigned long lb = 0;
-
-  minOccurs = xmlGetProp(schema_node, BAD_CAST "minOccurs");
-  maxOccurs = xmlGetProp(schema_node, BAD_CAST "maxOccurs");
-  // number of items in the sequence according to the schema
-  items = xmlGetProp(schema_node, BAD_CAST "items");
-  n = atoi((const char *) items);
-  xmlFree(items);
+
   // work out how many times data repeats
-  n = xmlChildElementCount(data_node) / n;
-  dbg("sequence_of len:%d", n);
-  // overide default of 0 if set
-  if (minOccurs) lb = atoi((const char *) minOccurs);
-  dbg("lb:%lu", lb);
-  if (xmlStrEqual(maxOccurs, BAD_CAST "unbounded")) {
+  n = n / plan->items;
+  dbg("sequence_of len:%lu", n);
+  dbg("lb:%ld", plan->lb);
+  if (plan->unbounded) {
      // encode as semi-constrained
-    encodeUnsignedSemiConstrainedInteger(pc->encodep, n, lb);
+    encodeUnsignedSemiConstrainedInteger(pc->encodep, n, plan->lb);
   } else {
     // encode as constrained
-    unsigned long ub = atoi((const char *) maxOccurs);
-    dbg("ub:%lu", ub);
-    encodeUnsignedConstrainedInteger(pc->encodep, n, lb, ub);
+    dbg("ub:%ld", plan->ub);
+    encodeConstrainedWholeNumber(pc->encodep, n, plan->lb, plan->bits);
   }
-  xmlFree(minOccurs);
-  xmlFree(maxOccurs);
 
 }
 
-static void encode_sequence_optional(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+// children appear in schema order so bit only ever moves forward
+static int optional_bit(planNode *plan, const xmlChar *name, int bit, unsigned long *bitmap)
 {
-  xmlNodePtr dnp = NULL;
-  xmlNodePtr snp = NULL;
-  int bit = 0;
-  unsigned long bitmap = 0;
-  xmlChar *items = NULL;
-  unsigned long n = 0;
-  
-  // number of items in the sequence according to the schema
-  items = xmlGetProp(schema_node, BAD_CAST "items");
-  n = atoi((const char *) items);
-  xmlFree(items);
-  
-  dnp = data_node->children;
-  snp = schema_node->children;
-  for (; dnp; dnp = dnp->next) {
-    while (snp) {
-      if (xmlStrEqual(dnp->name, snp->name)) {
-        bitmap = bitmap ^ (1UL << bit);
-        break;
-      }
-      bit++;
-      snp = snp->next;
+  while (bit < plan->nchildren) {
+    if (xmlStrEqual(name, plan->children[bit]->name)) {
+      *bitmap = *bitmap ^ (1UL << bit);
+      break;
     }
+    bit++;
   }
-  dbg("bitmap:%lu within %lu bits", bitmap, n);
-  encodeBitmap(pc->encodep, bitmap, n);
+
+  return bit;
+}
+
+static void encode_sequence_optional(packedobjectsContext *pc, unsigned long bitmap, planNode *plan)
+{
+
+  dbg("bitmap:%lu within %d bits", bitmap, plan->items);
+  encodeBitmap(pc->encodep, bitmap, plan->items);
   
 }
 
-static void encode_choice(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+// name is the element chosen in the data
+static void encode_choice(packedobjectsContext *pc, const xmlChar *name, planNode *plan)
 {
-  xmlNodePtr snp = NULL;
   int index = 1;
-  xmlChar *items = NULL;
-  unsigned long n = 0;
+  int i;
   
-  // number of items to choose from according to the schema
-  items = xmlGetProp(schema_node, BAD_CAST "items");
-  n = atoi((const char *) items);
-  xmlFree(items);
-  snp = schema_node->children;
-  while (snp) {
-    dbg("snp->name:%s", snp->name);
-    if (xmlStrEqual(data_node->children->name, snp->name)) break;
+  for (i = 0; i < plan->nchildren; i++) {
+    dbg("name:%s", plan->children[i]->name);
+    if (xmlStrEqual(name, plan->children[i]->name)) break;
     index++;
-    snp = snp->next;
   }
   dbg("choice index:%d", index);
-  encodeChoiceIndex(pc->encodep, index, n);
+  encodeConstrainedWholeNumber(pc->encodep, index, 1, plan->bits);
   
 }
 
-static void encode_enumerated(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_enumerated(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlNodePtr snp = NULL;
-  unsigned index = 0;
-  xmlChar *items = NULL;
-  unsigned long n = 0;
-  xmlAttrPtr attr = NULL;
-  xmlChar *data_value = NULL;
-  xmlChar *schema_value = NULL;
-  
-  // number of items to choose from according to the schema
-  items = xmlGetProp(schema_node, BAD_CAST "items");
-  n = atoi((const char *) items);
-  xmlFree(items);
-
-  data_value = xmlNodeListGetString(pc->doc_data, data_node->children, 1);
-  
-  snp = schema_node;
-  for(attr = snp->properties; NULL != attr; attr = attr->next) {
-    if (xmlStrEqual(attr->name, BAD_CAST "enumeration")) {
-      schema_value = xmlNodeListGetString(pc->doc_canonical_schema, attr->children, 1);
-      if (xmlStrEqual(data_value, schema_value)) {
-        xmlFree(schema_value);
-        break;
-      } else {
-        xmlFree(schema_value);
-        index++;
-      }
-    }
+  int index = 0;
+  
+  for (index = 0; index < plan->items; index++) {
+    if (xmlStrEqual(value, plan->enumeration[index])) break;
   }
-  xmlFree(data_value);
   
-  dbg("enumerated index:%d from %lu items", index, n);
-  encodeEnumerated(pc->encodep, index, n);
+  dbg("enumerated index:%d from %d items", index, plan->items);
+  encodeConstrainedWholeNumber(pc->encodep, index, 0, plan->bits);
   
 }
 
-static void encode_null(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_null(packedobjectsContext *pc, planNode *plan)
 {
   // don't need to encode anything
 }
 
 
-static void encode_boolean(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_boolean(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   if ((xmlStrEqual(value, BAD_CAST "0")) || (xmlStrEqual(value, BAD_CAST "false"))) {
     dbg("boolean: 0");
     encodeBoolean(pc->encodep, 0);
@@ -576,118 +702,458 @@ static void encode_boolean(packedobjectsContext *pc, xmlNodePtr data_node, xmlNo
     dbg("boolean: 1");
     encodeBoolean(pc->encodep, 1);
   }
-  xmlFree(value);  
 
 }
 
-static void encode_decimal(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_decimal(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
-  
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   dbg("value:%s", value);
   // encode in 4 bits per char
   encodeDecimal(pc->encodep, (char *)value);
-  xmlFree(value);
   
 }
 
-static void encode_currency(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_currency(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   dbg("value:%s", value);
 
   encodeCurrency(pc->encodep, (char *)value);
-  xmlFree(value);
   
 }
 
-static void encode_ipv4address(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_ipv4address(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   dbg("value:%s", value);
 
   encodeIPv4Address(pc->encodep, (char *)value);
-  xmlFree(value);
   
 }
 
-static void encode_unix_time(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_unix_time(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   dbg("value:%s", value);
 
   encodeUnixTime(pc->encodep, (char *)value);
-  xmlFree(value);
   
 }
 
 // special kind of octet-string without length restrictions
-static void encode_utf8_string(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
+static void encode_utf8_string(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
 {
-  xmlChar *value = NULL;
   
-  value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
   dbg("value:%s", value);
 
   encodeSemiConstrainedOctetString(pc->encodep, (char *)value);
-  xmlFree(value);
-  
-}
-
-static void encode_node(packedobjectsContext *pc, xmlNodePtr data_node, xmlNodePtr schema_node)
-{
-
-  xmlChar *type = NULL;
-
-  type = xmlGetProp(schema_node, BAD_CAST "type");
-  if (xmlStrEqual(type, BAD_CAST "integer")) {
-    encode_integer(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "string")) {
-    encode_string(pc, data_node, schema_node, STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "bit-string")) {
-    encode_string(pc, data_node, schema_node, BIT_STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "numeric-string")) {
-    encode_string(pc, data_node, schema_node, NUMERIC_STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "hex-string")) {
-    encode_string(pc, data_node, schema_node, HEX_STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "octet-string")) {
-    encode_string(pc, data_node, schema_node, OCTET_STRING);
-  } else if (xmlStrEqual(type, BAD_CAST "sequence")) {
-    encode_sequence(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "sequence-of")) {
-    encode_sequence_of(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "sequence-optional")) {
-    encode_sequence_optional(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "null")) {
-    encode_null(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "boolean")) {
-    encode_boolean(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "choice")) {
-    encode_choice(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "enumerated")) {
-    encode_enumerated(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "currency")) {
-    encode_currency(pc, data_node, schema_node);    
-  } else if (xmlStrEqual(type, BAD_CAST "decimal")) {
-    encode_decimal(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "ipv4-address")) {
-    encode_ipv4address(pc, data_node, schema_node);
-  } else if (xmlStrEqual(type, BAD_CAST "utf8-string")) {
-    encode_utf8_string(pc, data_node, schema_node);    
-  } else if (xmlStrEqual(type, BAD_CAST "unix-time")) {
-    encode_unix_time(pc, data_node, schema_node);    
-  } else {
+  
+}
+
+// encode the text content of a simple type element
+static void encode_value(packedobjectsContext *pc, const xmlChar *value, planNode *plan)
+{
+
+  switch (plan->type) {
+  case INTEGER_TYPE:
+    encode_integer(pc, value, plan);
+    break;
+  case STRING_TYPE:
+    encode_string(pc, value, plan, STRING);
+    break;
+  case BIT_STRING_TYPE:
+    encode_string(pc, value, plan, BIT_STRING);
+    break;
+  case NUMERIC_STRING_TYPE:
+    encode_string(pc, value, plan, NUMERIC_STRING);
+    break;
+  case HEX_STRING_TYPE:
+    encode_string(pc, value, plan, HEX_STRING);
+    break;
+  case OCTET_STRING_TYPE:
+    encode_string(pc, value, plan, OCTET_STRING);
+    break;
+  case BOOLEAN_TYPE:
+    encode_boolean(pc, value, plan);
+    break;
+  case ENUMERATED_TYPE:
+    encode_enumerated(pc, value, plan);
+    break;
+  case CURRENCY_TYPE:
+    encode_currency(pc, value, plan);
+    break;
+  case DECIMAL_TYPE:
+    encode_decimal(pc, value, plan);
+    break;
+  case IPV4_ADDRESS_TYPE:
+    encode_ipv4address(pc, value, plan);
+    break;
+  case UTF8_STRING_TYPE:
+    encode_utf8_string(pc, value, plan);
+    break;
+  case UNIX_TIME_TYPE:
+    encode_unix_time(pc, value, plan);
+    break;
+  default:
     alert("Found a type I can't encode.");
   }
-  xmlFree(type);
 
 }
 
+static void encode_node(packedobjectsContext *pc, xmlNodePtr data_node, planNode *plan)
+{
+  xmlNodePtr dnp = NULL;
+  xmlChar *value = NULL;
+  unsigned long bitmap = 0;
+  int bit = 0;
+
+  dbg("type:%d", plan->type);
+  
+  switch (plan->type) {
+  case SEQUENCE_TYPE:
+    encode_sequence(pc, plan);
+    break;
+  case SEQUENCE_OF_TYPE:
+    encode_sequence_of(pc, xmlChildElementCount(data_node), plan);
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    for (dnp = data_node->children; dnp; dnp = dnp->next) {
+      bit = optional_bit(plan, dnp->name, bit, &bitmap);
+    }
+    encode_sequence_optional(pc, bitmap, plan);
+    break;
+  case NULL_TYPE:
+    encode_null(pc, plan);
+    break;
+  case CHOICE_TYPE:
+    // only possible when the data has not been validated
+    if ((dnp = xmlFirstElementChild(data_node)) == NULL) {
+      alert("%s does not have the children required by schema.", plan->name);
+      longjmp(pc->encodep->env, ENCODE_VALIDATION_FAILED);
+    }
+    encode_choice(pc, dnp->name, plan);
+    break;
+  default:
+    value = xmlNodeListGetString(pc->doc_data, data_node->xmlChildrenNode, 1);
+    if (pc->init_options & INLINE_VALIDATION) {
+      inline_value(pc, plan, value);
+    }
+    encode_value(pc, value, plan);
+    xmlFree(value);
+  }
+
+}
+
+// read the next node, parse errors and invalid data stop the encode
+static int stream_read(packedobjectsContext *pc, xmlTextReaderPtr reader)
+{
+  int ret;
+
+  if ((ret = xmlTextReaderRead(reader)) == -1) {
+    alert("Failed to parse XML data.");
+    longjmp(pc->encodep->env, ENCODE_PARSE_FAILED);
+  }
+  // check as we go so invalid values never reach the encoders
+  if (((pc->init_options & NO_DATA_VALIDATION) == 0) && (xmlTextReaderIsValid(reader) == 0)) {
+    alert("Failed to validate XSD schema.");
+    longjmp(pc->encodep->env, ENCODE_VALIDATION_FAILED);
+  }
+
+  return ret;
+}
+
+// text of a simple type element, NULL if it is empty
+static xmlChar *stream_value(packedobjectsContext *pc, xmlTextReaderPtr reader, planNode *plan)
+{
+  xmlChar *value = NULL;
+  int depth = xmlTextReaderDepth(reader);
+  
+  if (xmlTextReaderIsEmptyElement(reader)) {
+    return NULL;
+  }
+  while (stream_read(pc, reader)) {
+    switch (xmlTextReaderNodeType(reader)) {
+    case XML_READER_TYPE_TEXT:
+    case XML_READER_TYPE_CDATA:
+    case XML_READER_TYPE_WHITESPACE:
+    case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+      value = xmlStrcat(value, xmlTextReaderConstValue(reader));
+      break;
+    case XML_READER_TYPE_ELEMENT:
+      alert("%s is not a child of %s in schema.", xmlTextReaderConstLocalName(reader), plan->name);
+      xmlFree(value);
+      longjmp(pc->encodep->env, ENCODE_XPATH_QUERY_FAILED);
+    case XML_READER_TYPE_END_ELEMENT:
+      if (xmlTextReaderDepth(reader) == depth) {
+        return value;
+      }
+      break;
+    }
+  }
+  
+  return value;
+}
+
+// an empty encoder to hold a container's children at this nesting level
+static packedEncode *stream_scratch(packedobjectsContext *pc, int level)
+{
+  packedEncode **scratch = NULL;
+  packedEncode *encodep = NULL;
+  char *pdu = NULL;
+  
+  if (level == pc->nscratch) {
+    if ((scratch = realloc(pc->scratch, (level + 1) * sizeof(packedEncode *))) == NULL) {
+      alert("Failed to allocate scratch encoders.");
+      longjmp(pc->encodep->env, ENCODE_PDU_BUFFER_FULL);
+    }
+    pc->scratch = scratch;
+    if (((pdu = malloc(SCRATCH_BYTES)) == NULL) || ((encodep = initializeEncode(pdu, SCRATCH_BYTES)) == NULL)) {
+      free(pdu);
+      alert("Failed to allocate scratch encoders.");
+      longjmp(pc->encodep->env, ENCODE_PDU_BUFFER_FULL);
+    }
+    encodep->growable = 1;
+    pc->scratch[pc->nscratch++] = encodep;
+  }
+  encodep = pc->scratch[level];
+  resetEncode(encodep);
+  // errors thrown from the scratch encoder go to the same handler
+  memcpy(encodep->env, pc->encodep->env, sizeof(jmp_buf));
+  
+  return encodep;
+}
+
+// encode the element the reader is on along with everything inside it
+static void stream_element(packedobjectsContext *pc, xmlTextReaderPtr reader, planNode *plan, int level)
+{
+  packedEncode *parent = NULL;
+  packedEncode *scratch = NULL;
+  planNode *np = NULL;
+  const xmlChar *name = NULL;
+  xmlChar *value = NULL;
+  unsigned long n = 0;
+  unsigned long bitmap = 0;
+  facetsCursor fc = { 0, 0 };
+  int check = pc->init_options & INLINE_VALIDATION;
+  int bit = 0;
+  int cursor = 0;
+  int depth = xmlTextReaderDepth(reader);
+
+  dbg("name:%s", plan->name);
+  
+  switch (plan->type) {
+  case SEQUENCE_OF_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+    // the header depends on the children so hold them back until the end tag
+    parent = pc->encodep;
+    pc->encodep = stream_scratch(pc, level++);
+    break;
+  case SEQUENCE_TYPE:
+  case CHOICE_TYPE:
+  case NULL_TYPE:
+    break;
+  default:
+    value = stream_value(pc, reader, plan);
+    if (pc->init_options & INLINE_VALIDATION) {
+      inline_value(pc, plan, value);
+    }
+    encode_value(pc, value, plan);
+    xmlFree(value);
+    return;
+  }
+
+  if (!xmlTextReaderIsEmptyElement(reader)) {
+    while (stream_read(pc, reader)) {
+      if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_END_ELEMENT) {
+        if (xmlTextReaderDepth(reader) == depth) break;
+        continue;
+      }
+      if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) continue;
+      name = xmlTextReaderConstLocalName(reader);
+      if (check) {
+        np = inline_child(pc, plan, name, &fc);
+      } else if ((np = plan_find_child(plan, name, &cursor)) == NULL) {
+        alert("%s is not a child of %s in schema.", name, plan->name);
+        longjmp(pc->encodep->env, ENCODE_XPATH_QUERY_FAILED);
+      }
+      n++;
+      if (plan->type == SEQUENCE_OPTIONAL_TYPE) {
+        bit = optional_bit(plan, name, bit, &bitmap);
+      } else if ((plan->type == CHOICE_TYPE) && (n == 1)) {
+        encode_choice(pc, name, plan);
+      }
+      stream_element(pc, reader, np, level);
+    }
+  }
+  if (check) {
+    inline_end(pc, plan, &fc);
+  }
+
+  switch (plan->type) {
+  case SEQUENCE_TYPE:
+    encode_sequence(pc, plan);
+    break;
+  case NULL_TYPE:
+    encode_null(pc, plan);
+    break;
+  case SEQUENCE_OF_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+    scratch = pc->encodep;
+    pc->encodep = parent;
+    if (plan->type == SEQUENCE_OF_TYPE) {
+      encode_sequence_of(pc, n, plan);
+    } else {
+      encode_sequence_optional(pc, bitmap, plan);
+    }
+    appendEncode(parent, scratch);
+    break;
+  }
+  
+}
+
+static void struct_check(packedobjectsContext *pc, planNode *plan, int ok)
+{
+
+  if (!ok) {
+    alert("%s does not meet its facets in schema.", plan->name);
+    longjmp(pc->encodep->env, ENCODE_VALIDATION_FAILED);
+  }
+
+}
+
+// an optional element without a flag is a string which is NULL when absent
+static int struct_present(structNode *sn, char *base)
+{
+
+  if (sn->flag) {
+    return *STRUCT_FIELD(base, sn->flag, int) != 0;
+  }
+
+  return *STRUCT_FIELD(base, sn->value, char *) != NULL;
+}
+
+// the typed values go straight to the encoders without being made into text
+static void struct_number(packedobjectsContext *pc, planNode *plan, signed long int n)
+{
+
+  dbg("n:%ld", n);
+  
+  switch (plan->type) {
+  case INTEGER_TYPE:
+    struct_check(pc, plan, facets_check_integer(plan, n) == 0);
+    switch (plan->variant) {
+    case UNCONSTRAINED:
+      encodeUnconstrainedInteger(pc->encodep, n);
+      break;
+    case SEMI_CONSTRAINED:
+      encodeUnsignedSemiConstrainedInteger(pc->encodep, n, plan->lb);
+      break;
+    case CONSTRAINED:
+      encodeConstrainedWholeNumber(pc->encodep, n, plan->lb, plan->bits);
+      break;
+    default:
+      alert("Found an integer variant I can't encode.");
+    }
+    break;
+  case BOOLEAN_TYPE:
+    encodeBoolean(pc->encodep, n != 0);
+    break;
+  case ENUMERATED_TYPE:
+    struct_check(pc, plan, (n >= 0) && (n < plan->items));
+    encodeConstrainedWholeNumber(pc->encodep, n, 0, plan->bits);
+    break;
+  case CURRENCY_TYPE:
+    struct_check(pc, plan, n >= 0);
+    encodeCurrencyCents(pc->encodep, n);
+    break;
+  case IPV4_ADDRESS_TYPE:
+    // held in host byte order like the decode events
+    encodeIPv4AddressValue(pc->encodep, htonl((uint32_t)n));
+    break;
+  case UNIX_TIME_TYPE:
+    struct_check(pc, plan, (n >= INT_MIN) && (n <= INT_MAX));
+    encodeUnixTimeValue(pc->encodep, n);
+    break;
+  }
+  
+}
+
+// base is the struct or, below a sequence-of, the item
+static void struct_node(packedobjectsContext *pc, structNode *sn, char *base)
+{
+  planNode *plan = sn->plan;
+  const po_field *f = sn->value;
+  const char *value = NULL;
+  char *items = NULL;
+  unsigned long bitmap = 0;
+  int i, j, count, choice;
+
+  dbg("name:%s", plan->name);
+  
+  switch (plan->type) {
+  case SEQUENCE_TYPE:
+    for (i = 0; i < plan->nchildren; i++) {
+      struct_node(pc, sn->children[i], base);
+    }
+    break;
+  case SEQUENCE_OF_TYPE:
+    items = *STRUCT_FIELD(base, f, char *);
+    count = *STRUCT_COUNT(base, f);
+    struct_check(pc, plan, (count >= plan->lb) && (plan->unbounded || (count <= plan->ub)) && (items || (count == 0)));
+    // the same count as a document with items children per repetition
+    encode_sequence_of(pc, (unsigned long)count * plan->items, plan);
+    for (i = 0; i < count; i++) {
+      for (j = 0; j < plan->nchildren; j++) {
+        struct_node(pc, sn->children[j], items + i * f->size);
+      }
+    }
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    for (i = 0; i < plan->items; i++) {
+      if (struct_present(sn->children[i], base)) {
+        bitmap |= 1UL << i;
+      }
+    }
+    encode_sequence_optional(pc, bitmap, plan);
+    for (i = 0; i < plan->items; i++) {
+      if (CHECK_BIT(bitmap, i)) {
+        struct_node(pc, sn->children[i], base);
+      }
+    }
+    break;
+  case CHOICE_TYPE:
+    choice = *STRUCT_FIELD(base, f, int);
+    struct_check(pc, plan, (choice >= 1) && (choice <= plan->nchildren));
+    encodeConstrainedWholeNumber(pc->encodep, choice, 1, plan->bits);
+    struct_node(pc, sn->children[choice - 1], base);
+    break;
+  case NULL_TYPE:
+    encode_null(pc, plan);
+    break;
+  default:
+    switch (f->kind) {
+    case PO_INT:
+      struct_number(pc, plan, *STRUCT_FIELD(base, f, int));
+      return;
+    case PO_LONG:
+      struct_number(pc, plan, *STRUCT_FIELD(base, f, long));
+      return;
+    case PO_STRING:
+      // the same as an empty element
+      if ((value = *STRUCT_FIELD(base, f, char *)) == NULL) {
+        value = "";
+      }
+      break;
+    case PO_CHARS:
+      value = STRUCT_FIELD(base, f, char);
+      struct_check(pc, plan, memchr(value, '\0', f->size) != NULL);
+      break;
+    }
+    if (pc->init_options & INLINE_VALIDATION) {
+      struct_check(pc, plan, facets_check_value(plan, BAD_CAST value) == 0);
+    }
+    encode_value(pc, BAD_CAST value, plan);
+  }
+  
+}
@@ -5,6 +5,17 @@
 
 // main api function
 char *packedobjects_encode(packedobjectsContext *pc, xmlDocPtr doc);
+// encode straight into caller memory; on ENCODE_PDU_BUFFER_FULL out_len is the size needed
+int packedobjects_encode_into(packedobjectsContext *pc, xmlDocPtr doc, void *dst, size_t cap, size_t *out_len);
+// encode n documents back to back; the PDUs live in the context until the next encode
+int packedobjects_encode_batch(packedobjectsContext *pc, xmlDocPtr *docs, int n, char **out_bufs, int *out_lens);
+
+// encode a struct laid out as given to packedobjects_register_struct
+char *packedobjects_encode_struct(packedobjectsContext *pc, const void *msg);
+
+// streaming encode which never builds a tree for the data
+char *packedobjects_encode_reader(packedobjectsContext *pc, xmlTextReaderPtr reader);
+char *packedobjects_encode_file(packedobjectsContext *pc, const char *file);
 
 // convenience function
 char *packedobjects_encode_with_string(packedobjectsContext *pc, const char *xml);
@@ -12,5 +23,7 @@ char *packedobjects_encode_with_string(packedobjectsContext *pc, const char *xml
 // auxillary functions
 int encode_make_memory(packedobjectsContext *pc, size_t bytes);
 void encode_free_memory(packedobjectsContext *pc);
+// returns the size of the PDU written at offset or minus the error code
+int encode_append_doc(packedobjectsContext *pc, xmlDocPtr doc, int offset);
 
 #endif
@@ -30,107 +30,267 @@ packedobjectsContext *_init_packedobjects()
     return NULL;    
   }
   
-  pc->doc_schema = NULL;
   pc->doc_data = NULL;
-  pc->doc_expanded_schema = NULL;
-  pc->doc_canonical_schema = NULL;
-  pc->schemap = NULL;
-  pc->xpathp = NULL;
-  pc->udt = NULL;
-  pc->start_element_name = NULL;
+  pc->schema = NULL;
+  pc->plan = NULL;
+  pc->validCtxt = NULL;
   pc->encodep = NULL;
   pc->decodep = NULL;
+  pc->dict = NULL;
+  pc->scratch = NULL;
+  pc->nscratch = 0;
+  pc->text = NULL;
+  pc->text_size = 0;
   pc->pdu_size = 0;
   pc->bytes = 0;
   pc->init_options = 0;
   pc->init_error = 0;
   pc->encode_error = 0;
   pc->decode_error = 0;
+  pc->binding = NULL;
 
   return pc;
   
 }
 
-packedobjectsContext *init_packedobjects(const char *schema_file, size_t bytes, int options)
+static packedobjectsSchema *_init_packedobjects_schema()
 {
-  packedobjectsContext *pc = NULL;
+  packedobjectsSchema *ps = NULL;
+  
+  if ((ps = (packedobjectsSchema *)malloc(sizeof(packedobjectsSchema))) == NULL) {
+    alert("Could not alllocate memory.");
+    return NULL;    
+  }
+  
+  ps->doc_schema = NULL;
+  ps->doc_expanded_schema = NULL;
+  ps->doc_canonical_schema = NULL;
+  ps->schemap = NULL;
+  ps->plan = NULL;
+  ps->dict = NULL;
+  ps->udt = NULL;
+  ps->start_element_name = NULL;
+  ps->hash = 0;
+  ps->compiled = NULL;
+  ps->compiled_size = 0;
+  ps->init_options = 0;
+  ps->refs = 1;
 
-  // do the real allocation of structure with the provided schema
-  if ((pc = _init_packedobjects()) == NULL) {
-    pc->init_error = INIT_FAILED;
+  return ps;
+  
+}
+
+static void schema_teardown(packedobjectsSchema *ps)
+{
+  if (ps->schemap) {
+    schema_free_validation(ps);
+  }
+  expand_free(ps);
+  canon_free(ps);
+  plan_free(ps);
+  schema_free(ps);
+  compiled_free(ps);
+  
+  // free the structure
+  free(ps);
+}
+
+packedobjectsSchema *init_packedobjects_schema(const char *schema_file, int options, int *error)
+{
+  packedobjectsSchema *ps = NULL;
+  int result = 0;
+
+  // set up libxml2's globals once before any thread can touch them
+  xmlInitParser();
+
+  if ((ps = _init_packedobjects_schema()) == NULL) {
+    if (error) *error = INIT_FAILED;
     return NULL;
   }
 
+  // the inline checks take the place of libxml2's validator
+  if (options & INLINE_VALIDATION) {
+    options |= NO_DATA_VALIDATION;
+  }
   // we will need these later
-  pc->init_options = options;
+  ps->init_options = options;
 
   // store the schema we will work with
-  if (schema_setup_schema(pc, schema_file) == -1) {
-    pc->init_error = INIT_SCHEMA_SETUP_FAILED;
+  if (schema_setup_schema(ps, schema_file) == -1) {
+    result = INIT_SCHEMA_SETUP_FAILED;
+  } else if (((options & NO_SCHEMA_VALIDATION) == 0) && (schema_validate_schema(ps) == -1)) {
+    // the schema must conform to PO schema
+    result = INIT_SCHEMA_VALIDATION_FAILED;
+  } else if (((options & NO_DATA_VALIDATION) == 0) && (schema_setup_validation(ps) == -1)) {
+    // compile the schema once for every context to validate with
+    result = INIT_SETUP_VALIDATION_FAILED;
+  } else if (expand_make_expanded_schema(ps) == -1) {
+    // expand user defined types in schema
+    result = INIT_EXPANDED_SCHEMA_FAILED;
+  } else if (canon_make_canonical_schema(ps) == -1) {
+    // make the canonical schema used for encoding
+    result = INIT_CANON_SCHEMA_FAILED;
+  } else if (plan_make_plan(ps) == -1) {
+    // compile the canonical schema into a plan to use during encode/decode
+    result = INIT_PLAN_FAILED;
+  } else if (compiled_hash(ps) == -1) {
+    // the hash a compiled copy of this schema would carry
+    result = INIT_PLAN_FAILED;
+  }
+
+  if (error) *error = result;
+  if (result) {
+    schema_teardown(ps);
     return NULL;
-  }  
+  }
   
+  return ps;
+}
+
+packedobjectsSchema *init_packedobjects_schema_from_compiled(const char *file, int options, int *error)
+{
+  packedobjectsSchema *ps = NULL;
+
+  if ((ps = _init_packedobjects_schema()) == NULL) {
+    if (error) *error = INIT_FAILED;
+    return NULL;
+  }
+
+  // libxml2 needs the XSD to validate so data validation is done inline
+  if ((options & NO_DATA_VALIDATION) == 0) {
+    options |= INLINE_VALIDATION;
+  }
+  ps->init_options = options | NO_SCHEMA_VALIDATION | NO_DATA_VALIDATION;
+
+  if (compiled_read(ps, file) == -1) {
+    if (error) *error = INIT_COMPILED_SCHEMA_FAILED;
+    schema_teardown(ps);
+    return NULL;
+  }
+
+  if (error) *error = 0;
+  return ps;
+}
+
+packedobjectsContext *init_packedobjects_from_compiled(const char *file, size_t bytes, int options)
+{
+  packedobjectsSchema *ps = NULL;
+  packedobjectsContext *pc = NULL;
+
+  if ((ps = init_packedobjects_schema_from_compiled(file, options, NULL)) == NULL) {
+    return NULL;
+  }
+
+  // the context now holds the only reference
+  pc = init_packedobjects_with_schema(ps, bytes, NULL);
+  free_packedobjects_schema(ps);
+
+  return pc;
+}
+
+int packedobjects_write_compiled(packedobjectsSchema *ps, const char *file)
+{
+  return compiled_write(ps, file);
+}
+
+packedobjectsSchema *packedobjects_schema_ref(packedobjectsSchema *ps)
+{
+  __atomic_add_fetch(&ps->refs, 1, __ATOMIC_RELAXED);
+  return ps;
+}
+
+void free_packedobjects_schema(packedobjectsSchema *ps)
+{
+  // the last context or owner to let go frees the schema
+  if (__atomic_sub_fetch(&ps->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    schema_teardown(ps);
+  }
+}
+
+packedobjectsContext *init_packedobjects_with_schema(packedobjectsSchema *ps, size_t bytes, int *error)
+{
+  packedobjectsContext *pc = NULL;
+  int result = 0;
+
+  if ((pc = _init_packedobjects()) == NULL) {
+    if (error) *error = INIT_FAILED;
+    return NULL;
+  }
+
+  // share the compiled schema
+  pc->schema = packedobjects_schema_ref(ps);
+  pc->plan = ps->plan;
+  pc->init_options = ps->init_options;
+
   // used to store the encoded data
   if (encode_make_memory(pc, bytes) == -1) {
-    pc->init_error = INIT_ENCODE_SETUP_FAILED;
-    return NULL;
+    result = INIT_ENCODE_SETUP_FAILED;
+    goto cleanup;
   }
 
-  // check flag
-  if ((options & NO_SCHEMA_VALIDATION) == 0) {
-    // validate the schema conforms to PO schema
-    if (schema_validate_schema(pc) == -1) {
-      pc->init_error = INIT_SCHEMA_VALIDATION_FAILED;
-      return NULL;
-    }
+  // used to read back encoded data
+  if (decode_make_memory(pc) == -1) {
+    result = INIT_DECODE_SETUP_FAILED;
+    goto cleanup;
   }
 
   // check flag
-  if ((options & NO_DATA_VALIDATION) == 0) {  
-    // initialise xml validation code for later 
-    if (schema_setup_validation(pc) == -1) {
-      pc->init_error = INIT_SETUP_VALIDATION_FAILED;
-      return NULL;
+  if ((pc->init_options & NO_DATA_VALIDATION) == 0) {  
+    // validation contexts hold state so every context needs its own
+    if (schema_make_validation_context(pc) == -1) {
+      result = INIT_SETUP_VALIDATION_FAILED;
+      goto cleanup;
     }
   }
   
-  // expand user defined types in schema
-  if (expand_make_expanded_schema(pc) == -1) {
-    pc->init_error = INIT_EXPANDED_SCHEMA_FAILED;
-    return NULL;
-  }
+  if (error) *error = 0;
+  return pc;
 
-  // make the canonical schema used for encoding
-  if (canon_make_canonical_schema(pc) == -1) {
-    pc->init_error = INIT_CANON_SCHEMA_FAILED;
-    return NULL;
+ cleanup:
+  // the context is freed below so the caller can only learn why here
+  if (error) *error = result;
+  // undo whatever was set up before the failure
+  if (pc->encodep) {
+    encode_free_memory(pc);
+  }
+  if (pc->decodep) {
+    decode_free_memory(pc);
   }
+  free_packedobjects_schema(pc->schema);
+  free(pc);
+
+  return NULL;
+}
+
+packedobjectsContext *init_packedobjects(const char *schema_file, size_t bytes, int options)
+{
+  packedobjectsSchema *ps = NULL;
+  packedobjectsContext *pc = NULL;
 
-  // setup xpath to use during encode
-  if (schema_setup_xpath(pc) == -1) {
-    pc->init_error = INIT_XPATH_SETUP_FAILED;
+  if ((ps = init_packedobjects_schema(schema_file, options, NULL)) == NULL) {
     return NULL;
   }
-  
+
+  // the context now holds the only reference
+  pc = init_packedobjects_with_schema(ps, bytes, NULL);
+  free_packedobjects_schema(ps);
+
   return pc;
 }
 
 void free_packedobjects(packedobjectsContext *pc)
 {
   if ((pc->init_options & NO_DATA_VALIDATION) == 0) {  
-    schema_free_validation(pc);
+    schema_free_validation_context(pc);
   }
-  expand_free(pc);
-  canon_free(pc);
-  schema_free_xpath(pc);
   encode_free_memory(pc);
-  schema_free(pc);
+  decode_free_memory(pc);
+  struct_free_binding(pc);
+  free_packedobjects_schema(pc->schema);
   
   // free the structure
   free(pc);
 
-  xmlCleanupParser();
+  // other contexts may still be in use so libxml2 is left to the
+  // application to clean up with xmlCleanupParser
 }
-
-
-
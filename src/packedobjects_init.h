@@ -6,9 +6,23 @@
 #include "canon.h"
 #include "expand.h"
 #include "schema.h"
+#include "plan.h"
+#include "facets.h"
+#include "compiled.h"
+#include "pool.h"
 
 packedobjectsContext *init_packedobjects(const char *schema_file, size_t bytes, int options);
 void free_packedobjects(packedobjectsContext *poCtxPtr);
+// compile a schema once and share it between contexts, one per thread
+packedobjectsSchema *init_packedobjects_schema(const char *schema_file, int options, int *error);
+packedobjectsContext *init_packedobjects_with_schema(packedobjectsSchema *ps, size_t bytes, int *error);
+// a schema saved with packedobjects_write_compiled loads without any XSD processing,
+// data validation is done with the inline checks unless NO_DATA_VALIDATION is passed
+packedobjectsSchema *init_packedobjects_schema_from_compiled(const char *file, int options, int *error);
+packedobjectsContext *init_packedobjects_from_compiled(const char *file, size_t bytes, int options);
+int packedobjects_write_compiled(packedobjectsSchema *ps, const char *file);
+packedobjectsSchema *packedobjects_schema_ref(packedobjectsSchema *ps);
+void free_packedobjects_schema(packedobjectsSchema *ps);
 // low-level api use only
 packedobjectsContext *_init_packedobjects();
 
@@ -0,0 +1,273 @@
+#include "packedobjects_parallel.h"
+
+#ifdef DEBUG_MODE
+#define dbg(fmtstr, args...) \
+  (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#else
+#define dbg(dummy...)
+#endif
+
+#ifdef QUIET_MODE
+#define alert(dummy...)
+#else
+#define alert(fmtstr, args...) \
+  (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#endif
+
+enum JOBS { ENCODE_JOB, DECODE_JOB };
+
+#define RANGE(next, end) (((uint64_t)(end) << 32) | (uint32_t)(next))
+#define RANGE_NEXT(r) ((int)((r) & 0xffffffff))
+#define RANGE_END(r) ((int)((r) >> 32))
+
+static void *worker_main(void *arg);
+static int take_message(packedobjectsWorker *w);
+static int steal_messages(packedobjectsWorker *w);
+static void do_message(packedobjectsWorker *w, int i);
+static int run_job(packedobjectsWorkers *pw, int job, int n);
+
+// the owner works forwards through its range one message at a time
+static int take_message(packedobjectsWorker *w)
+{
+  uint64_t r = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+
+  while (RANGE_NEXT(r) < RANGE_END(r)) {
+    if (__atomic_compare_exchange_n(&w->range, &r, RANGE(RANGE_NEXT(r) + 1, RANGE_END(r)),
+                                    0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return RANGE_NEXT(r);
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * an idle worker takes the back half of the first range it finds with
+ * work left, so a worker stuck on a few large messages hands on the
+ * rest. returns 0 once every range is empty
+ */
+static int steal_messages(packedobjectsWorker *w)
+{
+  packedobjectsWorkers *pw = w->pw;
+  packedobjectsWorker *victim = NULL;
+  uint64_t r;
+  int i, next, end, mid;
+
+  for (i = 1; i < pw->nworkers; i++) {
+    victim = &pw->workers[(w - pw->workers + i) % pw->nworkers];
+    r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    while ((next = RANGE_NEXT(r)) < (end = RANGE_END(r))) {
+      mid = next + (end - next) / 2;
+      if (__atomic_compare_exchange_n(&victim->range, &r, RANGE(next, mid),
+                                      0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&w->range, RANGE(mid, end), __ATOMIC_RELEASE);
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static void do_message(packedobjectsWorker *w, int i)
+{
+  packedobjectsWorkers *pw = w->pw;
+  xmlDocPtr doc = NULL;
+  int len;
+
+  if (pw->job == ENCODE_JOB) {
+    // appended to this worker's buffer and located once the job is done
+    if ((len = encode_append_doc(w->pc, pw->docs[i], w->offset)) < 0) {
+      w->failed++;
+    } else {
+      pw->slots[i].worker = w - pw->workers;
+      pw->slots[i].offset = w->offset;
+      w->offset += len;
+    }
+    pw->lens[i] = len;
+  } else {
+    doc = packedobjects_decode_n(w->pc, pw->bufs[i], pw->lens[i]);
+    if (w->pc->decode_error) {
+      // a document that failed validation is still returned by decode
+      xmlFreeDoc(doc);
+      doc = NULL;
+      w->failed++;
+    }
+    pw->docs[i] = doc;
+    if (pw->errors) pw->errors[i] = w->pc->decode_error;
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  packedobjectsWorker *w = arg;
+  packedobjectsWorkers *pw = w->pw;
+  unsigned seen = 0;
+  int i, quit;
+
+  while (1) {
+    pthread_mutex_lock(&pw->lock);
+    while ((pw->generation == seen) && !pw->quit) {
+      pthread_cond_wait(&pw->start, &pw->lock);
+    }
+    seen = pw->generation;
+    quit = pw->quit;
+    pthread_mutex_unlock(&pw->lock);
+    if (quit) break;
+
+    do {
+      while ((i = take_message(w)) != -1) {
+        do_message(w, i);
+      }
+    } while (steal_messages(w));
+
+    pthread_mutex_lock(&pw->lock);
+    if (--pw->running == 0) {
+      pthread_cond_signal(&pw->done);
+    }
+    pthread_mutex_unlock(&pw->lock);
+  }
+
+  return NULL;
+}
+
+// split the messages evenly, start everyone and wait for them to finish
+static int run_job(packedobjectsWorkers *pw, int job, int n)
+{
+  int i, failed = 0;
+
+  for (i = 0; i < pw->nworkers; i++) {
+    pw->workers[i].range = RANGE((int64_t)n * i / pw->nworkers, (int64_t)n * (i + 1) / pw->nworkers);
+    pw->workers[i].offset = 0;
+    pw->workers[i].failed = 0;
+  }
+  pthread_mutex_lock(&pw->lock);
+  pw->job = job;
+  pw->n = n;
+  pw->running = pw->nworkers;
+  pw->generation++;
+  pthread_cond_broadcast(&pw->start);
+  while (pw->running) {
+    pthread_cond_wait(&pw->done, &pw->lock);
+  }
+  pthread_mutex_unlock(&pw->lock);
+
+  for (i = 0; i < pw->nworkers; i++) {
+    failed += pw->workers[i].failed;
+  }
+
+  return failed;
+}
+
+packedobjectsWorkers *packedobjects_workers_new(packedobjectsSchema *ps, int nthreads, size_t bytes)
+{
+  packedobjectsWorkers *pw = NULL;
+  int i, error;
+
+  if (nthreads < 1) {
+    alert("Need at least one worker.");
+    return NULL;
+  }
+  if ((pw = (packedobjectsWorkers *)calloc(1, sizeof(packedobjectsWorkers))) == NULL) {
+    alert("Could not allocate memory.");
+    return NULL;
+  }
+  if ((pw->workers = (packedobjectsWorker *)calloc(nthreads, sizeof(packedobjectsWorker))) == NULL) {
+    alert("Could not allocate memory.");
+    free(pw);
+    return NULL;
+  }
+  pthread_mutex_init(&pw->lock, NULL);
+  pthread_cond_init(&pw->start, NULL);
+  pthread_cond_init(&pw->done, NULL);
+
+  // every context is made before any thread starts
+  for (i = 0; i < nthreads; i++) {
+    pw->workers[i].pw = pw;
+    if ((pw->workers[i].pc = init_packedobjects_with_schema(ps, bytes, &error)) == NULL) {
+      alert("Failed to create context for worker %d with error %d.", i, error);
+      packedobjects_workers_free(pw);
+      return NULL;
+    }
+    pw->ncontexts++;
+  }
+  for (i = 0; i < nthreads; i++) {
+    if (pthread_create(&pw->workers[i].thread, NULL, worker_main, &pw->workers[i])) {
+      alert("Failed to start worker %d.", i);
+      packedobjects_workers_free(pw);
+      return NULL;
+    }
+    pw->nworkers++;
+  }
+  dbg("started %d workers", pw->nworkers);
+
+  return pw;
+}
+
+void packedobjects_workers_free(packedobjectsWorkers *pw)
+{
+  int i;
+
+  pthread_mutex_lock(&pw->lock);
+  pw->quit = 1;
+  pthread_cond_broadcast(&pw->start);
+  pthread_mutex_unlock(&pw->lock);
+  // only the threads that started are counted
+  for (i = 0; i < pw->nworkers; i++) {
+    pthread_join(pw->workers[i].thread, NULL);
+  }
+  for (i = 0; i < pw->ncontexts; i++) {
+    free_packedobjects(pw->workers[i].pc);
+  }
+  pthread_mutex_destroy(&pw->lock);
+  pthread_cond_destroy(&pw->start);
+  pthread_cond_destroy(&pw->done);
+
+  free(pw->slots);
+  free(pw->workers);
+  free(pw);
+}
+
+/* 
+ * each worker appends its PDUs to its own context's buffer, so like a
+ * batch the results stay valid until the next job on these workers
+ */
+int packedobjects_encode_parallel(packedobjectsWorkers *pw, xmlDocPtr *docs, int n, char **out_bufs, int *out_lens)
+{
+  packedobjectsSlot *slots = NULL;
+  int i, failed;
+
+  // kept between jobs so a steady stream of batches stops allocating
+  if (n > pw->nslots) {
+    if ((slots = (packedobjectsSlot *)realloc(pw->slots, n * sizeof(packedobjectsSlot))) == NULL) {
+      alert("Could not allocate memory.");
+      return -1;
+    }
+    pw->slots = slots;
+    pw->nslots = n;
+  }
+  pw->docs = docs;
+  pw->lens = out_lens;
+  failed = run_job(pw, ENCODE_JOB, n);
+
+  // the buffers may have moved as they grew so hand out pointers last
+  for (i = 0; i < n; i++) {
+    if (out_lens[i] < 0) {
+      out_bufs[i] = NULL;
+    } else {
+      out_bufs[i] = pw->workers[pw->slots[i].worker].pc->encodep->pdu + pw->slots[i].offset;
+    }
+  }
+
+  return failed;
+}
+
+int packedobjects_decode_parallel(packedobjectsWorkers *pw, char **pdus, int *lens, int n, xmlDocPtr *out_docs, int *errors)
+{
+  pw->bufs = pdus;
+  pw->lens = lens;
+  pw->docs = out_docs;
+  pw->errors = errors;
+
+  return run_job(pw, DECODE_JOB, n);
+}
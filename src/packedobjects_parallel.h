@@ -0,0 +1,58 @@
+#ifndef PACKEDOBJECTS_PARALLEL_H_
+#define PACKEDOBJECTS_PARALLEL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "packedobjects.h"
+
+struct packedobjectsWorkers;
+
+typedef struct {
+  struct packedobjectsWorkers *pw;
+  packedobjectsContext *pc;
+  pthread_t thread;
+  // messages still to do, next in the low 32 bits and end in the high
+  uint64_t range;
+  // where this worker's next PDU goes in its buffer
+  int offset;
+  int failed;
+} packedobjectsWorker;
+
+// where each PDU of a parallel encode ended up
+typedef struct {
+  int worker;
+  int offset;
+} packedobjectsSlot;
+
+typedef struct packedobjectsWorkers {
+  packedobjectsWorker *workers;
+  int nworkers;
+  int ncontexts;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  // bumped for each job so a worker knows it has something new to do
+  unsigned generation;
+  int running;
+  int quit;
+  // the current job
+  int job;
+  int n;
+  xmlDocPtr *docs;
+  char **bufs;
+  int *lens;
+  int *errors;
+  packedobjectsSlot *slots;
+  int nslots;
+} packedobjectsWorkers;
+
+// nthreads workers each with a context made from ps
+packedobjectsWorkers *packedobjects_workers_new(packedobjectsSchema *ps, int nthreads, size_t bytes);
+void packedobjects_workers_free(packedobjectsWorkers *pw);
+// as packedobjects_encode_batch with the documents shared between the workers
+int packedobjects_encode_parallel(packedobjectsWorkers *pw, xmlDocPtr *docs, int n, char **out_bufs, int *out_lens);
+// out_docs[i] is NULL and errors[i] the decode error if pdus[i] failed
+int packedobjects_decode_parallel(packedobjectsWorkers *pw, char **pdus, int *lens, int n, xmlDocPtr *out_docs, int *errors);
+
+#endif
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packedobjects_struct.h"
+
+#ifdef DEBUG_MODE
+#define dbg(fmtstr, args...) \
+  (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#else
+#define dbg(dummy...)
+#endif
+
+#ifdef QUIET_MODE
+#define alert(dummy...)
+#else
+#define alert(fmtstr, args...) \
+  (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#endif
+
+static structNode *new_node(planNode *plan);
+static void free_node(structNode *sn);
+static structNode *find_node(structNode *root, const char *path);
+static int bind_field(structNode *root, const po_field *f);
+static int check_node(structNode *sn);
+static int is_number(planNode *plan);
+static int is_text(planNode *plan);
+
+// a mirror of the plan with nothing bound yet
+static structNode *new_node(planNode *plan)
+{
+  structNode *sn = NULL;
+  int i;
+
+  if ((sn = (structNode *)calloc(1, sizeof(structNode))) == NULL) {
+    alert("Could not allocate memory.");
+    return NULL;
+  }
+  sn->plan = plan;
+  if (plan->nchildren == 0) {
+    return sn;
+  }
+  if ((sn->children = (structNode **)calloc(plan->nchildren, sizeof(structNode *))) == NULL) {
+    alert("Could not allocate memory.");
+    free(sn);
+    return NULL;
+  }
+  for (i = 0; i < plan->nchildren; i++) {
+    if ((sn->children[i] = new_node(plan->children[i])) == NULL) {
+      free_node(sn);
+      return NULL;
+    }
+  }
+
+  return sn;
+}
+
+static void free_node(structNode *sn)
+{
+  int i;
+
+  if (sn->children) {
+    for (i = 0; i < sn->plan->nchildren; i++) {
+      if (sn->children[i]) free_node(sn->children[i]);
+    }
+    free(sn->children);
+  }
+  free(sn);
+}
+
+// path is absolute so its first name must be the root's
+static structNode *find_node(structNode *root, const char *path)
+{
+  structNode *sn = NULL;
+  const char *name = path;
+  size_t len;
+  int i;
+
+  while (*name == '/') {
+    name++;
+    len = strcspn(name, "/");
+    if (sn == NULL) {
+      if ((len != xmlStrlen(root->plan->name)) || strncmp(name, (const char *)root->plan->name, len)) {
+        return NULL;
+      }
+      sn = root;
+    } else {
+      for (i = 0; i < sn->plan->nchildren; i++) {
+        if ((len == xmlStrlen(sn->plan->children[i]->name)) &&
+            !strncmp(name, (const char *)sn->plan->children[i]->name, len)) break;
+      }
+      if (i == sn->plan->nchildren) {
+        return NULL;
+      }
+      sn = sn->children[i];
+    }
+    name += len;
+  }
+
+  return (*name == '\0') ? sn : NULL;
+}
+
+static int is_number(planNode *plan)
+{
+
+  switch (plan->type) {
+  case INTEGER_TYPE:
+  case BOOLEAN_TYPE:
+  case ENUMERATED_TYPE:
+  case CURRENCY_TYPE:
+  case IPV4_ADDRESS_TYPE:
+  case UNIX_TIME_TYPE:
+    return 1;
+  }
+
+  return 0;
+}
+
+static int is_text(planNode *plan)
+{
+
+  switch (plan->type) {
+  case STRING_TYPE:
+  case BIT_STRING_TYPE:
+  case NUMERIC_STRING_TYPE:
+  case HEX_STRING_TYPE:
+  case OCTET_STRING_TYPE:
+  case DECIMAL_TYPE:
+  case UTF8_STRING_TYPE:
+    return 1;
+  }
+
+  return 0;
+}
+
+static int bind_field(structNode *root, const po_field *f)
+{
+  structNode *sn = NULL;
+  planNode *plan = NULL;
+  int ok = 0;
+
+  if ((sn = find_node(root, f->path)) == NULL) {
+    alert("%s is not an element in schema.", f->path);
+    return -1;
+  }
+  plan = sn->plan;
+  switch (f->kind) {
+  case PO_INT:
+  case PO_LONG:
+    ok = is_number(plan);
+    break;
+  case PO_STRING:
+    ok = is_text(plan);
+    break;
+  case PO_CHARS:
+    ok = is_text(plan) && (f->size > 0);
+    break;
+  case PO_FLAG:
+    ok = plan->parent && (plan->parent->type == SEQUENCE_OPTIONAL_TYPE);
+    break;
+  case PO_CHOICE:
+    ok = (plan->type == CHOICE_TYPE);
+    break;
+  case PO_ARRAY:
+    ok = (plan->type == SEQUENCE_OF_TYPE) && (f->size > 0);
+    break;
+  }
+  if (!ok) {
+    alert("%s can't be held as a field of kind %d.", f->path, f->kind);
+    return -1;
+  }
+  if ((f->kind == PO_FLAG) ? (sn->flag != NULL) : (sn->value != NULL)) {
+    alert("%s has more than one field.", f->path);
+    return -1;
+  }
+  if (f->kind == PO_FLAG) {
+    sn->flag = f;
+  } else {
+    sn->value = f;
+  }
+
+  return 0;
+}
+
+// everything the encoder will ask for has to be somewhere
+static int check_node(structNode *sn)
+{
+  planNode *plan = sn->plan;
+  int i;
+
+  switch (plan->type) {
+  case SEQUENCE_TYPE:
+  case SEQUENCE_OPTIONAL_TYPE:
+  case NULL_TYPE:
+    break;
+  default:
+    if (sn->value == NULL) {
+      alert("Element %s has no field.", plan->name);
+      return -1;
+    }
+  }
+  if (plan->parent && (plan->parent->type == SEQUENCE_OPTIONAL_TYPE) && (sn->flag == NULL) &&
+      ((sn->value == NULL) || (sn->value->kind != PO_STRING))) {
+    alert("Optional element %s has no flag.", plan->name);
+    return -1;
+  }
+  for (i = 0; i < plan->nchildren; i++) {
+    if (check_node(sn->children[i]) == -1) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int packedobjects_register_struct(packedobjectsContext *pc, const po_field *fields, int n, size_t size)
+{
+  structBinding *sb = NULL;
+  int i;
+
+  if ((sb = (structBinding *)calloc(1, sizeof(structBinding))) == NULL) {
+    alert("Could not allocate memory.");
+    return -1;
+  }
+  // the caller's table need not outlive the call
+  if (((sb->fields = (po_field *)malloc(n * sizeof(po_field))) == NULL) ||
+      ((sb->root = new_node(pc->plan)) == NULL)) {
+    alert("Could not allocate memory.");
+    free(sb->fields);
+    free(sb);
+    return -1;
+  }
+  memcpy(sb->fields, fields, n * sizeof(po_field));
+  sb->size = size;
+  for (i = 0; i < n; i++) {
+    if (bind_field(sb->root, &sb->fields[i]) == -1) break;
+  }
+  if ((i < n) || (check_node(sb->root) == -1)) {
+    free_node(sb->root);
+    free(sb->fields);
+    free(sb);
+    return -1;
+  }
+  // the path strings belong to the caller
+  for (i = 0; i < n; i++) {
+    sb->fields[i].path = NULL;
+  }
+  struct_free_binding(pc);
+  pc->binding = sb;
+  dbg("bound %d fields", n);
+
+  return 0;
+}
+
+void struct_free_binding(packedobjectsContext *pc)
+{
+
+  if (pc->binding) {
+    free_node(pc->binding->root);
+    free(pc->binding->fields);
+    free(pc->binding);
+    pc->binding = NULL;
+  }
+
+}
+
+// only ever follows what decode wrote, so an absent element has nothing to free
+void struct_free_node(structNode *sn, char *base)
+{
+  planNode *plan = sn->plan;
+  char *items = NULL;
+  int i, j, count, choice;
+
+  switch (plan->type) {
+  case SEQUENCE_OF_TYPE:
+    items = *STRUCT_FIELD(base, sn->value, char *);
+    count = *STRUCT_COUNT(base, sn->value);
+    for (i = 0; items && (i < count); i++) {
+      for (j = 0; j < plan->nchildren; j++) {
+        struct_free_node(sn->children[j], items + i * sn->value->size);
+      }
+    }
+    free(items);
+    *STRUCT_FIELD(base, sn->value, char *) = NULL;
+    *STRUCT_COUNT(base, sn->value) = 0;
+    break;
+  case CHOICE_TYPE:
+    // the others may share its memory
+    choice = *STRUCT_FIELD(base, sn->value, int);
+    if ((choice >= 1) && (choice <= plan->nchildren)) {
+      struct_free_node(sn->children[choice - 1], base);
+    }
+    break;
+  case SEQUENCE_OPTIONAL_TYPE:
+    for (i = 0; i < plan->nchildren; i++) {
+      if ((sn->children[i]->flag == NULL) || *STRUCT_FIELD(base, sn->children[i]->flag, int)) {
+        struct_free_node(sn->children[i], base);
+      }
+    }
+    break;
+  default:
+    if (sn->value && (sn->value->kind == PO_STRING)) {
+      free(*STRUCT_FIELD(base, sn->value, char *));
+      *STRUCT_FIELD(base, sn->value, char *) = NULL;
+    }
+    for (i = 0; i < plan->nchildren; i++) {
+      struct_free_node(sn->children[i], base);
+    }
+  }
+
+}
+
+void packedobjects_free_struct(packedobjectsContext *pc, void *msg)
+{
+
+  if (pc->binding) {
+    struct_free_node(pc->binding->root, msg);
+  }
+
+}
@@ -0,0 +1,67 @@
+#ifndef PACKEDOBJECTS_STRUCT_H_
+#define PACKEDOBJECTS_STRUCT_H_
+
+#include <stddef.h>
+
+#include "packedobjects.h"
+
+// how a field is held in the caller's struct
+enum STRUCT_KINDS {
+  // integer, boolean, enumerated index, currency in cents, ipv4-address in
+  // host byte order and unix-time in seconds
+  PO_INT = 1,
+  PO_LONG,
+  // any string type, decimal or utf8-string. decode allocates a STRING and
+  // copies into the size bytes of CHARS
+  PO_STRING,
+  PO_CHARS,
+  // int which is non zero when an optional element is present, a STRING
+  // needs none as NULL means absent
+  PO_FLAG,
+  // int holding the 1 based child of a choice
+  PO_CHOICE,
+  // pointer to items of size bytes with an int count at count_offset
+  PO_ARRAY,
+};
+
+/*
+ * one element of the canonical schema, named by its absolute path such as
+ * "/personnel/name/givenName". offsets are from the start of the struct
+ * or, inside a sequence-of, from the start of the item
+ */
+typedef struct {
+  const char *path;
+  int kind;
+  size_t offset;
+  size_t size;
+  size_t count_offset;
+} po_field;
+
+#define STRUCT_FIELD(base, f, type) ((type *)((char *)(base) + (f)->offset))
+#define STRUCT_COUNT(base, f) ((int *)((char *)(base) + (f)->count_offset))
+
+// the plan with the fields bound to it
+typedef struct structNode {
+  planNode *plan;
+  const po_field *value;
+  const po_field *flag;
+  // the same order as the plan's children
+  struct structNode **children;
+} structNode;
+
+typedef struct structBinding {
+  structNode *root;
+  po_field *fields;
+  size_t size;
+} structBinding;
+
+// every element of the schema must have a field, size is the whole struct
+int packedobjects_register_struct(packedobjectsContext *pc, const po_field *fields, int n, size_t size);
+// release what packedobjects_decode_struct allocated
+void packedobjects_free_struct(packedobjectsContext *pc, void *msg);
+
+// auxillary functions
+void struct_free_binding(packedobjectsContext *pc);
+void struct_free_node(structNode *sn, char *base);
+
+#endif
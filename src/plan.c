@@ -0,0 +1,292 @@
+#include "plan.h"
+
+#ifdef DEBUG_MODE
+#define dbg(fmtstr, args...) \
+  (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#else
+#define dbg(dummy...)
+#endif
+
+#ifdef QUIET_MODE
+#define alert(dummy...)
+#else
+#define alert(fmtstr, args...) \
+  (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#endif
+
+typedef struct {
+  const char *name;
+  int value;
+} planName;
+
+static planName type_names[] = {
+  { "integer", INTEGER_TYPE },
+  { "string", STRING_TYPE },
+  { "bit-string", BIT_STRING_TYPE },
+  { "numeric-string", NUMERIC_STRING_TYPE },
+  { "hex-string", HEX_STRING_TYPE },
+  { "octet-string", OCTET_STRING_TYPE },
+  { "sequence", SEQUENCE_TYPE },
+  { "sequence-of", SEQUENCE_OF_TYPE },
+  { "sequence-optional", SEQUENCE_OPTIONAL_TYPE },
+  { "null", NULL_TYPE },
+  { "boolean", BOOLEAN_TYPE },
+  { "choice", CHOICE_TYPE },
+  { "enumerated", ENUMERATED_TYPE },
+  { "currency", CURRENCY_TYPE },
+  { "decimal", DECIMAL_TYPE },
+  { "ipv4-address", IPV4_ADDRESS_TYPE },
+  { "utf8-string", UTF8_STRING_TYPE },
+  { "unix-time", UNIX_TIME_TYPE },
+  { NULL, UNKNOWN_TYPE }
+};
+
+static planName variant_names[] = {
+  { "unconstrained", UNCONSTRAINED },
+  { "semi-constrained", SEMI_CONSTRAINED },
+  { "constrained", CONSTRAINED },
+  { "fixed-length", FIXED_LENGTH },
+  { NULL, UNKNOWN_VARIANT }
+};
+
+static int lookup_name(planName *names, xmlNodePtr node, const char *prop);
+static planNode *make_plan_node(xmlDictPtr dict, xmlNodePtr schema_node, planNode *parent);
+static int set_facets(planNode *np, xmlNodePtr schema_node);
+static int get_int_prop(xmlNodePtr node, const char *name, int *value);
+static void free_plan_node(planNode *np);
+
+// map a type or variant attribute onto its enum
+static int lookup_name(planName *names, xmlNodePtr node, const char *prop)
+{
+  xmlChar *value = NULL;
+  planName *np = names;
+
+  // a missing attribute falls through to the terminating entry
+  value = xmlGetProp(node, BAD_CAST prop);
+  while (np->name) {
+    if (xmlStrEqual(value, BAD_CAST np->name)) break;
+    np++;
+  }
+  xmlFree(value);
+
+  return np->value;
+}
+
+// returns 1 and sets value if the attribute exists
+static int get_int_prop(xmlNodePtr node, const char *name, int *value)
+{
+  xmlChar *prop = NULL;
+
+  if ((prop = xmlGetProp(node, BAD_CAST name)) == NULL) {
+    return 0;
+  }
+  *value = atoi((const char *) prop);
+  xmlFree(prop);
+
+  return 1;
+}
+
+static int set_facets(planNode *np, xmlNodePtr schema_node)
+{
+  xmlChar *maxOccurs = NULL;
+  xmlAttrPtr attr = NULL;
+  int lb = 0, ub = 0, i = 0;
+
+  np->lb = 0;
+  np->ub = 0;
+  np->length = 0;
+  np->items = 0;
+  np->bits = 0;
+  np->unbounded = 0;
+  np->has_max = 0;
+  np->enumeration = NULL;
+
+  get_int_prop(schema_node, "items", &np->items);
+  get_int_prop(schema_node, "length", &np->length);
+
+  // integer bounds
+  if (get_int_prop(schema_node, "minInclusive", &lb)) np->lb = lb;
+  if (get_int_prop(schema_node, "maxInclusive", &ub)) {
+    np->ub = ub;
+    np->has_max = 1;
+  }
+  // string length bounds
+  if (get_int_prop(schema_node, "minLength", &lb)) np->lb = lb;
+  if (get_int_prop(schema_node, "maxLength", &ub)) np->ub = ub;
+  // sequence-of bounds with a default of 0
+  if (get_int_prop(schema_node, "minOccurs", &lb)) np->lb = lb;
+  if ((maxOccurs = xmlGetProp(schema_node, BAD_CAST "maxOccurs"))) {
+    if (xmlStrEqual(maxOccurs, BAD_CAST "unbounded")) {
+      np->unbounded = 1;
+    } else {
+      np->ub = atoi((const char *) maxOccurs);
+    }
+    xmlFree(maxOccurs);
+  }
+
+  if (np->type == CHOICE_TYPE) {
+    np->bits = bitsRequired(1, np->items);
+  } else if (np->type == ENUMERATED_TYPE) {
+    np->bits = bitsRequired(0, np->items - 1);
+  } else if (!np->unbounded) {
+    np->bits = bitsRequired(np->lb, np->ub);
+  }
+  
+  if (np->type == ENUMERATED_TYPE) {
+    // point at the values held by the canonical schema
+    if ((np->enumeration = (const xmlChar **)calloc(np->items, sizeof(xmlChar *))) == NULL) {
+      alert("Could not allocate memory.");
+      return -1;
+    }
+    for (attr = schema_node->properties; attr; attr = attr->next) {
+      if ((xmlStrEqual(attr->name, BAD_CAST "enumeration")) && (i < np->items)) {
+        np->enumeration[i++] = (attr->children) ? attr->children->content : BAD_CAST "";
+      }
+    }
+  }
+
+  return 0;
+}
+
+static planNode *make_plan_node(xmlDictPtr dict, xmlNodePtr schema_node, planNode *parent)
+{
+  planNode *np = NULL;
+  xmlNodePtr cur_node = NULL;
+  int i = 0;
+
+  if ((np = (planNode *)malloc(sizeof(planNode))) == NULL) {
+    alert("Could not allocate memory.");
+    return NULL;
+  }
+
+  // interned so decoded documents can share the name rather than copy it
+  if ((np->name = xmlDictLookup(dict, schema_node->name, -1)) == NULL) {
+    alert("Could not allocate memory.");
+    free(np);
+    return NULL;
+  }
+  np->schema_node = schema_node;
+  np->parent = parent;
+  np->children = NULL;
+  np->nchildren = xmlChildElementCount(schema_node);
+  np->type = lookup_name(type_names, schema_node, "type");
+  np->variant = lookup_name(variant_names, schema_node, "variant");
+
+  if (set_facets(np, schema_node) == -1) {
+    free(np);
+    return NULL;
+  }
+
+  if (np->nchildren == 0) {
+    np->min_bits = plan_min_bits(np);
+    return np;
+  }
+
+  // zeroed so a partly built node can still be freed
+  if ((np->children = (planNode **)calloc(np->nchildren, sizeof(planNode *))) == NULL) {
+    alert("Could not allocate memory.");
+    free(np->enumeration);
+    free(np);
+    return NULL;
+  }
+  
+  for (cur_node = schema_node->children; cur_node; cur_node = cur_node->next) {
+    if (cur_node->type == XML_ELEMENT_NODE) {
+      if ((np->children[i] = make_plan_node(dict, cur_node, np)) == NULL) {
+        free_plan_node(np);
+        return NULL;
+      }
+      i++;
+    }
+  }
+  np->min_bits = plan_min_bits(np);
+
+  return np;
+}
+
+static void free_plan_node(planNode *np)
+{
+  int i;
+
+  for (i = 0; i < np->nchildren; i++) {
+    if (np->children[i]) {
+      free_plan_node(np->children[i]);
+    }
+  }
+  free(np->children);
+  free(np->enumeration);
+  free(np);
+}
+
+int plan_make_plan(packedobjectsSchema *ps)
+{
+  planNode *plan = NULL;
+  xmlNodePtr root_node = NULL;
+
+  if ((root_node = xmlDocGetRootElement(ps->doc_canonical_schema)) == NULL) {
+    alert("Canonical schema has no root element.");
+    return -1;
+  }
+
+  if ((ps->dict = xmlDictCreate()) == NULL) {
+    alert("Failed to create dictionary.");
+    return -1;
+  }
+
+  // build the plan once so encoding and decoding never search the schema
+  if ((plan = make_plan_node(ps->dict, root_node, NULL)) == NULL) {
+    alert("Failed to create encoding plan.");
+    return -1;
+  }
+  ps->plan = plan;
+
+  return 0;
+}
+
+// data arrives in schema order so start looking where we last matched
+planNode *plan_find_child(planNode *parent, const xmlChar *name, int *cursor)
+{
+  int i, n;
+
+  n = parent->nchildren;
+  for (i = 0; i < n; i++) {
+    int j = (*cursor + i) % n;
+    if (xmlStrEqual(parent->children[j]->name, name)) {
+      *cursor = j;
+      return parent->children[j];
+    }
+  }
+  
+  return NULL;
+}
+
+void plan_free(packedobjectsSchema *ps)
+{
+
+  if (ps->plan) {
+    free_plan_node(ps->plan);
+  }
+  // documents still holding the names keep their own reference
+  if (ps->dict) {
+    xmlDictFree(ps->dict);
+  }
+  
+}
+
+// the children built already, so a node is done bottom up
+int plan_min_bits(planNode *np)
+{
+  return minimumBits(np->type, np->variant, np->length, np->items, plan_item_bits(np));
+}
+
+// least bits one item of a sequence-of takes, the sum of its children
+int plan_item_bits(planNode *np)
+{
+  int i, bits = 0;
+
+  for (i = 0; i < np->nchildren; i++) {
+    bits += np->children[i]->min_bits;
+  }
+
+  return bits;
+}
@@ -0,0 +1,12 @@
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#include "packedobjects.h"
+
+int plan_make_plan(packedobjectsSchema *ps);
+planNode *plan_find_child(planNode *parent, const xmlChar *name, int *cursor);
+int plan_min_bits(planNode *np);
+int plan_item_bits(planNode *np);
+void plan_free(packedobjectsSchema *ps);
+
+#endif
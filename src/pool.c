@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+#ifdef DEBUG_MODE
+#define dbg(fmtstr, args...) \
+  (printf(PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#else
+#define dbg(dummy...)
+#endif
+
+#ifdef QUIET_MODE
+#define alert(dummy...)
+#else
+#define alert(fmtstr, args...) \
+  (fprintf(stderr, PROGNAME ":%s: " fmtstr "\n", __func__, ##args))
+#endif
+
+// blocks come in powers of two from 16 bytes to 64k, anything bigger is
+// passed straight to the system allocator
+#define POOL_MIN_SHIFT 4
+#define POOL_MAX_SHIFT 16
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_LARGE -1
+#define POOL_BYTES(cls) ((size_t)1 << ((cls) + POOL_MIN_SHIFT))
+
+// freed blocks of each size for one thread, linked through their first
+// word. per thread so contexts in different threads never contend
+typedef struct poolHeap {
+  void *free_list[POOL_CLASSES];
+  // blocks other threads have handed back, taken over when a list is empty
+  void *remote[POOL_CLASSES];
+  // blocks from the system not yet returned to it, plus one for the thread
+  unsigned long refs;
+  int exited;
+} poolHeap;
+
+// sits in front of every block, padded so the block stays aligned
+typedef union {
+  struct {
+    int cls;
+    union {
+      // of a large block
+      size_t size;
+      // the heap a pooled block goes back to
+      poolHeap *owner;
+    } u;
+  } h;
+  max_align_t align;
+} poolHeader;
+
+static __thread poolHeap *pool_heap = NULL;
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static unsigned long pool_system_allocs = 0;
+
+static void pool_make_key(void);
+static poolHeap *pool_thread_heap(void);
+static unsigned long pool_release(void *mem);
+static void pool_heap_unref(poolHeap *heap, unsigned long n);
+static void pool_heap_exit(void *arg);
+static int pool_class(size_t size);
+static void *pool_malloc(size_t size);
+static void pool_free(void *mem);
+static void *pool_realloc(void *mem, size_t size);
+static char *pool_strdup(const char *s);
+
+static void pool_make_key(void)
+{
+  // drains a thread's lists when it exits
+  if (pthread_key_create(&pool_key, pool_heap_exit) != 0) {
+    alert("Failed to create thread key.");
+  }
+}
+
+static poolHeap *pool_thread_heap(void)
+{
+  poolHeap *heap = NULL;
+
+  if (pool_heap) return pool_heap;
+  if ((heap = calloc(1, sizeof(poolHeap))) == NULL) return NULL;
+  heap->refs = 1;
+  pthread_once(&pool_once, pool_make_key);
+  if (pthread_setspecific(pool_key, heap) != 0) {
+    free(heap);
+    return NULL;
+  }
+  pool_heap = heap;
+
+  return heap;
+}
+
+// hand a list of blocks back to the system, returns how many there were
+static unsigned long pool_release(void *mem)
+{
+  unsigned long n = 0;
+  void *next = NULL;
+
+  while (mem) {
+    next = *(void **)mem;
+    free((poolHeader *)mem - 1);
+    mem = next;
+    n++;
+  }
+
+  return n;
+}
+
+static void pool_heap_unref(poolHeap *heap, unsigned long n)
+{
+  if (__atomic_sub_fetch(&heap->refs, n, __ATOMIC_ACQ_REL) == 0) {
+    free(heap);
+  }
+}
+
+static void pool_heap_exit(void *arg)
+{
+  poolHeap *heap = arg;
+  unsigned long n = 0;
+  int cls;
+
+  pool_heap = NULL;
+  // from now on a thread handing a block back releases it itself
+  __atomic_store_n(&heap->exited, 1, __ATOMIC_SEQ_CST);
+  for (cls = 0; cls < POOL_CLASSES; cls++) {
+    n += pool_release(heap->free_list[cls]);
+    n += pool_release(__atomic_exchange_n(&heap->remote[cls], NULL, __ATOMIC_SEQ_CST));
+  }
+  // blocks still in use elsewhere keep the heap until they come back
+  pool_heap_unref(heap, n + 1);
+}
+
+static int pool_class(size_t size)
+{
+  int cls = 0;
+
+  while ((cls < POOL_CLASSES) && (POOL_BYTES(cls) < size)) cls++;
+
+  return (cls < POOL_CLASSES) ? cls : POOL_LARGE;
+}
+
+static void *pool_malloc(size_t size)
+{
+  poolHeap *heap = NULL;
+  poolHeader *hp = NULL;
+  void *mem = NULL;
+  int cls = pool_class(size);
+
+  if (cls != POOL_LARGE) {
+    // without a heap the block is not pooled
+    if ((heap = pool_thread_heap()) == NULL) {
+      cls = POOL_LARGE;
+    } else if ((mem = heap->free_list[cls]) != NULL ||
+               (mem = __atomic_exchange_n(&heap->remote[cls], NULL, __ATOMIC_ACQUIRE)) != NULL) {
+      heap->free_list[cls] = *(void **)mem;
+      return mem;
+    }
+  }
+  if ((hp = malloc(sizeof(poolHeader) + ((cls == POOL_LARGE) ? size : POOL_BYTES(cls)))) == NULL) {
+    return NULL;
+  }
+  __atomic_add_fetch(&pool_system_allocs, 1, __ATOMIC_RELAXED);
+  hp->h.cls = cls;
+  if (cls == POOL_LARGE) {
+    hp->h.u.size = size;
+  } else {
+    __atomic_add_fetch(&heap->refs, 1, __ATOMIC_RELAXED);
+    hp->h.u.owner = heap;
+  }
+
+  return hp + 1;
+}
+
+static void pool_free(void *mem)
+{
+  poolHeap *heap = NULL;
+  poolHeader *hp = NULL;
+  void *head = NULL;
+  unsigned long n = 0;
+
+  if (mem == NULL) return;
+  hp = (poolHeader *)mem - 1;
+  if (hp->h.cls == POOL_LARGE) {
+    free(hp);
+    return;
+  }
+  heap = hp->h.u.owner;
+  if (heap == pool_heap) {
+    *(void **)mem = heap->free_list[hp->h.cls];
+    heap->free_list[hp->h.cls] = mem;
+    return;
+  }
+  // freed by another thread so give it back to the one that owns it,
+  // holding the heap in case that thread exits meanwhile
+  __atomic_add_fetch(&heap->refs, 1, __ATOMIC_RELAXED);
+  head = __atomic_load_n(&heap->remote[hp->h.cls], __ATOMIC_RELAXED);
+  do {
+    *(void **)mem = head;
+  } while (!__atomic_compare_exchange_n(&heap->remote[hp->h.cls], &head, mem, 1,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+  // nobody is left to take it back
+  if (__atomic_load_n(&heap->exited, __ATOMIC_SEQ_CST)) {
+    n = pool_release(__atomic_exchange_n(&heap->remote[hp->h.cls], NULL, __ATOMIC_SEQ_CST));
+  }
+  pool_heap_unref(heap, n + 1);
+}
+
+static void *pool_realloc(void *mem, size_t size)
+{
+  poolHeader *hp = NULL;
+  void *grown = NULL;
+  size_t old;
+
+  if (mem == NULL) return pool_malloc(size);
+  hp = (poolHeader *)mem - 1;
+  old = (hp->h.cls == POOL_LARGE) ? hp->h.u.size : POOL_BYTES(hp->h.cls);
+  // the block already has room
+  if ((hp->h.cls != POOL_LARGE) && (size <= old)) return mem;
+  if ((hp->h.cls == POOL_LARGE) && (pool_class(size) == POOL_LARGE)) {
+    if ((hp = realloc(hp, sizeof(poolHeader) + size)) == NULL) return NULL;
+    __atomic_add_fetch(&pool_system_allocs, 1, __ATOMIC_RELAXED);
+    hp->h.u.size = size;
+    return hp + 1;
+  }
+  if ((grown = pool_malloc(size)) == NULL) return NULL;
+  memcpy(grown, mem, (old < size) ? old : size);
+  pool_free(mem);
+
+  return grown;
+}
+
+static char *pool_strdup(const char *s)
+{
+  size_t len = strlen(s) + 1;
+  char *copy = NULL;
+
+  if ((copy = pool_malloc(len)) == NULL) return NULL;
+  memcpy(copy, s, len);
+
+  return copy;
+}
+
+int packedobjects_pool_memory(void)
+{
+  // libxml2 must not have allocated anything yet as it would be freed here
+  if (xmlMemSetup(pool_free, pool_malloc, pool_realloc, pool_strdup) != 0) {
+    alert("Failed to install pooled memory functions.");
+    return -1;
+  }
+
+  return 0;
+}
+
+unsigned long packedobjects_pool_system_allocs(void)
+{
+  return __atomic_load_n(&pool_system_allocs, __ATOMIC_RELAXED);
+}
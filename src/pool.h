@@ -0,0 +1,11 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include "packedobjects.h"
+
+// opt in to recycling libxml2 memory, call before anything else uses libxml2
+int packedobjects_pool_memory(void);
+// calls made to the system allocator on behalf of the pool so far
+unsigned long packedobjects_pool_system_allocs(void);
+
+#endif
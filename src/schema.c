@@ -25,11 +25,11 @@ static const char *schema_rules_file_ios();
 static char *CFStringCopyUTF8String(CFStringRef aString);
 #endif
 
-static schemaData *compile_schema(xmlDoc *schema)
+// parse only, the compiled schema may then be shared by many validation contexts
+static schemaData *parse_schema(xmlDoc *schema)
 {
   xmlSchemaParserCtxtPtr parserCtxt = NULL;
   xmlSchemaPtr schemaPtr = NULL;
-  xmlSchemaValidCtxtPtr validCtxt = NULL;
 
   schemaData *schemap;
 
@@ -48,19 +48,30 @@ static schemaData *compile_schema(xmlDoc *schema)
     fprintf(stderr, "Could not parse XSD schema.\n");
     exit(1);
   }
-  validCtxt = xmlSchemaNewValidCtxt(schemaPtr);
-  if (!validCtxt) {
-    fprintf(stderr, "Could not create XSD schema validation context.\n");
-    return NULL;
-  }    
 
   schemap->parserCtxt = parserCtxt;
   schemap->schemaPtr = schemaPtr;
-  schemap->validCtxt = validCtxt;
+  schemap->validCtxt = NULL;
     
   return schemap;
 }
 
+static schemaData *compile_schema(xmlDoc *schema)
+{
+  schemaData *schemap;
+
+  if ((schemap = parse_schema(schema)) == NULL) {
+    return NULL;
+  }
+  schemap->validCtxt = xmlSchemaNewValidCtxt(schemap->schemaPtr);
+  if (!schemap->validCtxt) {
+    fprintf(stderr, "Could not create XSD schema validation context.\n");
+    return NULL;
+  }    
+
+  return schemap;
+}
+
 static void free_validation(schemaData *schemap)
 {
 
@@ -79,13 +90,32 @@ static void free_validation(schemaData *schemap)
   
 }
 
-void schema_free_validation(packedobjectsContext *pc)
+void schema_free_validation(packedobjectsSchema *ps)
 {
   
-  free_validation(pc->schemap);
+  free_validation(ps->schemap);
   
 }
 
+// each context validates with its own context over the shared schema
+int schema_make_validation_context(packedobjectsContext *pc)
+{
+  xmlSchemaValidCtxtPtr validCtxt = NULL;
+
+  if ((validCtxt = xmlSchemaNewValidCtxt(pc->schema->schemap->schemaPtr)) == NULL) {
+    alert("Could not create XSD schema validation context.");
+    return -1;
+  }
+  pc->validCtxt = validCtxt;
+
+  return 0;
+}
+
+void schema_free_validation_context(packedobjectsContext *pc)
+{
+  xmlSchemaFreeValidCtxt(pc->validCtxt);
+}
+
 #if TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
 static char *CFStringCopyUTF8String(CFStringRef aString) {
     if (aString == NULL) {
@@ -238,37 +268,16 @@ static int validate_schema_sequence(xmlDocPtr doc)
   return 0;
 }
 
-int schema_setup_xpath(packedobjectsContext *pc)
-{
-  xmlXPathContextPtr xpathp = NULL;
-  
-  // setup xpath
-  xpathp = xmlXPathNewContext(pc->doc_canonical_schema);
-  if (xpathp == NULL) {
-    alert("Error in xmlXPathNewContext.");
-    return -1;
-  }
-
-  if(xmlXPathRegisterNs(xpathp, (const xmlChar *)NSPREFIX, (const xmlChar *)NSURL) != 0) {
-    alert("Error: unable to register NS.");
-    return -1;
-  }
-
-  pc->xpathp = xpathp;
-
-  return 0;
-}
-
-int schema_validate_schema(packedobjectsContext *pc)
+int schema_validate_schema(packedobjectsSchema *ps)
 {
 
   // validate the schema to make sure it conforms to packedobjects schema
-  if (validate_schema_rules(pc->doc_schema)) {
+  if (validate_schema_rules(ps->doc_schema)) {
     return -1;
   }
 
   // validate the schema to make sure repeating sequences conform to packedobjects schema
-  if (validate_schema_sequence(pc->doc_schema)) {
+  if (validate_schema_sequence(ps->doc_schema)) {
     return -1;
   }  
 
@@ -276,30 +285,22 @@ int schema_validate_schema(packedobjectsContext *pc)
   
 }
 
-int schema_setup_validation(packedobjectsContext *pc)
+int schema_setup_validation(packedobjectsSchema *ps)
 {
   schemaData *schemap = NULL;
   
-  // setup validation context
-  if ((schemap = compile_schema(pc->doc_schema)) == NULL) {
+  // contexts create their own validation context from this later
+  if ((schemap = parse_schema(ps->doc_schema)) == NULL) {
     alert("Failed to preprocess schema.");
     return -1;
   }
 
-  pc->schemap = schemap;  
+  ps->schemap = schemap;  
 
   return 0;
 }
 
-void schema_free_xpath(packedobjectsContext *pc)
-{
-
-  xmlXPathFreeContext(pc->xpathp);
-  
-
-}
-
-int schema_setup_schema(packedobjectsContext *pc, const char *schema_file)
+int schema_setup_schema(packedobjectsSchema *ps, const char *schema_file)
 {  
   xmlDoc *doc_schema = NULL;
   
@@ -309,13 +310,13 @@ int schema_setup_schema(packedobjectsContext *pc, const char *schema_file)
   }
   
   // set the schema
-  pc->doc_schema = doc_schema;  
+  ps->doc_schema = doc_schema;  
 
   return 0;
   
 }
 
-void schema_free(packedobjectsContext *pc)
+void schema_free(packedobjectsSchema *ps)
 {
-  xmlFreeDoc(pc->doc_schema);
+  xmlFreeDoc(ps->doc_schema);
 }
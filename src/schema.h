@@ -3,12 +3,12 @@
 
 #include "packedobjects.h"
 
-int schema_setup_schema(packedobjectsContext *pc, const char *schema_file);
-int schema_setup_xpath(packedobjectsContext *pc);
-int schema_validate_schema(packedobjectsContext *pc);
-int schema_setup_validation(packedobjectsContext *pc);
-void schema_free_validation(packedobjectsContext *pc);
-void schema_free_xpath(packedobjectsContext *pc);
-void schema_free(packedobjectsContext *pc);
+int schema_setup_schema(packedobjectsSchema *ps, const char *schema_file);
+int schema_validate_schema(packedobjectsSchema *ps);
+int schema_setup_validation(packedobjectsSchema *ps);
+void schema_free_validation(packedobjectsSchema *ps);
+int schema_make_validation_context(packedobjectsContext *pc);
+void schema_free_validation_context(packedobjectsContext *pc);
+void schema_free(packedobjectsSchema *ps);
 
 #endif
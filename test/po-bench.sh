@@ -0,0 +1,166 @@
+#!/bin/bash
+echo "PO bench"
+# run from this directory after make check
+BENCH=./../src/packedobjects-bench
+GEN=./../src/packedobjects-gen
+PO=./../src/packedobjects
+EXAMPLES=../examples
+
+dispatch()
+{
+    for f in personnel router-qos
+    do
+	$BENCH --bench dispatch --schema $EXAMPLES/$f.xsd --in $EXAMPLES/$f.xml --loop 100000
+    done
+}
+
+writer()
+{
+    $BENCH --bench writer --loop 10000000
+}
+
+reader()
+{
+    $BENCH --bench reader --loop 10000000
+}
+
+strings()
+{
+    $BENCH --bench strings --loop 10000000 || exit 1
+}
+
+threads()
+{
+    for f in personnel router-qos
+    do
+	$BENCH --bench threads --schema $EXAMPLES/$f.xsd --in $EXAMPLES/$f.xml --threads 16 --loop 1000 || exit 1
+    done
+}
+
+text()
+{
+    for x in $EXAMPLES/*.xml
+    do
+	f=${x%.xml}
+	$BENCH --bench text --schema $f.xsd --in $x --loop 10000 || exit 1
+    done
+}
+
+events()
+{
+    for f in personnel router-qos sensor
+    do
+	$BENCH --bench events --schema $EXAMPLES/$f.xsd --in $EXAMPLES/$f.xml --loop 10000 || exit 1
+    done
+}
+
+arena()
+{
+    for f in personnel vehicles baseball
+    do
+	$BENCH --bench arena --schema $EXAMPLES/$f.xsd --in $EXAMPLES/$f.xml --loop 1000 || exit 1
+    done
+}
+
+pool()
+{
+    for f in personnel vehicles
+    do
+	$BENCH --bench pool --schema $EXAMPLES/$f.xsd --in $EXAMPLES/$f.xml --loop 10000 || exit 1
+    done
+}
+
+batch()
+{
+    for f in personnel vehicles
+    do
+	$BENCH --bench batch --schema $EXAMPLES/$f.xsd --in $EXAMPLES/$f.xml --loop 100000 || exit 1
+    done
+}
+
+parallel()
+{
+    for f in personnel vehicles
+    do
+	$BENCH --bench parallel --schema $EXAMPLES/$f.xsd --in $EXAMPLES/$f.xml --threads 4 --loop 20000 || exit 1
+    done
+}
+
+validate()
+{
+    for x in $EXAMPLES/*.xml
+    do
+	f=${x%.xml}
+	$BENCH --bench validate --schema $f.xsd --in $x --loop 1000 || exit 1
+    done
+}
+
+compiled()
+{
+    for x in $EXAMPLES/*.xml
+    do
+	f=${x%.xml}
+	$BENCH --bench compiled --schema $f.xsd --in $x --loop 100 || exit 1
+    done
+}
+
+struct()
+{
+    for x in $EXAMPLES/*.xml
+    do
+	f=${x%.xml}
+	$BENCH --bench struct --schema $f.xsd --in $x --loop 10000 || exit 1
+    done
+}
+
+# the core library and generated code are built with no sight of libxml2
+core()
+{
+    tmp=$(mktemp -d)
+    ${CC:-cc} ${CFLAGS:--O2} -I./../src po-core.c -o $tmp/po-core -L./../src/.libs -lpackedobjects-core || exit 1
+    for x in $EXAMPLES/*.xml
+    do
+	f=${x%.xml}
+	$BENCH --bench core --schema $f.xsd --in $x --loop 10000 || exit 1
+	$PO --schema $f.xsd --compile $tmp/schema.poc || exit 1
+	$PO --schema $f.xsd --in $x --out $tmp/data.po || exit 1
+	LD_LIBRARY_PATH=./../src/.libs $tmp/po-core $tmp/schema.poc $tmp/data.po 10000 || exit 1
+	$GEN --schema $f.xsd --out $tmp/generated || exit 1
+	${CC:-cc} ${CFLAGS:--O2} -I$tmp -I./../src -c $tmp/generated.c -o $tmp/generated.o || exit 1
+    done
+    rm -rf $tmp
+}
+
+# generated code is built against the library like any other user of it
+gen()
+{
+    tmp=$(mktemp -d)
+    for x in $EXAMPLES/*.xml
+    do
+	f=${x%.xml}
+	$GEN --schema $f.xsd --out $tmp/generated || exit 1
+	root=$(sed -n 's/^void encode_\([A-Za-z0-9_]*\)(.*/\1/p' $tmp/generated.h)
+	${CC:-cc} ${CFLAGS:--O2} -I$tmp -I./../src $(pkg-config --cflags libxml-2.0) -DGEN_HEADER='"generated.h"' -DGEN_ROOT=$root \
+	    po-gen.c $tmp/generated.c -o $tmp/po-gen -L./../src/.libs -lpackedobjects -lpackedobjects-core $(pkg-config --libs libxml-2.0) || exit 1
+	LD_LIBRARY_PATH=./../src/.libs $tmp/po-gen $f.xsd $x 10000 || exit 1
+    done
+    rm -rf $tmp
+}
+
+dispatch
+writer
+reader
+strings
+threads
+text
+events
+arena
+pool
+batch
+parallel
+validate
+compiled
+gen
+struct
+core
+exit 0
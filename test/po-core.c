@@ -0,0 +1,87 @@
+/*
+ * built by po-bench.sh against libpackedobjects-core alone, without the
+ * libxml2 headers or library, as a device would be. decodes a PDU written
+ * by the packedobjects tool using the compiled schema it wrote
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+
+#include "core.h"
+
+static double elapsed_ns(struct timespec *start, struct timespec *end);
+static void exit_with_message(char *message);
+static void count_event(void *user, const char *name);
+static void count_string(void *user, const char *name, const char *value, size_t len);
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void exit_with_message(char *message)
+{
+  printf("Failed to run: %s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+static void count_event(void *user, const char *name)
+{
+  (*(long *)user)++;
+}
+
+static void count_string(void *user, const char *name, const char *value, size_t len)
+{
+  (*(long *)user)++;
+}
+
+int main(int argc, char **argv)
+{
+  coreSchema *cs = NULL;
+  packedDecode *decodep = NULL;
+  core_handler h = { .start_element = count_event, .string = count_string };
+  struct timespec start, end;
+  double load_ns, decode_ns;
+  FILE *fp = NULL;
+  char *pdu = NULL;
+  long events = 0;
+  int i, loop, bytes;
+
+  if (argc != 4) {
+    printf("usage: po-core <compiled schema> <pdu> <loop>\n");
+    exit(EXIT_FAILURE);
+  }
+  loop = atoi(argv[3]);
+  if ((fp = fopen(argv[2], "rb")) == NULL) exit_with_message("did not find pdu file");
+  fseek(fp, 0, SEEK_END);
+  bytes = ftell(fp);
+  rewind(fp);
+  if ((pdu = malloc(bytes + 1)) == NULL) exit_with_message("out of memory");
+  if (fread(pdu, 1, bytes, fp) != bytes) exit_with_message("could not read pdu file");
+  fclose(fp);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if ((cs = core_schema_load(argv[1])) == NULL) exit_with_message("failed to load compiled schema");
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  load_ns = elapsed_ns(&start, &end);
+  if ((decodep = initializeDecode(NULL, 0)) == NULL) exit_with_message("out of memory");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if (core_decode(cs, decodep, pdu, bytes, &h, &events)) exit_with_message("decode failed");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  decode_ns = elapsed_ns(&start, &end);
+  if (events == 0) exit_with_message("decode found nothing");
+
+  printf("po-core: %s, load %.2f us, decode %.2f us, %ld events\n",
+         argv[2], load_ns / 1e3, decode_ns / loop / 1e3, events / loop);
+
+  freeDecode(decodep);
+  core_schema_free(cs);
+  free(pdu);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+/*
+ * built by po-bench.sh against the code packedobjects-gen wrote for one
+ * schema, with GEN_HEADER naming its header and GEN_ROOT its top level
+ * struct. the generated functions must give back the interpreter's PDU
+ * bit for bit after decoding it
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+
+#include "packedobjects.h"
+#include GEN_HEADER
+
+#define CAT(a, b) a ## b
+#define NAME(prefix, root) CAT(prefix, root)
+#define GEN_ENCODE NAME(encode_, GEN_ROOT)
+#define GEN_DECODE NAME(decode_, GEN_ROOT)
+#define GEN_FREE NAME(free_, GEN_ROOT)
+
+static double elapsed_ns(struct timespec *start, struct timespec *end);
+static void exit_with_message(char *message);
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void exit_with_message(char *message)
+{
+  printf("Failed to run: %s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  packedobjectsContext *pc = NULL;
+  packedEncode *encodep = NULL;
+  packedDecode *decodep = NULL;
+  xmlDocPtr doc = NULL;
+  xmlDocPtr out = NULL;
+  struct GEN_ROOT s;
+  struct timespec start, end;
+  double encode_ns, decode_ns, gen_encode_ns, gen_decode_ns;
+  char *pdu = NULL;
+  int i, loop, bytes, gen_bytes = 0;
+
+  if (argc != 4) {
+    printf("usage: po-gen <schema> <xml> <loop>\n");
+    exit(EXIT_FAILURE);
+  }
+  loop = atoi(argv[3]);
+  // the generated code trusts its data so leave validation out of both
+  if ((pc = init_packedobjects(argv[1], 0, NO_DATA_VALIDATION)) == NULL) exit_with_message("failed to initialise libpackedobjects");
+  if ((doc = packedobjects_new_doc(argv[2])) == NULL) exit_with_message("did not find .xml file");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    packedobjects_encode(pc, doc);
+    if (pc->encode_error) exit_with_message("encode failed");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  encode_ns = elapsed_ns(&start, &end);
+  bytes = pc->bytes;
+  if ((pdu = malloc(bytes)) == NULL) exit_with_message("out of memory");
+  memcpy(pdu, pc->encodep->pdu, bytes);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    if ((out = packedobjects_decode_n(pc, pdu, bytes)) == NULL) exit_with_message("decode failed");
+    xmlFreeDoc(out);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  decode_ns = elapsed_ns(&start, &end);
+
+  if ((decodep = initializeDecode(pdu, bytes)) == NULL) exit_with_message("out of memory");
+  if (setjmp(decodep->env)) exit_with_message("generated decode failed");
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    resetDecode(decodep, pdu, bytes);
+    GEN_DECODE(decodep, &s);
+    // the last one is encoded below
+    if (i < loop - 1) GEN_FREE(decodep, &s);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  gen_decode_ns = elapsed_ns(&start, &end);
+
+  if ((encodep = initializeEncode(malloc(MAX_PDU), MAX_PDU)) == NULL) exit_with_message("out of memory");
+  encodep->growable = 1;
+  if (setjmp(encodep->env)) exit_with_message("generated encode failed");
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < loop; i++) {
+    GEN_ENCODE(&s, encodep);
+    gen_bytes = finalizeEncode(encodep);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  gen_encode_ns = elapsed_ns(&start, &end);
+  if ((gen_bytes != bytes) || memcmp(encodep->pdu, pdu, bytes)) exit_with_message("generated pdu differs");
+
+  printf("gen: %s, encode %.2f us, generated %.3f us (x%.0f), decode %.2f us, generated %.3f us (x%.0f)\n",
+         argv[2], encode_ns / loop / 1e3, gen_encode_ns / loop / 1e3, encode_ns / gen_encode_ns,
+         decode_ns / loop / 1e3, gen_decode_ns / loop / 1e3, decode_ns / gen_decode_ns);
+
+  GEN_FREE(decodep, &s);
+  freeDecode(decodep);
+  free(encodep->pdu);
+  freeEncode(encodep);
+  free(pdu);
+  xmlFreeDoc(doc);
+  free_packedobjects(pc);
+  xmlCleanupParser();
+
+  return EXIT_SUCCESS;
+}
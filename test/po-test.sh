@@ -73,6 +73,79 @@ clearFile()
 	rm $xmltoClear.new.xml $xmltoClear.po
     fi
 }
+# round trip and negative tests, each failure is counted
+failures=0
+fail()
+{
+    echo "FAILED: $1"
+    failures=$((failures+1))
+}
+# check (check) on its own or (check schema.xsd file.xml)
+check()
+{
+    if [ $# -eq 1 ]
+    then
+	out=$(./../src/packedobjects-check --check $1 2> /dev/null) || fail "$1 ${out##*Failed to run: }"
+    else
+	out=$(./../src/packedobjects-check --check $1 --schema $2 --in $3 2> /dev/null) || fail "$1 $3 ${out##*Failed to run: }"
+    fi
+}
+# truncated (file.xsd file.xml) a PDU a byte short must not decode
+truncated()
+{
+    tmp=$(mktemp -d)
+    ./../src/packedobjects --schema $1 --in $2 --out $tmp/full.po || fail "encode $2"
+    bytes=$(wc -c < $tmp/full.po)
+    if [ $bytes -gt 0 ]
+    then
+	head -c $((bytes-1)) $tmp/full.po > $tmp/short.po
+	# DECODE_PDU_TRUNCATED
+	./../src/packedobjects --schema $1 --in $tmp/short.po --out $tmp/short.xml 2>&1 | grep -q "error 114" || fail "truncated $2"
+    fi
+    rm -rf $tmp
+}
+# damaged (file.xsd) a compiled schema missing its last byte must not load
+damaged()
+{
+    tmp=$(mktemp -d)
+    ./../src/packedobjects --schema $1 --compile $tmp/full.poc > /dev/null || fail "compile $1"
+    bytes=$(wc -c < $tmp/full.poc)
+    head -c $((bytes-1)) $tmp/full.poc > $tmp/short.poc
+    ./../src/packedobjects --schema $tmp/short.poc --in $tmp/x.xml --out $tmp/x.po > /dev/null 2>&1 && fail "damaged $1"
+    rm -rf $tmp
+}
+# hostile (file.xsd name error bytes) a crafted PDU must fail with error
+hostile()
+{
+    tmp=$(mktemp -d)
+    printf "$4" > $tmp/$2.po
+    # short of memory so a count taken on trust fails to allocate
+    out=$(ulimit -v 1048576; ./../src/packedobjects-check --check hostile --schema $1 --in $tmp/$2.po 2> /dev/null) || fail "hostile $2 ${out##*Failed to run: }"
+    echo "$out" | grep -q "error $3" || fail "hostile $2 $out"
+    rm -rf $tmp
+}
+tests()
+{
+    check bits
+    check strings
+    for file in ../examples/*.xml
+    do
+	f=${file%.*}
+	for c in threads text arena pool batch parallel validate compiled struct core
+	do
+	    check $c $f.xsd $file
+	done
+	truncated $f.xsd $file
+	damaged $f.xsd
+    done
+    # DECODE_DOCUMENT_FAILED for 2^30 nulls, DECODE_PDU_TRUNCATED for
+    # 245760 booleans in the 4 bits left and for INT_MAX of them, which
+    # a struct decode would otherwise try to allocate
+    hostile ../examples/nulls.xsd empties 118 '\x90\x00\x00\x00\x00'
+    hostile ../examples/nulls.xsd flags 114 '\x00\x20\x00\x3c\x00\x00'
+    hostile ../examples/nulls.xsd array 114 '\x00\x27\xff\xff\xff\xf0'
+    echo "$failures failures"
+}
 #init (<file.xml>)
 init()
 {
@@ -132,7 +205,8 @@ if [ $# -eq 0 ]
 then
     init
     clearFile
-    exit 0
+    tests
+    exit $failures
 elif [ $# -eq 2 ]
 then
     if [ -f $argfile ]